@@ -0,0 +1,109 @@
+// Fan-curve micro-benchmark: the compiled lookup table against the linear setpoint scan that
+// fanctl used before curves were compiled. Every round evaluates one temperature per device,
+// as a fanctl pass over the fleet does.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "curve.h"
+#include "timeutil.h"
+
+#define BENCH_DEVICES 1024
+#define BENCH_ROUNDS 2000
+
+// The pre-table implementation, kept verbatim (integer setpoints) as the baseline
+typedef struct {
+  unsigned int temp;
+  unsigned int fan;
+} legacy_setpoint_t;
+
+static unsigned int interpolate_fan_speed(unsigned int current_temp,
+                                          const legacy_setpoint_t* setpoints, int count) {
+  if (count == 0) return 0;
+
+  if (current_temp <= setpoints[0].temp) return setpoints[0].fan;
+  if (current_temp >= setpoints[count - 1].temp) return setpoints[count - 1].fan;
+
+  for (int i = 0; i < count - 1; i++) {
+    if (current_temp >= setpoints[i].temp && current_temp <= setpoints[i + 1].temp) {
+      unsigned int temp_range = setpoints[i + 1].temp - setpoints[i].temp;
+      unsigned int fan_range = setpoints[i + 1].fan - setpoints[i].fan;
+      unsigned int temp_offset = current_temp - setpoints[i].temp;
+
+      return setpoints[i].fan + (fan_range * temp_offset) / temp_range;
+    }
+  }
+
+  return setpoints[0].fan;
+}
+
+static unsigned int temps[BENCH_ROUNDS][BENCH_DEVICES];
+static volatile unsigned int sink;
+
+static double bench_legacy(const legacy_setpoint_t* sp, int count) {
+  unsigned int acc = 0;
+  uint64_t start = monotonic_ns();
+  for (int r = 0; r < BENCH_ROUNDS; r++)
+    for (int d = 0; d < BENCH_DEVICES; d++) acc += interpolate_fan_speed(temps[r][d], sp, count);
+  uint64_t elapsed = monotonic_ns() - start;
+  sink = acc;
+  return (double)elapsed / ((double)BENCH_ROUNDS * BENCH_DEVICES);
+}
+
+static double bench_table(const fan_curve_t* curve) {
+  unsigned int acc = 0;
+  uint64_t start = monotonic_ns();
+  for (int r = 0; r < BENCH_ROUNDS; r++)
+    for (int d = 0; d < BENCH_DEVICES; d++) acc += curve_fan_speed(curve, temps[r][d]);
+  uint64_t elapsed = monotonic_ns() - start;
+  sink = acc;
+  return (double)elapsed / ((double)BENCH_ROUNDS * BENCH_DEVICES);
+}
+
+int main(void) {
+  srand(1);
+  for (int r = 0; r < BENCH_ROUNDS; r++)
+    for (int d = 0; d < BENCH_DEVICES; d++) temps[r][d] = 25 + rand() % 75;
+
+  static fan_curve_t curve;
+  const int sizes[] = {3, 8, CURVE_MAX_SETPOINTS};
+  printf("%-10s %9s %12s %12s %9s %10s\n", "setpoints", "curve", "scan ns/op", "table ns/op",
+         "speedup", "max diff");
+
+  for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++) {
+    int count = sizes[n];
+    legacy_setpoint_t legacy[CURVE_MAX_SETPOINTS];
+    setpoint_t sp[CURVE_MAX_SETPOINTS];
+    for (int i = 0; i < count; i++) {
+      legacy[i].temp = 30 + i * 60 / count;
+      legacy[i].fan = 20 + i * 80 / count;
+      sp[i].temp = legacy[i].temp;
+      sp[i].fan = legacy[i].fan;
+    }
+
+    double scan_ns = bench_legacy(legacy, count);
+    for (int type = CURVE_LINEAR; type <= CURVE_STEP; type++) {
+      uint64_t compile_start = monotonic_ns();
+      curve_compile(&curve, (curve_type_t)type, sp, count);
+      uint64_t compile_ns = monotonic_ns() - compile_start;
+      double table_ns = bench_table(&curve);
+
+      // The scan truncates while the table rounds, so linear curves may differ by 1%
+      int max_diff = 0;
+      for (unsigned int t = 0; t < CURVE_MAX_TEMP_C && type == CURVE_LINEAR; t++) {
+        int diff = abs((int)curve_fan_speed(&curve, t) -
+                       (int)interpolate_fan_speed(t, legacy, count));
+        if (diff > max_diff) max_diff = diff;
+      }
+
+      printf("%-10d %9s %12.2f %12.2f %8.1fx ", count, curve_type_name((curve_type_t)type),
+             scan_ns, table_ns, scan_ns / table_ns);
+      if (type == CURVE_LINEAR)
+        printf("%9d%%", max_diff);
+      else
+        printf("%10s", "-");
+      printf("  (compile %.1f us)\n", compile_ns / 1e3);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,192 @@
+// Macro-benchmark suite: whole invocations of the tool against the simulated backend, which is
+// compiled into every build and stands in for NVML. status and info json are timed end to end,
+// NVML init included; fanctl runs for a fixed time at the shortest interval and is charged its
+// CPU time per control pass. Every child's wall and CPU time comes from wait4(), and the
+// simulator is seeded, so runs on the same machine are comparable. Results are printed as one
+// JSON document.
+//
+// Usage: bench_macro [path/to/nvml-tool]
+// Environment: BENCH_DEVICES (default 8), BENCH_RUNS (5), BENCH_FANCTL_MS (2000),
+//              BENCH_LATENCY_US (0, added to every simulated NVML call)
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "fanconf.h"
+#include "timeutil.h"
+
+#define MAX_RUNS 64
+
+typedef struct {
+  double wall_ms;
+  double cpu_ms; // User plus system time of the child
+  unsigned long lines; // Output lines containing "->" (fanctl control passes, per device)
+} run_t;
+
+static int env_int(const char* name, int fallback, int min) {
+  const char* value = getenv(name);
+  if (!value || !*value) return fallback;
+  int n = atoi(value);
+  return n < min ? min : n;
+}
+
+static double timeval_ms(const struct timeval* tv) {
+  return tv->tv_sec * 1e3 + tv->tv_usec / 1e3;
+}
+
+// Run the tool with argv; if stop_ms > 0, stop it with SIGINT after that long as a user would
+static int run_tool(char* const argv[], int stop_ms, run_t* run) {
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) != 0) {
+    perror("Error: pipe");
+    return -1;
+  }
+
+  uint64_t start = monotonic_ns();
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("Error: fork");
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  if (pid == 0) {
+    dup2(fds[1], STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) dup2(null, STDERR_FILENO);
+    execv(argv[0], argv);
+    _exit(127);
+  }
+  close(fds[1]);
+
+  // Count lines as they arrive so a long fanctl run never blocks on a full pipe
+  uint64_t stop_at = stop_ms > 0 ? start + (uint64_t)stop_ms * 1000000 : 0;
+  int stopped = 0;
+  char buf[4096], prev = 0;
+  run->lines = 0;
+  for (;;) {
+    int timeout = -1;
+    if (stop_at && !stopped) {
+      uint64_t now = monotonic_ns();
+      if (now >= stop_at) {
+        kill(pid, SIGINT);
+        stopped = 1;
+      } else {
+        timeout = (int)((stop_at - now) / 1000000) + 1;
+      }
+    }
+    struct pollfd pfd = {fds[0], POLLIN, 0};
+    int ready = poll(&pfd, 1, timeout);
+    if (ready < 0 && errno != EINTR) break;
+    if (ready <= 0) continue;
+    ssize_t n = read(fds[0], buf, sizeof(buf));
+    if (n <= 0) break;
+    for (ssize_t i = 0; i < n; i++) {
+      if (prev == '-' && buf[i] == '>') run->lines++;
+      prev = buf[i];
+    }
+  }
+  close(fds[0]);
+
+  int status;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) < 0) {
+    perror("Error: wait4");
+    return -1;
+  }
+  run->wall_ms = (monotonic_ns() - start) / 1e6;
+  run->cpu_ms = timeval_ms(&usage.ru_utime) + timeval_ms(&usage.ru_stime);
+  if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0 && !stopped)) {
+    fprintf(stderr, "Error: %s %s exited abnormally (status %d)\n", argv[0], argv[1], status);
+    return -1;
+  }
+  return 0;
+}
+
+static int compare_double(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static double median(double* values, int count) {
+  qsort(values, count, sizeof(double), compare_double);
+  return values[count / 2];
+}
+
+// One-shot command: median and minimum wall time, median CPU time
+static int bench_command(const char* name, char* const argv[], int runs, int last) {
+  double wall[MAX_RUNS], cpu[MAX_RUNS];
+  run_t run;
+  if (run_tool(argv, 0, &run) != 0) return -1; // Warm the page cache
+  for (int r = 0; r < runs; r++) {
+    if (run_tool(argv, 0, &run) != 0) return -1;
+    wall[r] = run.wall_ms;
+    cpu[r] = run.cpu_ms;
+  }
+  double wall_median = median(wall, runs);
+  printf("    {\"name\": \"%s\", \"runs\": %d, \"wall_ms_median\": %.3f, \"wall_ms_min\": %.3f, "
+         "\"cpu_ms_median\": %.3f}%s\n",
+         name, runs, wall_median, wall[0], median(cpu, runs), last ? "" : ",");
+  return 0;
+}
+
+// Control loop: passes completed and CPU time per pass over a fixed run time
+static int bench_fanctl(char* const argv[], int devices, int runs, int duration_ms) {
+  double per_pass[MAX_RUNS];
+  unsigned long passes = 0;
+  for (int r = 0; r < runs; r++) {
+    run_t run;
+    if (run_tool(argv, duration_ms, &run) != 0) return -1;
+    unsigned long n = run.lines / devices;
+    if (n == 0) {
+      fprintf(stderr, "Error: fanctl completed no control passes\n");
+      return -1;
+    }
+    per_pass[r] = run.cpu_ms * 1e3 / n;
+    passes += n;
+  }
+  printf("    {\"name\": \"fanctl\", \"runs\": %d, \"duration_ms\": %d, \"interval_ms\": %d, "
+         "\"passes_mean\": %.1f, \"cpu_us_per_pass_median\": %.3f}\n",
+         runs, duration_ms, MIN_INTERVAL_MS, (double)passes / runs, median(per_pass, runs));
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  char* tool = argc > 1 ? argv[1] : "build/nvml-tool";
+  int devices = env_int("BENCH_DEVICES", 8, 1);
+  int runs = env_int("BENCH_RUNS", 5, 1);
+  int duration_ms = env_int("BENCH_FANCTL_MS", 2000, 5 * MIN_INTERVAL_MS);
+  int latency_us = env_int("BENCH_LATENCY_US", 0, 0);
+  if (runs > MAX_RUNS) runs = MAX_RUNS;
+  if (access(tool, X_OK) != 0) {
+    fprintf(stderr, "Error: Cannot execute %s\n", tool);
+    return 1;
+  }
+
+  char backend[128], interval[16];
+  snprintf(backend, sizeof(backend), "sim:devices=%d,seed=1,latency_us=%d", devices, latency_us);
+  snprintf(interval, sizeof(interval), "%d", MIN_INTERVAL_MS);
+  setenv("NVML_TOOL_BACKEND", backend, 1);
+  setenv("NVML_TOOL_CACHE", "off", 1);
+  signal(SIGPIPE, SIG_IGN);
+
+  char* status_argv[] = {tool, "status", "--direct", NULL};
+  char* info_argv[] = {tool, "info", "json", "--direct", NULL};
+  char* fanctl_argv[] = {tool, "fanctl", "40:30", "60:50", "80:90", "-i", interval, NULL};
+
+  printf("{\n  \"suite\": \"macro\",\n  \"backend\": \"%s\",\n  \"results\": [\n", backend);
+  if (bench_command("status", status_argv, runs, 0) != 0 ||
+      bench_command("info_json", info_argv, runs, 0) != 0 ||
+      bench_fanctl(fanctl_argv, devices, runs, duration_ms) != 0)
+    return 1;
+  printf("  ]\n}\n");
+  return 0;
+}
@@ -0,0 +1,181 @@
+// Micro-benchmark suite for the hot helpers of the CLI: the argument parsers, the compiled fan
+// curve lookup, temperature conversion and the info/status formatters. Inputs are fixed and
+// every case runs a fixed number of operations per repetition, pinned to one CPU, so runs on the
+// same machine are comparable. Results are printed as one JSON document.
+//
+// Usage: bench_micro [REPS]   (default 7)
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "args.h"
+#include "curve.h"
+#include "format.h"
+#include "timeutil.h"
+
+#define BENCH_REPS 7
+#define BENCH_TEMPS 4096
+
+typedef struct {
+  const char* name;
+  long ops; // Operations per repetition
+  void (*run)(long ops);
+} bench_case_t;
+
+static volatile unsigned long sink;
+static unsigned int temps[BENCH_TEMPS];
+static fan_curve_t curves[CURVE_STEP + 1];
+static telemetry_t sample;
+static FILE* devnull;
+
+static char* setpoint_argv[] = {"nvml-tool", "fanctl", "40:30", "55:45", "62.5:55",
+                                "70:70",     "80:90",  "90:100", "-d",  "0-7"};
+#define SETPOINT_ARGC ((int)(sizeof(setpoint_argv) / sizeof(setpoint_argv[0])))
+
+static void run_parse_setpoints(long ops) {
+  setpoint_t sp[CURVE_MAX_SETPOINTS];
+  unsigned long acc = 0;
+  for (long i = 0; i < ops; i++)
+    acc += parse_setpoints(SETPOINT_ARGC, setpoint_argv, 2, sp, CURVE_MAX_SETPOINTS);
+  sink = acc;
+}
+
+static void run_parse_device_range(long ops) {
+  int devices[64];
+  unsigned long acc = 0;
+  for (long i = 0; i < ops; i++) acc += parse_device_range("0,2-5,8,10-15,31", devices, 64);
+  sink = acc;
+}
+
+static void run_curve(curve_type_t type, long ops) {
+  const fan_curve_t* curve = &curves[type];
+  unsigned long acc = 0;
+  for (long i = 0; i < ops; i++) acc += curve_fan_speed(curve, temps[i & (BENCH_TEMPS - 1)]);
+  sink = acc;
+}
+
+static void run_curve_linear(long ops) { run_curve(CURVE_LINEAR, ops); }
+static void run_curve_cubic(long ops) { run_curve(CURVE_CUBIC, ops); }
+static void run_curve_step(long ops) { run_curve(CURVE_STEP, ops); }
+
+static void run_curve_compile(long ops) {
+  setpoint_t sp[CURVE_MAX_SETPOINTS];
+  int count = parse_setpoints(SETPOINT_ARGC, setpoint_argv, 2, sp, CURVE_MAX_SETPOINTS);
+  for (long i = 0; i < ops; i++) curve_compile(&curves[CURVE_CUBIC], CURVE_CUBIC, sp, count);
+  sink = curves[CURVE_CUBIC].max_fan;
+}
+
+static void run_convert_temperature(long ops) {
+  static const char units[] = "CFK";
+  double acc = 0;
+  for (long i = 0; i < ops; i++)
+    acc += convert_temperature(temps[i & (BENCH_TEMPS - 1)], units[i % 3]);
+  sink = (unsigned long)acc;
+}
+
+static void run_status(long ops) {
+  for (long i = 0; i < ops; i++) print_status_cli(devnull, &sample, (int)(i & 7), 'C');
+  fflush(devnull);
+}
+
+static void run_info_human(long ops) {
+  for (long i = 0; i < ops; i++) print_device_info_human(devnull, &sample, (int)(i & 7), 'C');
+  fflush(devnull);
+}
+
+static void run_info_json(long ops) {
+  for (long i = 0; i < ops; i++) print_device_info_json(devnull, &sample, (int)(i & 7), 'C');
+  fflush(devnull);
+}
+
+static const bench_case_t cases[] = {
+    {"parse_setpoints", 200000, run_parse_setpoints},
+    {"parse_device_range", 200000, run_parse_device_range},
+    {"curve_fan_speed.linear", 20000000, run_curve_linear},
+    {"curve_fan_speed.cubic", 20000000, run_curve_cubic},
+    {"curve_fan_speed.step", 20000000, run_curve_step},
+    {"curve_compile.cubic", 2000, run_curve_compile},
+    {"convert_temperature", 20000000, run_convert_temperature},
+    {"print_status_cli", 500000, run_status},
+    {"print_device_info_human", 200000, run_info_human},
+    {"print_device_info_json", 200000, run_info_json},
+};
+#define CASE_COUNT ((int)(sizeof(cases) / sizeof(cases[0])))
+
+static int compare_double(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static void setup(void) {
+  // Fixed xorshift stream: the same temperatures on every run
+  uint32_t x = 2463534242u;
+  for (int i = 0; i < BENCH_TEMPS; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    temps[i] = 25 + x % 80;
+  }
+
+  setpoint_t sp[CURVE_MAX_SETPOINTS];
+  int count = parse_setpoints(SETPOINT_ARGC, setpoint_argv, 2, sp, CURVE_MAX_SETPOINTS);
+  for (int type = CURVE_LINEAR; type <= CURVE_STEP; type++)
+    curve_compile(&curves[type], (curve_type_t)type, sp, count);
+
+  sample.valid = TM_ALL;
+  snprintf(sample.name, sizeof(sample.name), "NVIDIA GeForce RTX 3090");
+  snprintf(sample.uuid, sizeof(sample.uuid), "GPU-51a00000-0000-4000-8000-000000000000");
+  sample.temperature = 67;
+  sample.fan_speed = 54;
+  sample.power_usage = 318250;
+  sample.power_limit = 350000;
+  sample.memory.total = 24ULL << 30;
+  sample.memory.used = 18ULL << 30;
+  sample.memory.free = sample.memory.total - sample.memory.used;
+}
+
+int main(int argc, char* argv[]) {
+  int reps = argc > 1 ? atoi(argv[1]) : BENCH_REPS;
+  if (reps < 1) {
+    fprintf(stderr, "Error: Invalid repetition count '%s'\n", argv[1]);
+    return 1;
+  }
+
+  devnull = fopen("/dev/null", "w");
+  if (!devnull) {
+    perror("Error: /dev/null");
+    return 1;
+  }
+  setvbuf(devnull, NULL, _IOFBF, 1 << 16);
+
+  // Migrations between CPUs are the largest source of run-to-run noise
+  int cpu = sched_getcpu();
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+  }
+
+  setup();
+  printf("{\n  \"suite\": \"micro\",\n  \"reps\": %d,\n  \"results\": [\n", reps);
+  for (int c = 0; c < CASE_COUNT; c++) {
+    const bench_case_t* b = &cases[c];
+    double ns[reps];
+    b->run(b->ops / 10 + 1); // Warm caches and branch predictors
+    for (int r = 0; r < reps; r++) {
+      uint64_t start = monotonic_ns();
+      b->run(b->ops);
+      ns[r] = (double)(monotonic_ns() - start) / b->ops;
+    }
+    qsort(ns, reps, sizeof(double), compare_double);
+    printf("    {\"name\": \"%s\", \"ops\": %ld, \"ns_per_op_median\": %.3f, "
+           "\"ns_per_op_min\": %.3f, \"ns_per_op_max\": %.3f}%s\n",
+           b->name, b->ops, ns[reps / 2], ns[0], ns[reps - 1], c == CASE_COUNT - 1 ? "" : ",");
+  }
+  printf("  ]\n}\n");
+  fclose(devnull);
+  return 0;
+}
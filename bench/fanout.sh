@@ -0,0 +1,33 @@
+#!/bin/sh
+# End-to-end latency of one `status` invocation against simulated GPUs, sequential (-j 1)
+# against the parallel fan-out (-j auto), as the device count grows. Every simulated call
+# takes LATENCY_US, roughly what a throttled GPU costs per NVML query.
+#
+# Usage: bench/fanout.sh [path/to/nvml-tool]
+set -eu
+
+TOOL=${1:-build/nvml-tool}
+LATENCY_US=${LATENCY_US:-2000}
+RUNS=${RUNS:-5}
+COUNTS=${COUNTS:-"1 2 4 8 16 32"}
+
+# Median wall time in ms of RUNS invocations
+measure() {
+  i=0
+  while [ "$i" -lt "$RUNS" ]; do
+    start=$(date +%s%N)
+    NVML_TOOL_BACKEND="sim:devices=$1,latency_us=$LATENCY_US" NVML_TOOL_CACHE=off \
+      "$TOOL" status --direct -j "$2" >/dev/null
+    end=$(date +%s%N)
+    echo $(((end - start) / 1000))
+    i=$((i + 1))
+  done | sort -n | awk '{ v[NR] = $1 } END { printf "%.2f", v[int((NR + 1) / 2)] / 1000 }'
+}
+
+printf "%-8s %12s %12s %9s\n" devices "-j 1 ms" "-j auto ms" speedup
+for n in $COUNTS; do
+  seq_ms=$(measure "$n" 1)
+  par_ms=$(measure "$n" auto)
+  printf "%-8s %12s %12s %8.1fx\n" "$n" "$seq_ms" "$par_ms" \
+    "$(awk -v a="$seq_ms" -v b="$par_ms" 'BEGIN { print (b > 0 ? a / b : 0) }')"
+done
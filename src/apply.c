@@ -0,0 +1,244 @@
+#define _GNU_SOURCE
+#include "apply.h"
+
+#include <nvml.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "backend.h"
+#include "fanout.h"
+
+#define APPLY_MAX_FANS 16
+
+typedef struct {
+  int device_id;
+  nvmlDevice_t device;
+  unsigned int old_limit_mw; // State before the change, for rollback
+  unsigned int num_fans;
+  nvmlFanControlPolicy_t old_policy[APPLY_MAX_FANS];
+  unsigned int old_speed; // Reported speed, restored to fans that were already manual
+  unsigned int applied;   // Successful sets: the power limit, or one per fan
+  int failed;
+} apply_target_t;
+
+typedef struct {
+  apply_kind_t kind;
+  unsigned int value;
+  unsigned int device_count;
+  apply_target_t* targets;
+} apply_batch_t;
+
+static int validate_one(int index, FILE* out, FILE* err, void* ctx) {
+  (void)out;
+  apply_batch_t* b = ctx;
+  apply_target_t* t = &b->targets[index];
+  nvmlReturn_t result;
+
+  if (t->device_id >= (int)b->device_count) {
+    fprintf(err, "Error: Device ID %d not found (available: 0-%d)\n", t->device_id,
+            b->device_count - 1);
+    return 1;
+  }
+  result = gpu->get_handle_by_index(t->device_id, &t->device);
+  if (result != NVML_SUCCESS) {
+    fprintf(err, "Error: Failed to get device handle for device %d (%s)\n", t->device_id,
+            gpu->error_string(result));
+    return 1;
+  }
+
+  if (b->kind == APPLY_POWER_LIMIT) {
+    unsigned int min_limit, max_limit;
+    result = gpu->get_power_limit_constraints(t->device, &min_limit, &max_limit);
+    if (result != NVML_SUCCESS) {
+      fprintf(err, "%d:Error: Cannot get power limit constraints (%s)\n", t->device_id,
+              gpu->error_string(result));
+      return 1;
+    }
+    if (b->value * 1000 < min_limit || b->value * 1000 > max_limit) {
+      fprintf(err, "%d:Error: Power limit %uW outside valid range (%.2f-%.2fW)\n", t->device_id,
+              b->value, min_limit / 1000.0, max_limit / 1000.0);
+      return 1;
+    }
+    result = gpu->get_power_limit(t->device, &t->old_limit_mw);
+    if (result != NVML_SUCCESS) {
+      fprintf(err, "%d:Error: Cannot read the current power limit to restore on failure (%s)\n",
+              t->device_id, gpu->error_string(result));
+      return 1;
+    }
+    return 0;
+  }
+
+  result = gpu->get_num_fans(t->device, &t->num_fans);
+  if (result != NVML_SUCCESS) {
+    fprintf(err, "%d:Error: Cannot get number of fans (%s)\n", t->device_id,
+            gpu->error_string(result));
+    return 1;
+  }
+  if (t->num_fans == 0) {
+    fprintf(err, "%d:Error: Device has no controllable fans\n", t->device_id);
+    return 1;
+  }
+  if (t->num_fans > APPLY_MAX_FANS) t->num_fans = APPLY_MAX_FANS;
+  for (unsigned int fan = 0; fan < t->num_fans; fan++) {
+    // Where the policy cannot be read, rolling back hands the fan to the driver
+    if (gpu->get_fan_control_policy(t->device, fan, &t->old_policy[fan]) != NVML_SUCCESS)
+      t->old_policy[fan] = NVML_FAN_POLICY_TEMPERATURE_CONTINOUS_SW;
+  }
+  if (gpu->get_fan_speed(t->device, &t->old_speed) != NVML_SUCCESS)
+    t->old_speed = 100; // Err on the side of cooling
+  return 0;
+}
+
+static int set_one(int index, FILE* out, FILE* err, void* ctx) {
+  (void)out;
+  apply_batch_t* b = ctx;
+  apply_target_t* t = &b->targets[index];
+  nvmlReturn_t result;
+
+  if (b->kind == APPLY_POWER_LIMIT) {
+    result = gpu->set_power_limit(t->device, b->value * 1000);
+    if (result == NVML_SUCCESS) {
+      t->applied = 1;
+    } else {
+      fprintf(err, "%d:Error: Failed to set power limit (%s)\n", t->device_id,
+              gpu->error_string(result));
+      t->failed = 1;
+    }
+    return t->failed;
+  }
+
+  for (unsigned int fan = 0; fan < t->num_fans; fan++) {
+    result = gpu->set_fan_speed(t->device, fan, b->value);
+    if (result == NVML_SUCCESS) {
+      t->applied++;
+    } else {
+      fprintf(err, "%d:Fan%u:Error: %s\n", t->device_id, fan, gpu->error_string(result));
+      t->failed = 1;
+    }
+  }
+  return t->failed;
+}
+
+// A fan speed cannot be read back as commanded (only as measured), so fans are checked for
+// having switched to manual control
+static int verify_one(int index, FILE* out, FILE* err, void* ctx) {
+  (void)out;
+  apply_batch_t* b = ctx;
+  apply_target_t* t = &b->targets[index];
+  nvmlReturn_t result;
+
+  if (b->kind == APPLY_POWER_LIMIT) {
+    unsigned int limit_mw;
+    result = gpu->get_power_limit(t->device, &limit_mw);
+    if (result != NVML_SUCCESS) {
+      fprintf(err, "%d:Error: Cannot read back power limit (%s)\n", t->device_id,
+              gpu->error_string(result));
+      t->failed = 1;
+    } else if (limit_mw != b->value * 1000) {
+      fprintf(err, "%d:Error: Power limit reads back as %.2fW\n", t->device_id,
+              limit_mw / 1000.0);
+      t->failed = 1;
+    }
+    return t->failed;
+  }
+
+  for (unsigned int fan = 0; fan < t->num_fans; fan++) {
+    nvmlFanControlPolicy_t policy;
+    result = gpu->get_fan_control_policy(t->device, fan, &policy);
+    if (result == NVML_SUCCESS && policy != NVML_FAN_POLICY_MANUAL) {
+      fprintf(err, "%d:Fan%u:Error: Still under automatic control after set\n", t->device_id,
+              fan);
+      t->failed = 1;
+    }
+  }
+  return t->failed;
+}
+
+static int rollback_one(int index, FILE* out, FILE* err, void* ctx) {
+  apply_batch_t* b = ctx;
+  apply_target_t* t = &b->targets[index];
+  if (!t->applied) return 0;
+  nvmlReturn_t result;
+
+  if (b->kind == APPLY_POWER_LIMIT) {
+    result = gpu->set_power_limit(t->device, t->old_limit_mw);
+    if (result != NVML_SUCCESS) {
+      fprintf(err, "%d:Error: Failed to restore power limit %.2fW (%s)\n", t->device_id,
+              t->old_limit_mw / 1000.0, gpu->error_string(result));
+      return 1;
+    }
+    fprintf(out, "%d:Power limit rolled back to %.2fW\n", t->device_id, t->old_limit_mw / 1000.0);
+    return 0;
+  }
+
+  int errors = 0;
+  for (unsigned int fan = 0; fan < t->num_fans; fan++) {
+    if (t->old_policy[fan] == NVML_FAN_POLICY_MANUAL)
+      result = gpu->set_fan_speed(t->device, fan, t->old_speed);
+    else
+      result = gpu->set_fan_control_policy(t->device, fan, t->old_policy[fan]);
+    if (result != NVML_SUCCESS) {
+      fprintf(err, "%d:Fan%u:Error: Failed to roll back (%s)\n", t->device_id, fan,
+              gpu->error_string(result));
+      errors++;
+    }
+  }
+  if (errors == 0) fprintf(out, "%d:Fans rolled back\n", t->device_id);
+  return errors > 0;
+}
+
+static void report_success(const apply_batch_t* b, int count) {
+  for (int i = 0; i < count; i++) {
+    const apply_target_t* t = &b->targets[i];
+    if (b->kind == APPLY_POWER_LIMIT) {
+      printf("%d:Power limit set to %uW\n", t->device_id, b->value);
+      continue;
+    }
+    for (unsigned int fan = 0; fan < t->num_fans; fan++)
+      printf("%d:Fan%u:Set to %u%%\n", t->device_id, fan, b->value);
+    printf("%d:Warning: Fan control is now MANUAL - monitor temperatures!\n", t->device_id);
+    printf("%d:Note: Use 'nvml-tool fan restore -d %d' to restore automatic control\n",
+           t->device_id, t->device_id);
+  }
+}
+
+int apply_batch(apply_kind_t kind, unsigned int value, const int* device_ids, int count,
+                unsigned int device_count, int jobs) {
+  if (kind == APPLY_FAN_SPEED && value > 100) {
+    fprintf(stderr, "Error: Fan speed must be between 0-100%%\n");
+    return count;
+  }
+
+  apply_batch_t b = {kind, value, device_count, calloc(count, sizeof(apply_target_t))};
+  if (!b.targets) {
+    fprintf(stderr, "Error: Out of memory\n");
+    return count;
+  }
+  for (int i = 0; i < count; i++) b.targets[i].device_id = device_ids[i];
+
+  int failed = fanout_run(count, jobs, validate_one, &b);
+  if (failed > 0) {
+    fprintf(stderr, "Error: %d of %d device(s) failed validation; nothing was changed\n", failed,
+            count);
+    free(b.targets);
+    return failed;
+  }
+
+  failed = fanout_run(count, jobs, set_one, &b);
+  if (failed == 0) failed = fanout_run(count, jobs, verify_one, &b);
+  if (failed == 0) {
+    report_success(&b, count);
+    free(b.targets);
+    return 0;
+  }
+
+  int stuck = fanout_run(count, jobs, rollback_one, &b);
+  if (stuck > 0)
+    fprintf(stderr, "Error: %d of %d device(s) failed and %d could not be rolled back\n", failed,
+            count, stuck);
+  else
+    fprintf(stderr, "Error: %d of %d device(s) failed; every device was rolled back\n", failed,
+            count);
+  free(b.targets);
+  return failed;
+}
@@ -0,0 +1,22 @@
+#ifndef NVML_TOOL_APPLY_H
+#define NVML_TOOL_APPLY_H
+
+typedef enum {
+  APPLY_POWER_LIMIT, // Value in W
+  APPLY_FAN_SPEED    // Value in %, on every fan
+} apply_kind_t;
+
+// Set a power limit or fan speed on the devices device_ids[0..count-1] as one transaction:
+//
+//   1. validate every device (handle, constraints or fan count) and save its current limit or
+//      fan policies; if any device fails, nothing is changed
+//   2. apply the value to all devices concurrently, on up to jobs threads (0 for automatic)
+//   3. read every device back to verify
+//   4. if any set or read-back failed, put every device that was touched back as it was
+//
+// Per-device output stays in device order. Returns the number of failed devices, 0 if the
+// change was applied everywhere.
+int apply_batch(apply_kind_t kind, unsigned int value, const int* device_ids, int count,
+                unsigned int device_count, int jobs);
+
+#endif
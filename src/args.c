@@ -0,0 +1,101 @@
+#define _GNU_SOURCE
+#include "args.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int parse_setpoints(int argc, char* argv[], int start_idx, setpoint_t* setpoints,
+                    int max_setpoints) {
+  int count = 0;
+
+  for (int i = start_idx; i < argc && count < max_setpoints; i++) {
+    if (argv[i][0] == '-') break;
+
+    if (!strchr(argv[i], ':')) continue;
+
+    if (curve_parse_setpoint(argv[i], &setpoints[count]) != 0) {
+      fprintf(stderr, "Error: Invalid setpoint '%s' (temp 0-%d, fan 0-100%%)\n", argv[i],
+              CURVE_MAX_TEMP_C - 1);
+      return -1;
+    }
+    count++;
+  }
+
+  if (count == 0) {
+    fprintf(stderr, "Error: No valid setpoints provided\n");
+    return -1;
+  }
+
+  if (curve_sort_setpoints(setpoints, count) != 0) {
+    fprintf(stderr, "Error: Setpoints must have distinct temperatures\n");
+    return -1;
+  }
+
+  return count;
+}
+
+int parse_device_range(const char* range_str, int* devices, int max_devices) {
+  char* str = strdup(range_str);
+  char* token = strtok(str, ",");
+  int count = 0;
+
+  while (token && count < max_devices) {
+    char* dash = strchr(token, '-');
+    if (dash) {
+      *dash = '\0';
+      int start = atoi(token);
+      int end = atoi(dash + 1);
+      for (int i = start; i <= end && count < max_devices; i++) devices[count++] = i;
+    } else {
+      devices[count++] = atoi(token);
+    }
+    token = strtok(NULL, ",");
+  }
+
+  free(str);
+  return count;
+}
+
+int parse_time(const char* str, double* seconds) {
+  char* end;
+  double value = strtod(str, &end);
+  if (end != str && !*end && value > 0) {
+    *seconds = value;
+    return 0;
+  }
+
+  static const char* const formats[] = {"%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S",
+                                        "%Y-%m-%d %H:%M", "%Y-%m-%dT%H:%M"};
+  for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* rest = strptime(str, formats[i], &tm);
+    if (!rest || *rest) continue;
+    tm.tm_isdst = -1;
+    time_t t = mktime(&tm);
+    if (t <= 0) return -1;
+    *seconds = t;
+    return 0;
+  }
+  return -1;
+}
+
+int parse_duration(const char* str, unsigned int* seconds) {
+  char* end;
+  long value = strtol(str, &end, 10);
+  long scale = 1;
+  if (*end && !end[1]) {
+    const char* units = "smhd";
+    const long scales[] = {1, 60, 3600, 86400};
+    const char* unit = strchr(units, *end);
+    if (!unit) return -1;
+    scale = scales[unit - units];
+    end++;
+  }
+  if (end == str || *end || value < 1 || value > UINT_MAX / scale) return -1;
+  *seconds = value * scale;
+  return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef NVML_TOOL_ARGS_H
+#define NVML_TOOL_ARGS_H
+
+#include "curve.h"
+
+// Parsers for command line values. Errors are reported on stderr where noted.
+
+// Read TEMP:FAN setpoints from argv[start_idx..], stopping at the first option, and sort them by
+// temperature. Returns the number read, or -1 (reported) if one is invalid, none were given or
+// two share a temperature.
+int parse_setpoints(int argc, char* argv[], int start_idx, setpoint_t* setpoints,
+                    int max_setpoints);
+
+// Expand a device list such as "0,2-4" into devices. Returns the number of entries.
+int parse_device_range(const char* range_str, int* devices, int max_devices);
+
+// Unix seconds, or a local "YYYY-MM-DD HH:MM[:SS]" (a T may separate date and time)
+int parse_time(const char* str, double* seconds);
+
+// N seconds, or N followed by s, m, h or d
+int parse_duration(const char* str, unsigned int* seconds);
+
+#endif
@@ -0,0 +1,57 @@
+#define _GNU_SOURCE
+#include "backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const gpu_backend_t nvml_backend = {
+    .name = "nvml",
+    .init = nvmlInit,
+    .shutdown = nvmlShutdown,
+    .error_string = nvmlErrorString,
+    .get_driver_version = nvmlSystemGetDriverVersion,
+    .get_count = nvmlDeviceGetCount,
+    .get_handle_by_index = nvmlDeviceGetHandleByIndex,
+    .get_name = nvmlDeviceGetName,
+    .get_uuid = nvmlDeviceGetUUID,
+    .get_pci_info = nvmlDeviceGetPciInfo,
+    .get_temperature = nvmlDeviceGetTemperature,
+    .get_memory_info = nvmlDeviceGetMemoryInfo,
+    .get_fan_speed = nvmlDeviceGetFanSpeed,
+    .get_num_fans = nvmlDeviceGetNumFans,
+    .set_fan_speed = nvmlDeviceSetFanSpeed_v2,
+    .get_fan_control_policy = nvmlDeviceGetFanControlPolicy_v2,
+    .set_fan_control_policy = nvmlDeviceSetFanControlPolicy,
+    .get_power_usage = nvmlDeviceGetPowerUsage,
+    .get_power_limit = nvmlDeviceGetPowerManagementLimit,
+    .get_power_limit_constraints = nvmlDeviceGetPowerManagementLimitConstraints,
+    .set_power_limit = nvmlDeviceSetPowerManagementLimit,
+    .get_throttle_reasons = nvmlDeviceGetCurrentClocksThrottleReasons,
+    .get_utilization = nvmlDeviceGetUtilizationRates,
+    .get_field_values = nvmlDeviceGetFieldValues,
+    .event_set_create = nvmlEventSetCreate,
+    .get_supported_event_types = nvmlDeviceGetSupportedEventTypes,
+    .register_events = nvmlDeviceRegisterEvents,
+    .event_set_wait = nvmlEventSetWait_v2,
+    .event_set_free = nvmlEventSetFree,
+};
+
+const gpu_backend_t* gpu = &nvml_backend;
+
+int gpu_backend_select(void) {
+  const char* spec = getenv("NVML_TOOL_BACKEND");
+  if (!spec || !*spec || strcmp(spec, "nvml") == 0) {
+    gpu = &nvml_backend;
+    return 0;
+  }
+
+  if (strncmp(spec, "sim", 3) == 0 && (spec[3] == '\0' || spec[3] == ':')) {
+    if (sim_configure(spec[3] ? spec + 4 : "") != 0) return -1;
+    gpu = &sim_backend;
+    return 0;
+  }
+
+  fprintf(stderr, "Error: Unknown backend '%s' in NVML_TOOL_BACKEND (use nvml or sim)\n", spec);
+  return -1;
+}
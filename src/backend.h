@@ -0,0 +1,71 @@
+#ifndef NVML_TOOL_BACKEND_H
+#define NVML_TOOL_BACKEND_H
+
+#include <nvml.h>
+
+// Thin indirection over the NVML calls the tool makes. Signatures mirror NVML so the real
+// backend is a table of NVML function pointers; other backends hand out their own opaque
+// nvmlDevice_t handles. Every function must be safe to call from multiple threads.
+typedef struct {
+  const char* name;
+  nvmlReturn_t (*init)(void);
+  nvmlReturn_t (*shutdown)(void);
+  const char* (*error_string)(nvmlReturn_t result);
+  nvmlReturn_t (*get_driver_version)(char* version, unsigned int length);
+
+  nvmlReturn_t (*get_count)(unsigned int* count);
+  nvmlReturn_t (*get_handle_by_index)(unsigned int index, nvmlDevice_t* device);
+  nvmlReturn_t (*get_name)(nvmlDevice_t device, char* name, unsigned int length);
+  nvmlReturn_t (*get_uuid)(nvmlDevice_t device, char* uuid, unsigned int length);
+  nvmlReturn_t (*get_pci_info)(nvmlDevice_t device, nvmlPciInfo_t* pci);
+
+  nvmlReturn_t (*get_temperature)(nvmlDevice_t device, nvmlTemperatureSensors_t sensor,
+                                  unsigned int* temp);
+  nvmlReturn_t (*get_memory_info)(nvmlDevice_t device, nvmlMemory_t* memory);
+
+  nvmlReturn_t (*get_fan_speed)(nvmlDevice_t device, unsigned int* speed);
+  nvmlReturn_t (*get_num_fans)(nvmlDevice_t device, unsigned int* num_fans);
+  nvmlReturn_t (*set_fan_speed)(nvmlDevice_t device, unsigned int fan, unsigned int speed);
+  nvmlReturn_t (*get_fan_control_policy)(nvmlDevice_t device, unsigned int fan,
+                                         nvmlFanControlPolicy_t* policy);
+  nvmlReturn_t (*set_fan_control_policy)(nvmlDevice_t device, unsigned int fan,
+                                         nvmlFanControlPolicy_t policy);
+
+  nvmlReturn_t (*get_power_usage)(nvmlDevice_t device, unsigned int* milliwatts);
+  nvmlReturn_t (*get_power_limit)(nvmlDevice_t device, unsigned int* milliwatts);
+  nvmlReturn_t (*get_power_limit_constraints)(nvmlDevice_t device, unsigned int* min_mw,
+                                              unsigned int* max_mw);
+  nvmlReturn_t (*set_power_limit)(nvmlDevice_t device, unsigned int milliwatts);
+  nvmlReturn_t (*get_throttle_reasons)(nvmlDevice_t device, unsigned long long* reasons);
+  nvmlReturn_t (*get_utilization)(nvmlDevice_t device, nvmlUtilization_t* utilization);
+
+  // Batched query; per-field status is reported in values[i].nvmlReturn
+  nvmlReturn_t (*get_field_values)(nvmlDevice_t device, int count, nvmlFieldValue_t* values);
+
+  // Asynchronous events (XID errors, clock and power source changes). event_set_wait blocks for
+  // up to timeout_ms and returns NVML_ERROR_TIMEOUT if nothing happened.
+  nvmlReturn_t (*event_set_create)(nvmlEventSet_t* set);
+  nvmlReturn_t (*get_supported_event_types)(nvmlDevice_t device, unsigned long long* types);
+  nvmlReturn_t (*register_events)(nvmlDevice_t device, unsigned long long types,
+                                  nvmlEventSet_t set);
+  nvmlReturn_t (*event_set_wait)(nvmlEventSet_t set, nvmlEventData_t* data,
+                                 unsigned int timeout_ms);
+  nvmlReturn_t (*event_set_free)(nvmlEventSet_t set);
+} gpu_backend_t;
+
+extern const gpu_backend_t nvml_backend;
+extern const gpu_backend_t sim_backend;
+
+// Active backend, nvml_backend unless gpu_backend_select() picked another one
+extern const gpu_backend_t* gpu;
+
+// Select the backend from the NVML_TOOL_BACKEND environment variable:
+//   unset or "nvml"      real NVML
+//   "sim[:OPTIONS]"      simulated GPUs, see sim_configure() for OPTIONS
+// Returns 0 on success, -1 (with a message on stderr) for an invalid value.
+int gpu_backend_select(void);
+
+// Parse a comma-separated key=value option string for the simulated backend
+int sim_configure(const char* options);
+
+#endif
@@ -0,0 +1,643 @@
+#define _GNU_SOURCE
+#include "backend.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Simulated GPU fleet. Each device is a lumped thermal mass heated by its power draw and cooled
+// through a conductance that grows with fan speed:
+//
+//   C * dT/dt = P - (G0 + G1 * fan/100) * (T - ambient)
+//
+// Power draw follows a per-device load pattern (or a fixed load), capped by the power limit and
+// cut back during thermal slowdown. State is integrated lazily on every call from the elapsed
+// monotonic time, optionally sped up by a timescale factor.
+//
+// Event sets report a clock event whenever a device's throttle reasons change, plus XID errors
+// scripted with xid=DEV@SECONDS[:CODE]. XID 79 (fallen off the bus) makes every later call on
+// the device fail with NVML_ERROR_GPU_IS_LOST.
+
+#define SIM_MAX_DEVICES 1024
+#define SIM_NUM_FANS 2
+#define SIM_IDLE_W 30.0
+#define SIM_TDP_W 350.0
+#define SIM_MIN_LIMIT_W 100.0
+#define SIM_MAX_LIMIT_W 450.0
+#define SIM_HEAT_CAPACITY 150.0 // J/K
+#define SIM_G0 2.0              // W/K with fans stopped
+#define SIM_G1 8.0              // Additional W/K at 100% fan
+#define SIM_SLOWDOWN_C 90.0
+#define SIM_STEP_S 0.1
+#define SIM_MAX_STEPS 1000
+#define SIM_MEMORY_TOTAL (24ULL << 30)
+#define SIM_MAX_XIDS 16
+#define SIM_XID_FALLEN_OFF_BUS 79
+#define SIM_EVENT_POLL_MS 10
+#define SIM_EVENT_TYPES \
+  (nvmlEventTypeXidCriticalError | nvmlEventTypeClock | nvmlEventTypePState)
+
+typedef struct {
+  pthread_mutex_t lock;
+  unsigned int index;
+  uint64_t rng;
+  double temp;  // Die temperature, C
+  double power; // Power draw at the last integration step, W
+  double load;  // Load fraction at the last integration step
+  double time;  // Simulated seconds at the last integration step
+  unsigned int power_limit_mw;
+  unsigned long long throttle_reasons; // nvmlClocksThrottleReason* bits at the last step
+  unsigned int fan_speed[SIM_NUM_FANS];
+  nvmlFanControlPolicy_t fan_policy[SIM_NUM_FANS];
+  unsigned int xids_fired;        // Bit per sim_config.xids entry already raised
+  unsigned long long pending_xid; // Raised but not yet reported to an event set, 0 if none
+  int lost;
+} sim_device_t;
+
+typedef struct {
+  unsigned int device;
+  double time; // Simulated seconds
+  unsigned long long code;
+} sim_xid_t;
+
+typedef struct {
+  unsigned long long* types;   // Registered event types per device
+  unsigned long long* reasons; // Throttle reasons last reported per device
+  unsigned int next;           // Device to look at first, so a busy one cannot starve the rest
+} sim_event_set_t;
+
+static struct {
+  unsigned int device_count;
+  unsigned int latency_us; // Added to every device call
+  double fail_rate;        // Probability that a device call fails
+  unsigned long seed;
+  double timescale; // Simulated seconds per wall-clock second
+  double ambient;
+  double load; // Fixed load fraction, or <0 for the built-in periodic pattern
+  sim_xid_t xids[SIM_MAX_XIDS];
+  unsigned int xid_count;
+} sim_config = {8, 0, 0.0, 1, 1.0, 25.0, -1.0, {{0}}, 0};
+
+static sim_device_t* sim_devices = NULL;
+static struct timespec sim_epoch;
+
+int sim_configure(const char* options) {
+  char* copy = strdup(options);
+  char* save = NULL;
+  int ret = 0;
+
+  for (char* opt = strtok_r(copy, ",", &save); opt; opt = strtok_r(NULL, ",", &save)) {
+    char* eq = strchr(opt, '=');
+    const char* value = eq ? eq + 1 : opt;
+    if (eq) *eq = '\0';
+    char* end = NULL;
+
+    if (!eq || strcmp(opt, "devices") == 0) {
+      long count = strtol(value, &end, 10);
+      if (count < 1 || count > SIM_MAX_DEVICES) end = NULL;
+      sim_config.device_count = count;
+    } else if (strcmp(opt, "latency_us") == 0) {
+      sim_config.latency_us = strtoul(value, &end, 10);
+    } else if (strcmp(opt, "fail") == 0) {
+      sim_config.fail_rate = strtod(value, &end);
+      if (sim_config.fail_rate < 0.0 || sim_config.fail_rate > 1.0) end = NULL;
+    } else if (strcmp(opt, "seed") == 0) {
+      sim_config.seed = strtoul(value, &end, 10);
+    } else if (strcmp(opt, "timescale") == 0) {
+      sim_config.timescale = strtod(value, &end);
+      if (sim_config.timescale <= 0.0) end = NULL;
+    } else if (strcmp(opt, "ambient") == 0) {
+      sim_config.ambient = strtod(value, &end);
+    } else if (strcmp(opt, "load") == 0) {
+      if (strcmp(value, "auto") == 0) {
+        sim_config.load = -1.0;
+        end = (char*)value + 4;
+      } else {
+        sim_config.load = strtod(value, &end);
+        if (sim_config.load < 0.0 || sim_config.load > 1.0) end = NULL;
+      }
+    } else if (strcmp(opt, "xid") == 0 && sim_config.xid_count < SIM_MAX_XIDS) {
+      // DEV@SECONDS[:CODE]
+      sim_xid_t* xid = &sim_config.xids[sim_config.xid_count++];
+      xid->device = strtoul(value, &end, 10);
+      xid->code = SIM_XID_FALLEN_OFF_BUS;
+      if (end == value || *end != '@') {
+        end = NULL;
+      } else {
+        const char* time = end + 1;
+        xid->time = strtod(time, &end);
+        if (end == time || xid->time < 0.0) end = NULL;
+        else if (*end == ':') xid->code = strtoull(end + 1, &end, 10);
+        if (xid->code == 0) end = NULL;
+      }
+    }
+
+    if (!end || *end != '\0' || end == value) {
+      fprintf(stderr, "Error: Invalid simulator option '%s%s%s'\n", opt, eq ? "=" : "",
+              eq ? value : "");
+      ret = -1;
+      break;
+    }
+  }
+
+  for (unsigned int i = 0; i < sim_config.xid_count && ret == 0; i++) {
+    if (sim_config.xids[i].device >= sim_config.device_count) {
+      fprintf(stderr, "Error: Simulator xid option names device %u of %u\n",
+              sim_config.xids[i].device, sim_config.device_count);
+      ret = -1;
+    }
+  }
+
+  free(copy);
+  return ret;
+}
+
+static double sim_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  double elapsed = (ts.tv_sec - sim_epoch.tv_sec) + (ts.tv_nsec - sim_epoch.tv_nsec) / 1e9;
+  return elapsed * sim_config.timescale;
+}
+
+// xorshift64*, uniform in [0, 1)
+static double sim_random(sim_device_t* dev) {
+  dev->rng ^= dev->rng >> 12;
+  dev->rng ^= dev->rng << 25;
+  dev->rng ^= dev->rng >> 27;
+  return ((dev->rng * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Square-wave load: busy for half of a device-specific period, idle otherwise
+static double sim_load_at(const sim_device_t* dev, double t) {
+  if (sim_config.load >= 0.0) return sim_config.load;
+  unsigned long long period_ms = 60000ULL + dev->index * 7000ULL;
+  unsigned long long now_ms = (unsigned long long)(t * 1000.0) + dev->index * 13000ULL;
+  unsigned long long phase_ms = now_ms % period_ms;
+  return phase_ms < period_ms / 2 ? 0.9 : 0.05;
+}
+
+static unsigned int sim_auto_fan(double temp) {
+  double fan = 30.0 + (temp - 40.0) * 1.4;
+  if (fan < 30.0) fan = 30.0;
+  if (fan > 100.0) fan = 100.0;
+  return (unsigned int)fan;
+}
+
+static void sim_advance(sim_device_t* dev) {
+  double now = sim_now();
+  double dt = now - dev->time;
+  if (dt <= 0.0) return;
+
+  int steps = (int)(dt / SIM_STEP_S) + 1;
+  if (steps > SIM_MAX_STEPS) steps = SIM_MAX_STEPS;
+  double h = dt / steps;
+
+  for (int s = 0; s < steps; s++) {
+    double t = dev->time + h * (s + 1);
+    double fan = 0.0;
+    for (int f = 0; f < SIM_NUM_FANS; f++) {
+      if (dev->fan_policy[f] != NVML_FAN_POLICY_MANUAL) dev->fan_speed[f] = sim_auto_fan(dev->temp);
+      fan += dev->fan_speed[f];
+    }
+    fan /= SIM_NUM_FANS;
+
+    dev->load = sim_load_at(dev, t);
+    double power = SIM_IDLE_W + dev->load * (SIM_TDP_W - SIM_IDLE_W);
+    dev->throttle_reasons = 0;
+    if (power > dev->power_limit_mw / 1000.0) {
+      power = dev->power_limit_mw / 1000.0;
+      dev->throttle_reasons |= nvmlClocksThrottleReasonSwPowerCap;
+    }
+    if (dev->temp >= SIM_SLOWDOWN_C) {
+      power *= 0.7;
+      dev->throttle_reasons |=
+          nvmlClocksThrottleReasonHwSlowdown | nvmlClocksThrottleReasonHwThermalSlowdown;
+    }
+    dev->power = power;
+
+    double conductance = SIM_G0 + SIM_G1 * fan / 100.0;
+    dev->temp += (power - conductance * (dev->temp - sim_config.ambient)) * h / SIM_HEAT_CAPACITY;
+  }
+  dev->time = now;
+
+  for (unsigned int i = 0; i < sim_config.xid_count; i++) {
+    const sim_xid_t* xid = &sim_config.xids[i];
+    if (xid->device != dev->index || (dev->xids_fired & (1u << i)) || now < xid->time) continue;
+    dev->xids_fired |= 1u << i;
+    dev->pending_xid = xid->code;
+    if (xid->code == SIM_XID_FALLEN_OFF_BUS) dev->lost = 1;
+  }
+}
+
+// Common prologue for device calls: validate the handle, apply injected latency and failures,
+// and bring the thermal state up to date. On success the device lock is held.
+static nvmlReturn_t sim_enter(nvmlDevice_t device, sim_device_t** out) {
+  sim_device_t* dev = (sim_device_t*)device;
+  if (!sim_devices) return NVML_ERROR_UNINITIALIZED;
+  if (!dev || dev < sim_devices || dev >= sim_devices + sim_config.device_count)
+    return NVML_ERROR_INVALID_ARGUMENT;
+
+  if (sim_config.latency_us) {
+    struct timespec delay = {sim_config.latency_us / 1000000,
+                             (long)(sim_config.latency_us % 1000000) * 1000};
+    nanosleep(&delay, NULL);
+  }
+
+  pthread_mutex_lock(&dev->lock);
+  if (sim_config.fail_rate > 0.0 && sim_random(dev) < sim_config.fail_rate) {
+    pthread_mutex_unlock(&dev->lock);
+    return NVML_ERROR_UNKNOWN;
+  }
+  sim_advance(dev);
+  if (dev->lost) {
+    pthread_mutex_unlock(&dev->lock);
+    return NVML_ERROR_GPU_IS_LOST;
+  }
+  *out = dev;
+  return NVML_SUCCESS;
+}
+
+static nvmlReturn_t sim_leave(sim_device_t* dev, nvmlReturn_t result) {
+  pthread_mutex_unlock(&dev->lock);
+  return result;
+}
+
+static nvmlReturn_t sim_init(void) {
+  if (sim_devices) return NVML_SUCCESS;
+
+  sim_devices = calloc(sim_config.device_count, sizeof(sim_device_t));
+  if (!sim_devices) return NVML_ERROR_UNKNOWN;
+  clock_gettime(CLOCK_MONOTONIC, &sim_epoch);
+
+  for (unsigned int i = 0; i < sim_config.device_count; i++) {
+    sim_device_t* dev = &sim_devices[i];
+    pthread_mutex_init(&dev->lock, NULL);
+    dev->index = i;
+    dev->rng = (sim_config.seed + 1) * 0x9E3779B97F4A7C15ULL ^ (i + 1) * 0xBF58476D1CE4E5B9ULL;
+    dev->temp = sim_config.ambient + 5.0 + sim_random(dev) * 5.0;
+    dev->power_limit_mw = (unsigned int)(SIM_TDP_W * 1000);
+    for (int f = 0; f < SIM_NUM_FANS; f++) {
+      dev->fan_policy[f] = NVML_FAN_POLICY_TEMPERATURE_CONTINOUS_SW;
+      dev->fan_speed[f] = sim_auto_fan(dev->temp);
+    }
+  }
+  return NVML_SUCCESS;
+}
+
+static nvmlReturn_t sim_shutdown(void) {
+  if (!sim_devices) return NVML_ERROR_UNINITIALIZED;
+  for (unsigned int i = 0; i < sim_config.device_count; i++)
+    pthread_mutex_destroy(&sim_devices[i].lock);
+  free(sim_devices);
+  sim_devices = NULL;
+  return NVML_SUCCESS;
+}
+
+static const char* sim_error_string(nvmlReturn_t result) {
+  switch (result) {
+  case NVML_SUCCESS: return "Success";
+  case NVML_ERROR_UNINITIALIZED: return "Uninitialized";
+  case NVML_ERROR_INVALID_ARGUMENT: return "Invalid Argument";
+  case NVML_ERROR_NOT_SUPPORTED: return "Not Supported";
+  case NVML_ERROR_NO_PERMISSION: return "Insufficient Permissions";
+  case NVML_ERROR_NOT_FOUND: return "Not Found";
+  case NVML_ERROR_INSUFFICIENT_SIZE: return "Insufficient Size";
+  case NVML_ERROR_TIMEOUT: return "Timeout";
+  case NVML_ERROR_GPU_IS_LOST: return "GPU is lost";
+  default: return "Unknown Error (simulated)";
+  }
+}
+
+// Only the device count shapes the simulated topology, so it stands in for a driver version
+static nvmlReturn_t sim_get_driver_version(char* version, unsigned int length) {
+  if (!sim_devices) return NVML_ERROR_UNINITIALIZED;
+  snprintf(version, length, "sim-%u", sim_config.device_count);
+  return NVML_SUCCESS;
+}
+
+static nvmlReturn_t sim_get_count(unsigned int* count) {
+  if (!sim_devices) return NVML_ERROR_UNINITIALIZED;
+  *count = sim_config.device_count;
+  return NVML_SUCCESS;
+}
+
+static nvmlReturn_t sim_get_handle_by_index(unsigned int index, nvmlDevice_t* device) {
+  if (!sim_devices) return NVML_ERROR_UNINITIALIZED;
+  if (index >= sim_config.device_count) return NVML_ERROR_INVALID_ARGUMENT;
+  *device = (nvmlDevice_t)&sim_devices[index];
+  return NVML_SUCCESS;
+}
+
+static nvmlReturn_t sim_get_name(nvmlDevice_t device, char* name, unsigned int length) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  snprintf(name, length, "NVIDIA Simulated GPU");
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_get_uuid(nvmlDevice_t device, char* uuid, unsigned int length) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  snprintf(uuid, length, "GPU-51a00000-0000-4000-8000-%012x", dev->index);
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_get_pci_info(nvmlDevice_t device, nvmlPciInfo_t* pci) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  memset(pci, 0, sizeof(*pci));
+  pci->domain = dev->index / 256;
+  pci->bus = dev->index % 256;
+  pci->device = 0;
+  pci->pciDeviceId = 0x268410de;
+  snprintf(pci->busIdLegacy, sizeof(pci->busIdLegacy), "%04x:%02x:00.0", pci->domain, pci->bus);
+  snprintf(pci->busId, sizeof(pci->busId), "%08x:%02x:00.0", pci->domain, pci->bus);
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_get_temperature(nvmlDevice_t device, nvmlTemperatureSensors_t sensor,
+                                        unsigned int* temp) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  if (sensor != NVML_TEMPERATURE_GPU) return sim_leave(dev, NVML_ERROR_NOT_SUPPORTED);
+  *temp = (unsigned int)(dev->temp + 0.5);
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_get_memory_info(nvmlDevice_t device, nvmlMemory_t* memory) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  memory->total = SIM_MEMORY_TOTAL;
+  memory->used = (512ULL << 20) + (unsigned long long)(dev->load * (20ULL << 30));
+  memory->free = memory->total - memory->used;
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_get_fan_speed(nvmlDevice_t device, unsigned int* speed) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  *speed = dev->fan_speed[0];
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_get_num_fans(nvmlDevice_t device, unsigned int* num_fans) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  *num_fans = SIM_NUM_FANS;
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_set_fan_speed(nvmlDevice_t device, unsigned int fan, unsigned int speed) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  if (fan >= SIM_NUM_FANS || speed > 100) return sim_leave(dev, NVML_ERROR_INVALID_ARGUMENT);
+  dev->fan_policy[fan] = NVML_FAN_POLICY_MANUAL;
+  dev->fan_speed[fan] = speed;
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_get_fan_control_policy(nvmlDevice_t device, unsigned int fan,
+                                               nvmlFanControlPolicy_t* policy) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  if (fan >= SIM_NUM_FANS) return sim_leave(dev, NVML_ERROR_INVALID_ARGUMENT);
+  *policy = dev->fan_policy[fan];
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_set_fan_control_policy(nvmlDevice_t device, unsigned int fan,
+                                               nvmlFanControlPolicy_t policy) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  if (fan >= SIM_NUM_FANS) return sim_leave(dev, NVML_ERROR_INVALID_ARGUMENT);
+  dev->fan_policy[fan] = policy;
+  if (policy != NVML_FAN_POLICY_MANUAL) dev->fan_speed[fan] = sim_auto_fan(dev->temp);
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_get_power_usage(nvmlDevice_t device, unsigned int* milliwatts) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  *milliwatts = (unsigned int)(dev->power * 1000.0);
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_get_power_limit(nvmlDevice_t device, unsigned int* milliwatts) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  *milliwatts = dev->power_limit_mw;
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_get_power_limit_constraints(nvmlDevice_t device, unsigned int* min_mw,
+                                                    unsigned int* max_mw) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  *min_mw = (unsigned int)(SIM_MIN_LIMIT_W * 1000);
+  *max_mw = (unsigned int)(SIM_MAX_LIMIT_W * 1000);
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_set_power_limit(nvmlDevice_t device, unsigned int milliwatts) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  if (milliwatts < SIM_MIN_LIMIT_W * 1000 || milliwatts > SIM_MAX_LIMIT_W * 1000)
+    return sim_leave(dev, NVML_ERROR_INVALID_ARGUMENT);
+  dev->power_limit_mw = milliwatts;
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_get_throttle_reasons(nvmlDevice_t device, unsigned long long* reasons) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  *reasons = dev->throttle_reasons;
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+// The GPU is busy for the load fraction of the time whether or not its clocks are capped
+static nvmlReturn_t sim_get_utilization(nvmlDevice_t device, nvmlUtilization_t* utilization) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  utilization->gpu = (unsigned int)(dev->load * 100.0 + 0.5);
+  utilization->memory = (unsigned int)(dev->load * 60.0 + 0.5);
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_get_field_values(nvmlDevice_t device, int count,
+                                         nvmlFieldValue_t* values) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+
+  long long now_us = (long long)(dev->time * 1e6);
+  for (int i = 0; i < count; i++) {
+    nvmlFieldValue_t* v = &values[i];
+    v->timestamp = now_us;
+    v->latencyUsec = 0;
+    v->valueType = NVML_VALUE_TYPE_UNSIGNED_INT;
+    v->nvmlReturn = NVML_SUCCESS;
+    switch (v->fieldId) {
+#ifdef NVML_FI_DEV_POWER_AVERAGE
+    case NVML_FI_DEV_POWER_AVERAGE:
+#endif
+#ifdef NVML_FI_DEV_POWER_INSTANT
+    case NVML_FI_DEV_POWER_INSTANT:
+#endif
+      v->value.uiVal = (unsigned int)(dev->power * 1000.0);
+      break;
+#ifdef NVML_FI_DEV_POWER_CURRENT_LIMIT
+    case NVML_FI_DEV_POWER_CURRENT_LIMIT: v->value.uiVal = dev->power_limit_mw; break;
+#endif
+    default: v->nvmlReturn = NVML_ERROR_NOT_SUPPORTED; break;
+    }
+  }
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_event_set_create(nvmlEventSet_t* set) {
+  if (!sim_devices) return NVML_ERROR_UNINITIALIZED;
+  sim_event_set_t* s = calloc(1, sizeof(*s));
+  if (s) {
+    s->types = calloc(sim_config.device_count, sizeof(*s->types));
+    s->reasons = calloc(sim_config.device_count, sizeof(*s->reasons));
+  }
+  if (!s || !s->types || !s->reasons) {
+    if (s) {
+      free(s->types);
+      free(s->reasons);
+    }
+    free(s);
+    return NVML_ERROR_UNKNOWN;
+  }
+  *set = (nvmlEventSet_t)s;
+  return NVML_SUCCESS;
+}
+
+static nvmlReturn_t sim_get_supported_event_types(nvmlDevice_t device, unsigned long long* types) {
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  *types = SIM_EVENT_TYPES;
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+static nvmlReturn_t sim_register_events(nvmlDevice_t device, unsigned long long types,
+                                        nvmlEventSet_t set) {
+  sim_event_set_t* s = (sim_event_set_t*)set;
+  if (!s) return NVML_ERROR_INVALID_ARGUMENT;
+  sim_device_t* dev;
+  nvmlReturn_t r = sim_enter(device, &dev);
+  if (r != NVML_SUCCESS) return r;
+  if (types & ~SIM_EVENT_TYPES) return sim_leave(dev, NVML_ERROR_NOT_SUPPORTED);
+  s->types[dev->index] |= types;
+  s->reasons[dev->index] = dev->throttle_reasons;
+  return sim_leave(dev, NVML_SUCCESS);
+}
+
+// Report a pending XID or a throttle reason change of one device. Returns 1 if data was filled.
+static int sim_poll_event(sim_event_set_t* s, sim_device_t* dev, nvmlEventData_t* data) {
+  unsigned long long types = s->types[dev->index];
+  int found = 0;
+  pthread_mutex_lock(&dev->lock);
+  sim_advance(dev);
+  memset(data, 0, sizeof(*data));
+  data->device = (nvmlDevice_t)dev;
+  if (dev->pending_xid && (types & nvmlEventTypeXidCriticalError)) {
+    data->eventType = nvmlEventTypeXidCriticalError;
+    data->eventData = dev->pending_xid;
+    dev->pending_xid = 0;
+    found = 1;
+  } else if (!dev->lost && (types & nvmlEventTypeClock) &&
+             dev->throttle_reasons != s->reasons[dev->index]) {
+    data->eventType = nvmlEventTypeClock;
+    s->reasons[dev->index] = dev->throttle_reasons;
+    found = 1;
+  }
+  pthread_mutex_unlock(&dev->lock);
+  return found;
+}
+
+// Events are found by polling the simulated devices every SIM_EVENT_POLL_MS of wall time
+static nvmlReturn_t sim_event_set_wait(nvmlEventSet_t set, nvmlEventData_t* data,
+                                       unsigned int timeout_ms) {
+  sim_event_set_t* s = (sim_event_set_t*)set;
+  if (!sim_devices) return NVML_ERROR_UNINITIALIZED;
+  if (!s || !data) return NVML_ERROR_INVALID_ARGUMENT;
+
+  unsigned int waited_ms = 0;
+  for (;;) {
+    for (unsigned int n = 0; n < sim_config.device_count; n++) {
+      unsigned int i = (s->next + n) % sim_config.device_count;
+      if (!s->types[i] || !sim_poll_event(s, &sim_devices[i], data)) continue;
+      s->next = (i + 1) % sim_config.device_count;
+      return NVML_SUCCESS;
+    }
+    if (waited_ms >= timeout_ms) return NVML_ERROR_TIMEOUT;
+
+    unsigned int step = timeout_ms - waited_ms < SIM_EVENT_POLL_MS ? timeout_ms - waited_ms
+                                                                   : SIM_EVENT_POLL_MS;
+    struct timespec delay = {0, (long)step * 1000000L};
+    nanosleep(&delay, NULL);
+    waited_ms += step;
+  }
+}
+
+static nvmlReturn_t sim_event_set_free(nvmlEventSet_t set) {
+  sim_event_set_t* s = (sim_event_set_t*)set;
+  if (!s) return NVML_ERROR_INVALID_ARGUMENT;
+  free(s->types);
+  free(s->reasons);
+  free(s);
+  return NVML_SUCCESS;
+}
+
+const gpu_backend_t sim_backend = {
+    .name = "sim",
+    .init = sim_init,
+    .shutdown = sim_shutdown,
+    .error_string = sim_error_string,
+    .get_driver_version = sim_get_driver_version,
+    .get_count = sim_get_count,
+    .get_handle_by_index = sim_get_handle_by_index,
+    .get_name = sim_get_name,
+    .get_uuid = sim_get_uuid,
+    .get_pci_info = sim_get_pci_info,
+    .get_temperature = sim_get_temperature,
+    .get_memory_info = sim_get_memory_info,
+    .get_fan_speed = sim_get_fan_speed,
+    .get_num_fans = sim_get_num_fans,
+    .set_fan_speed = sim_set_fan_speed,
+    .get_fan_control_policy = sim_get_fan_control_policy,
+    .set_fan_control_policy = sim_set_fan_control_policy,
+    .get_power_usage = sim_get_power_usage,
+    .get_power_limit = sim_get_power_limit,
+    .get_power_limit_constraints = sim_get_power_limit_constraints,
+    .set_power_limit = sim_set_power_limit,
+    .get_throttle_reasons = sim_get_throttle_reasons,
+    .get_utilization = sim_get_utilization,
+    .get_field_values = sim_get_field_values,
+    .event_set_create = sim_event_set_create,
+    .get_supported_event_types = sim_get_supported_event_types,
+    .register_events = sim_register_events,
+    .event_set_wait = sim_event_set_wait,
+    .event_set_free = sim_event_set_free,
+};
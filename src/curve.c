@@ -0,0 +1,119 @@
+#define _GNU_SOURCE
+#include "curve.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* const curve_names[] = {"linear", "cubic", "step"};
+
+int curve_parse_type(const char* name, curve_type_t* type) {
+  for (size_t i = 0; i < sizeof(curve_names) / sizeof(curve_names[0]); i++) {
+    if (strcmp(name, curve_names[i]) == 0) {
+      *type = (curve_type_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+const char* curve_type_name(curve_type_t type) { return curve_names[type]; }
+
+int curve_parse_setpoint(const char* str, setpoint_t* out) {
+  char* end;
+  double temp = strtod(str, &end);
+  if (end == str || *end != ':') return -1;
+  const char* fan_str = end + 1;
+  double fan = strtod(fan_str, &end);
+  if (end == fan_str || *end) return -1;
+
+  // The negated comparisons also reject NaN
+  if (!(temp >= 0 && temp < CURVE_MAX_TEMP_C) || !(fan >= 0 && fan <= 100)) return -1;
+  out->temp = temp;
+  out->fan = fan;
+  return 0;
+}
+
+static int compare_setpoints(const void* a, const void* b) {
+  double ta = ((const setpoint_t*)a)->temp, tb = ((const setpoint_t*)b)->temp;
+  return (ta > tb) - (ta < tb);
+}
+
+int curve_sort_setpoints(setpoint_t* setpoints, int count) {
+  qsort(setpoints, count, sizeof(setpoint_t), compare_setpoints);
+  for (int i = 1; i < count; i++)
+    if (setpoints[i].temp == setpoints[i - 1].temp) return -1;
+  return 0;
+}
+
+// Fritsch-Butland tangents (as in PCHIP): zero at local extrema, otherwise a weighted harmonic
+// mean of the neighbouring secants. That keeps every segment within the monotone region, so
+// the curve never leaves the range spanned by its two setpoints.
+static void cubic_tangents(const setpoint_t* sp, int count, double* m) {
+  if (count < 2) {
+    m[0] = 0;
+    return;
+  }
+  double prev_h = sp[1].temp - sp[0].temp;
+  double prev_d = (sp[1].fan - sp[0].fan) / prev_h;
+  m[0] = prev_d;
+  for (int k = 1; k < count - 1; k++) {
+    double h = sp[k + 1].temp - sp[k].temp;
+    double d = (sp[k + 1].fan - sp[k].fan) / h;
+    if (prev_d * d <= 0)
+      m[k] = 0;
+    else
+      m[k] = 3 * (prev_h + h) / ((2 * h + prev_h) / prev_d + (h + 2 * prev_h) / d);
+    prev_h = h;
+    prev_d = d;
+  }
+  m[count - 1] = prev_d;
+}
+
+static double evaluate(curve_type_t type, const setpoint_t* sp, int count, const double* m,
+                       double temp) {
+  if (temp <= sp[0].temp) return sp[0].fan;
+  if (temp >= sp[count - 1].temp) return sp[count - 1].fan;
+
+  int k = 0;
+  while (temp >= sp[k + 1].temp) k++; // Bounded by the checks above; runs at compile time only
+
+  double h = sp[k + 1].temp - sp[k].temp;
+  double t = (temp - sp[k].temp) / h;
+  switch (type) {
+  case CURVE_STEP: return sp[k].fan;
+  case CURVE_CUBIC: {
+    double t2 = t * t, t3 = t2 * t;
+    return (2 * t3 - 3 * t2 + 1) * sp[k].fan + (t3 - 2 * t2 + t) * h * m[k] +
+           (-2 * t3 + 3 * t2) * sp[k + 1].fan + (t3 - t2) * h * m[k + 1];
+  }
+  case CURVE_LINEAR: break;
+  }
+  return sp[k].fan + (sp[k + 1].fan - sp[k].fan) * t;
+}
+
+double curve_evaluate(curve_type_t type, const setpoint_t* setpoints, int count, double temp) {
+  double m[CURVE_MAX_SETPOINTS];
+  if (count <= 0 || count > CURVE_MAX_SETPOINTS) return 0;
+  if (type == CURVE_CUBIC) cubic_tangents(setpoints, count, m);
+  return evaluate(type, setpoints, count, m, temp);
+}
+
+int curve_compile(fan_curve_t* curve, curve_type_t type, const setpoint_t* setpoints, int count) {
+  double m[CURVE_MAX_SETPOINTS];
+  if (count <= 0 || count > CURVE_MAX_SETPOINTS) return -1;
+  if (type == CURVE_CUBIC) cubic_tangents(setpoints, count, m);
+
+  const double scale = 1 << CURVE_FAN_FRAC_BITS;
+  for (uint32_t i = 0; i < CURVE_TABLE_SIZE; i++) {
+    double fan = evaluate(type, setpoints, count, m, (double)i / (1 << CURVE_TEMP_FRAC_BITS));
+    if (fan < 0) fan = 0;
+    if (fan > 100) fan = 100;
+    curve->table[i] = (uint16_t)(fan * scale + 0.5);
+  }
+
+  curve->type = type;
+  curve->min_fan = (unsigned int)(setpoints[0].fan + 0.5);
+  curve->max_fan = (unsigned int)(setpoints[count - 1].fan + 0.5);
+  return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef NVML_TOOL_CURVE_H
+#define NVML_TOOL_CURVE_H
+
+#include <stdint.h>
+
+#define CURVE_MAX_SETPOINTS 16
+
+// The compiled table covers 0 C up to (not including) CURVE_MAX_TEMP_C in steps of
+// 1/2^CURVE_TEMP_FRAC_BITS C. Entries are fan speeds in 1/2^CURVE_FAN_FRAC_BITS percent.
+#define CURVE_TEMP_FRAC_BITS 4
+#define CURVE_FAN_FRAC_BITS 8
+#define CURVE_MAX_TEMP_C 128
+#define CURVE_TABLE_SIZE (CURVE_MAX_TEMP_C << CURVE_TEMP_FRAC_BITS)
+
+typedef enum {
+  CURVE_LINEAR, // Straight lines between setpoints
+  CURVE_CUBIC,  // Monotone cubic (PCHIP): smooth, never overshoots between setpoints
+  CURVE_STEP    // Hold each setpoint's speed until the next setpoint is reached
+} curve_type_t;
+
+typedef struct {
+  double temp; // C, 0 <= temp < CURVE_MAX_TEMP_C
+  double fan;  // %, 0-100
+} setpoint_t;
+
+typedef struct {
+  curve_type_t type;
+  unsigned int min_fan; // Speeds at the first and last setpoint, in whole percent
+  unsigned int max_fan;
+  uint16_t table[CURVE_TABLE_SIZE];
+} fan_curve_t;
+
+// Parse "linear", "cubic" or "step". Returns 0 on success.
+int curve_parse_type(const char* name, curve_type_t* type);
+
+const char* curve_type_name(curve_type_t type);
+
+// Parse one "TEMP:FAN" setpoint; both values may be fractional. Returns 0 on success.
+int curve_parse_setpoint(const char* str, setpoint_t* out);
+
+// Sort setpoints by temperature. Returns -1 if two setpoints share a temperature.
+int curve_sort_setpoints(setpoint_t* setpoints, int count);
+
+// Evaluate the curve directly from sorted setpoints. This is what curve_compile() samples; it
+// is too slow for the control loop.
+double curve_evaluate(curve_type_t type, const setpoint_t* setpoints, int count, double temp);
+
+// Sample the curve into curve->table. Setpoints must be sorted. Returns 0 on success.
+int curve_compile(fan_curve_t* curve, curve_type_t type, const setpoint_t* setpoints, int count);
+
+// Fan speed in 1/2^CURVE_FAN_FRAC_BITS percent for a temperature in 1/2^CURVE_TEMP_FRAC_BITS C
+static inline unsigned int curve_lookup_fixed(const fan_curve_t* curve, uint32_t temp_fixed) {
+  return curve->table[temp_fixed < CURVE_TABLE_SIZE ? temp_fixed : CURVE_TABLE_SIZE - 1];
+}
+
+// Fan speed in whole percent for a temperature in whole C
+static inline unsigned int curve_fan_speed(const fan_curve_t* curve, unsigned int temp_c) {
+  uint32_t index = temp_c < CURVE_MAX_TEMP_C ? temp_c << CURVE_TEMP_FRAC_BITS
+                                             : CURVE_TABLE_SIZE - 1;
+  return (curve->table[index] + (1u << (CURVE_FAN_FRAC_BITS - 1))) >> CURVE_FAN_FRAC_BITS;
+}
+
+#endif
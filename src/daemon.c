@@ -0,0 +1,306 @@
+#define _GNU_SOURCE
+#include "daemon.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "backend.h"
+
+#define DAEMON_IO_TIMEOUT_MS 2000
+
+// Warm device table, built once when the daemon starts
+typedef struct {
+  nvmlReturn_t status;
+  nvmlDevice_t handle;
+  char name[TELEMETRY_NAME_LEN];
+  char uuid[TELEMETRY_UUID_LEN];
+} daemon_device_t;
+
+static daemon_device_t* devices;
+static unsigned int device_count;
+
+const char* daemon_socket_path(const char* override) {
+  if (override) return override;
+  const char* env = getenv(DAEMON_SOCKET_ENV);
+  return env && *env ? env : DEFAULT_DAEMON_SOCKET;
+}
+
+static int fill_address(const char* path, struct sockaddr_un* addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path)) return -1;
+  strcpy(addr->sun_path, path);
+  return 0;
+}
+
+static void set_timeouts(int fd) {
+  struct timeval tv = {DAEMON_IO_TIMEOUT_MS / 1000, (DAEMON_IO_TIMEOUT_MS % 1000) * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static int read_full(int fd, void* buf, size_t len) {
+  char* p = buf;
+  while (len > 0) {
+    ssize_t r = read(fd, p, len);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return -1;
+    p += r;
+    len -= r;
+  }
+  return 0;
+}
+
+static int write_full(int fd, const void* buf, size_t len) {
+  const char* p = buf;
+  while (len > 0) {
+    ssize_t w = send(fd, p, len, MSG_NOSIGNAL);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return -1;
+    p += w;
+    len -= w;
+  }
+  return 0;
+}
+
+static void query_device(int id, unsigned int want, daemon_record_t* rec) {
+  memset(rec, 0, sizeof(*rec));
+  rec->device_id = id;
+  if (id < 0 || (unsigned int)id >= device_count) {
+    rec->status = NVML_ERROR_INVALID_ARGUMENT;
+    return;
+  }
+  const daemon_device_t* dev = &devices[id];
+  rec->status = dev->status;
+  if (dev->status != NVML_SUCCESS) return;
+
+  // Names and UUIDs come from the table; only the live values touch the backend. The temperature
+  // is read here, so that a failure reaches the client with its NVML error.
+  telemetry_read(dev->handle, want & ~(TM_NAME | TM_UUID | TM_TEMP), &rec->telemetry);
+  if (want & TM_TEMP) {
+    rec->temp_status =
+        gpu->get_temperature(dev->handle, NVML_TEMPERATURE_GPU, &rec->telemetry.temperature);
+    if (rec->temp_status == NVML_SUCCESS) rec->telemetry.valid |= TM_TEMP;
+  }
+  if (want & TM_NAME) {
+    memcpy(rec->telemetry.name, dev->name, sizeof(dev->name));
+    rec->telemetry.valid |= TM_NAME;
+  }
+  if (want & TM_UUID) {
+    memcpy(rec->telemetry.uuid, dev->uuid, sizeof(dev->uuid));
+    rec->telemetry.valid |= TM_UUID;
+  }
+}
+
+static void serve_client(int fd, daemon_record_t* records, int32_t* ids) {
+  set_timeouts(fd);
+
+  daemon_response_t resp = {DAEMON_PROTOCOL_MAGIC, DAEMON_PROTOCOL_VERSION,
+                            sizeof(daemon_record_t), DAEMON_OK, device_count, 0};
+  daemon_request_t req;
+  if (read_full(fd, &req, sizeof(req)) != 0 || req.magic != DAEMON_PROTOCOL_MAGIC)
+    resp.status = DAEMON_ERR_REQUEST;
+  else if (req.version != DAEMON_PROTOCOL_VERSION)
+    resp.status = DAEMON_ERR_VERSION;
+  else if (req.op != DAEMON_OP_QUERY)
+    resp.status = DAEMON_ERR_REQUEST;
+  else if (req.count < 0 || req.count > DAEMON_MAX_IDS)
+    resp.status = DAEMON_ERR_COUNT;
+  else if (req.count > 0 && read_full(fd, ids, req.count * sizeof(int32_t)) != 0)
+    resp.status = DAEMON_ERR_REQUEST;
+  if (resp.status != DAEMON_OK) {
+    // Answered all the same, so the client reports it instead of quietly going to NVML
+    write_full(fd, &resp, sizeof(resp));
+    return;
+  }
+  req.uuid[DAEMON_UUID_LEN - 1] = '\0';
+  if (req.uuid[0]) {
+    resp.count = -1;
+    for (unsigned int i = 0; i < device_count; i++) {
+      if (devices[i].status == NVML_SUCCESS && strstr(devices[i].uuid, req.uuid)) {
+        query_device(i, req.want, &records[0]);
+        resp.count = 1;
+        break;
+      }
+    }
+  } else if (req.count == 0) {
+    for (unsigned int i = 0; i < device_count; i++) query_device(i, req.want, &records[i]);
+    resp.count = device_count;
+  } else {
+    for (int i = 0; i < req.count; i++) query_device(ids[i], req.want, &records[i]);
+    resp.count = req.count;
+  }
+
+  if (write_full(fd, &resp, sizeof(resp)) == 0 && resp.count > 0)
+    write_full(fd, records, resp.count * sizeof(daemon_record_t));
+}
+
+static int open_server_socket(const char* path) {
+  struct sockaddr_un addr;
+  if (fill_address(path, &addr) != 0) {
+    fprintf(stderr, "Error: Socket path too long '%s'\n", path);
+    return -1;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Failed to create socket: %s\n", strerror(errno));
+    return -1;
+  }
+
+  // A socket file nobody accepts on is left over from a daemon that did not exit cleanly
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+    fprintf(stderr, "Error: A daemon is already listening on %s\n", path);
+    close(fd);
+    return -1;
+  }
+  unlink(path);
+
+  // Telemetry is readable by everyone, as with nvidia-smi; nothing here changes device state
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || chmod(path, 0666) != 0 ||
+      listen(fd, 64) != 0) {
+    fprintf(stderr, "Error: Failed to listen on %s: %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int run_daemon(const char* path, volatile int* running) {
+  nvmlReturn_t result = gpu->get_count(&device_count);
+  if (result != NVML_SUCCESS) {
+    fprintf(stderr, "Error: Failed to get device count (%s)\n", gpu->error_string(result));
+    return -1;
+  }
+
+  // A request may name more devices than there are (each unknown ID gets an error record)
+  devices = calloc(device_count ? device_count : 1, sizeof(daemon_device_t));
+  daemon_record_t* records =
+      calloc(device_count > DAEMON_MAX_IDS ? device_count : DAEMON_MAX_IDS,
+             sizeof(daemon_record_t));
+  int32_t* ids = calloc(DAEMON_MAX_IDS, sizeof(int32_t));
+  if (!devices || !records || !ids) {
+    fprintf(stderr, "Error: Out of memory\n");
+    free(devices);
+    free(records);
+    free(ids);
+    return -1;
+  }
+
+  for (unsigned int i = 0; i < device_count; i++) {
+    daemon_device_t* dev = &devices[i];
+    strcpy(dev->name, "Unknown");
+    strcpy(dev->uuid, "Unknown");
+    dev->status = gpu->get_handle_by_index(i, &dev->handle);
+    if (dev->status != NVML_SUCCESS) {
+      fprintf(stderr, "%u:Warning: No handle (%s)\n", i, gpu->error_string(dev->status));
+      continue;
+    }
+    gpu->get_name(dev->handle, dev->name, sizeof(dev->name));
+    gpu->get_uuid(dev->handle, dev->uuid, sizeof(dev->uuid));
+  }
+
+  int listen_fd = open_server_socket(path);
+  if (listen_fd < 0) {
+    free(devices);
+    free(records);
+    free(ids);
+    return -1;
+  }
+  fprintf(stderr, "Serving %u device(s) on %s (Ctrl-C to exit)\n", device_count, path);
+
+  // poll() is never restarted after a signal handler, so SIGINT/SIGTERM end the loop promptly
+  while (*running) {
+    struct pollfd pfd = {listen_fd, POLLIN, 0};
+    if (poll(&pfd, 1, -1) <= 0) continue;
+
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) continue;
+    serve_client(fd, records, ids);
+    close(fd);
+  }
+
+  close(listen_fd);
+  unlink(path);
+  free(devices);
+  free(records);
+  free(ids);
+  devices = NULL;
+  return 0;
+}
+
+static const char* status_string(int32_t status) {
+  switch (status) {
+  case DAEMON_ERR_REQUEST: return "malformed request";
+  case DAEMON_ERR_VERSION: return "different protocol version";
+  case DAEMON_ERR_COUNT: return "too many device IDs";
+  default: return "unknown status";
+  }
+}
+
+int daemon_query(const char* path, unsigned int want, const int* ids, int count, const char* uuid,
+                 daemon_response_t* resp, daemon_record_t* records, int max) {
+  struct sockaddr_un addr;
+  if (fill_address(path, &addr) != 0) return -1;
+
+  daemon_request_t req;
+  memset(&req, 0, sizeof(req));
+  req.magic = DAEMON_PROTOCOL_MAGIC;
+  req.version = DAEMON_PROTOCOL_VERSION;
+  req.op = DAEMON_OP_QUERY;
+  req.want = want;
+  req.count = uuid && *uuid ? 0 : count;
+  if (uuid) strncpy(req.uuid, uuid, sizeof(req.uuid) - 1);
+  if (req.count > max) return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    close(fd); // No daemon: the common case, not an error
+    return -1;
+  }
+  set_timeouts(fd);
+
+  // A daemon that refuses the request may answer before reading the IDs, so the answer is read
+  // even if they could not all be sent
+  int32_t wire_ids[max > 0 ? max : 1];
+  for (int i = 0; i < req.count; i++) wire_ids[i] = ids[i];
+  if (write_full(fd, &req, sizeof(req)) != 0) {
+    close(fd);
+    return -1;
+  }
+  if (req.count > 0) write_full(fd, wire_ids, req.count * sizeof(int32_t));
+  if (read_full(fd, resp, sizeof(*resp)) != 0) {
+    close(fd); // The daemon went away without answering
+    return -1;
+  }
+
+  int ok = 0;
+  if (resp->magic != DAEMON_PROTOCOL_MAGIC)
+    fprintf(stderr, "Error: %s is not an nvml-tool daemon socket\n", path);
+  else if (resp->version != DAEMON_PROTOCOL_VERSION)
+    fprintf(stderr,
+            "Error: Daemon on %s speaks protocol version %u, not %u (restart it, or use "
+            "--direct)\n",
+            path, resp->version, DAEMON_PROTOCOL_VERSION);
+  else if (resp->status != DAEMON_OK)
+    fprintf(stderr, "Error: Daemon on %s refused the query (%s)\n", path,
+            status_string(resp->status));
+  else if (resp->record_size != sizeof(daemon_record_t) || resp->count > max)
+    fprintf(stderr, "Error: Malformed response from daemon on %s\n", path);
+  else if (resp->count > 0 && read_full(fd, records, resp->count * sizeof(daemon_record_t)) != 0)
+    fprintf(stderr, "Error: Incomplete response from daemon on %s\n", path);
+  else
+    ok = 1;
+
+  close(fd);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+#ifndef NVML_TOOL_DAEMON_H
+#define NVML_TOOL_DAEMON_H
+
+#include <stdint.h>
+
+#include "telemetry.h"
+
+#define DEFAULT_DAEMON_SOCKET "/run/nvml-tool.sock"
+#define DAEMON_SOCKET_ENV "NVML_TOOL_SOCKET"
+
+// Wire protocol: one request and one response per connection, native byte order (the socket is
+// local). A daemon_request_t followed by count int32 device IDs; the reply is a
+// daemon_response_t followed, if the request was accepted, by count daemon_record_t.
+#define DAEMON_PROTOCOL_MAGIC 0x4454564eu // "NVTD"
+#define DAEMON_PROTOCOL_VERSION 3
+#define DAEMON_UUID_LEN 80
+#define DAEMON_MAX_IDS 1024 // Device IDs one request may name, valid or not
+
+enum { DAEMON_OP_QUERY = 1 };
+
+// daemon_response_t.status
+enum {
+  DAEMON_OK = 0,
+  DAEMON_ERR_REQUEST = 1, // Truncated request, wrong magic or unknown op
+  DAEMON_ERR_VERSION = 2, // Request for another protocol version
+  DAEMON_ERR_COUNT = 3,   // Negative count, or more than DAEMON_MAX_IDS device IDs
+};
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t op;
+  uint32_t want; // TM_* mask
+  int32_t count; // Device IDs that follow; 0 selects every device
+  char uuid[DAEMON_UUID_LEN]; // If set, select the first device whose UUID contains it instead
+} daemon_request_t;
+
+// magic, version and status keep their offsets in later versions, so a refusal can always be read
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;  // sizeof(daemon_record_t); clients reject a mismatch
+  int32_t status;        // DAEMON_OK, or why the request was refused
+  uint32_t device_count; // Devices known to the daemon
+  int32_t count;         // Records that follow, -1 if the UUID matched no device
+} daemon_response_t;
+
+typedef struct {
+  int32_t device_id;
+  int32_t status;      // nvmlReturn_t of the handle lookup; telemetry is valid only on success
+  int32_t temp_status; // nvmlReturn_t of the temperature read, if TM_TEMP was asked for
+  telemetry_t telemetry;
+} daemon_record_t;
+
+// Socket path: override if set, else $NVML_TOOL_SOCKET, else DEFAULT_DAEMON_SOCKET
+const char* daemon_socket_path(const char* override);
+
+// Serve queries on path until *running drops to 0. The backend must be initialized; device
+// handles, names and UUIDs are resolved once at startup. Returns 0 on a clean shutdown.
+int run_daemon(const char* path, volatile int* running);
+
+// Ask the daemon at path for the want fields of the given devices (count 0: all, or the device
+// matching uuid if non-empty). Fills resp and up to max records. Returns 0 on success, -1 if no
+// daemon answered, in which case the caller should query NVML itself, or 1 if the daemon
+// refused the request or gave an answer that cannot be used (the reason is printed).
+int daemon_query(const char* path, unsigned int want, const int* ids, int count, const char* uuid,
+                 daemon_response_t* resp, daemon_record_t* records, int max);
+
+#endif
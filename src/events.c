@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include "events.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "backend.h"
+
+#define EVENTS_WANTED \
+  (nvmlEventTypeXidCriticalError | nvmlEventTypeClock | nvmlEventTypePState | \
+   nvmlEventTypePowerSourceChange)
+#define EVENTS_WAIT_MS 200 // Bounds how long events_stop() waits for the thread
+#define EVENTS_RETRY_MS 1000
+
+static const unsigned long long thermal_reasons =
+    nvmlClocksThrottleReasonSwThermalSlowdown | nvmlClocksThrottleReasonHwThermalSlowdown;
+
+typedef struct {
+  nvmlDevice_t device;
+  unsigned long long reasons; // Throttle reasons at the last clock event
+  gpu_event_t posted;
+} event_slot_t;
+
+static struct {
+  int active;
+  int stopping;
+  nvmlEventSet_t set;
+  event_slot_t* slots;
+  int count;
+  int wake_fd; // eventfd, readable while events are waiting to be taken
+  pthread_mutex_t lock;
+  pthread_t thread;
+} events = {.wake_fd = -1};
+
+static event_slot_t* find_slot(nvmlDevice_t device) {
+  for (int i = 0; i < events.count; i++)
+    if (events.slots[i].device == device) return &events.slots[i];
+  return NULL;
+}
+
+static void post(event_slot_t* slot, unsigned int flags, unsigned long long xid,
+                 unsigned long long power_source) {
+  pthread_mutex_lock(&events.lock);
+  slot->posted.flags |= flags;
+  if (flags & (GPU_EVENT_XID | GPU_EVENT_LOST)) slot->posted.xid = xid;
+  if (flags & GPU_EVENT_POWER_SOURCE) slot->posted.power_source = power_source;
+  pthread_mutex_unlock(&events.lock);
+
+  // Only fails if the counter would overflow, and then the loop is already awake
+  uint64_t one = 1;
+  ssize_t written = write(events.wake_fd, &one, sizeof(one));
+  (void)written;
+}
+
+// NVML reports a lost GPU from the wait itself without saying which one, so ask every device
+static void find_lost_devices(void) {
+  for (int i = 0; i < events.count; i++) {
+    event_slot_t* slot = &events.slots[i];
+    unsigned long long reasons;
+    if (gpu->get_throttle_reasons(slot->device, &reasons) == NVML_ERROR_GPU_IS_LOST)
+      post(slot, GPU_EVENT_LOST, 0, 0);
+  }
+}
+
+static void handle_event(const nvmlEventData_t* data) {
+  event_slot_t* slot = find_slot(data->device);
+  if (!slot) return;
+
+  if (data->eventType & nvmlEventTypeXidCriticalError) {
+    unsigned int flag = data->eventData == GPU_XID_FALLEN_OFF_BUS ? GPU_EVENT_LOST : GPU_EVENT_XID;
+    post(slot, flag, data->eventData, 0);
+  }
+  if (data->eventType & nvmlEventTypePowerSourceChange)
+    post(slot, GPU_EVENT_POWER_SOURCE, 0, data->eventData);
+
+  if (data->eventType & (nvmlEventTypeClock | nvmlEventTypePState)) {
+    unsigned long long reasons;
+    nvmlReturn_t result = gpu->get_throttle_reasons(slot->device, &reasons);
+    if (result == NVML_ERROR_GPU_IS_LOST) {
+      post(slot, GPU_EVENT_LOST, 0, 0);
+    } else if (result == NVML_SUCCESS) {
+      if ((reasons & thermal_reasons) && !(slot->reasons & thermal_reasons))
+        post(slot, GPU_EVENT_THERMAL, 0, 0);
+      slot->reasons = reasons;
+    }
+  }
+}
+
+static void* events_main(void* arg) {
+  (void)arg;
+  while (!__atomic_load_n(&events.stopping, __ATOMIC_ACQUIRE)) {
+    nvmlEventData_t data;
+    nvmlReturn_t result = gpu->event_set_wait(events.set, &data, EVENTS_WAIT_MS);
+    if (result == NVML_SUCCESS) {
+      handle_event(&data);
+    } else if (result == NVML_ERROR_GPU_IS_LOST) {
+      find_lost_devices();
+    } else if (result != NVML_ERROR_TIMEOUT) {
+      // Keep the loop from spinning on a persistent error; polling still covers the devices
+      struct timespec delay = {EVENTS_RETRY_MS / 1000, (EVENTS_RETRY_MS % 1000) * 1000000L};
+      nanosleep(&delay, NULL);
+    }
+  }
+  return NULL;
+}
+
+int events_start(const nvmlDevice_t* devices, int count) {
+  if (events.active) return -1;
+  if (gpu->event_set_create(&events.set) != NVML_SUCCESS) return 0;
+
+  events.slots = calloc(count, sizeof(event_slot_t));
+  events.wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (!events.slots || events.wake_fd < 0) {
+    fprintf(stderr, "Error: Failed to set up event handling\n");
+    events_stop();
+    return -1;
+  }
+
+  int registered = 0;
+  for (int i = 0; i < count; i++) {
+    unsigned long long supported = 0;
+    if (gpu->get_supported_event_types(devices[i], &supported) != NVML_SUCCESS) continue;
+    supported &= EVENTS_WANTED;
+    if (!supported || gpu->register_events(devices[i], supported, events.set) != NVML_SUCCESS)
+      continue;
+
+    event_slot_t* slot = &events.slots[events.count++];
+    slot->device = devices[i];
+    gpu->get_throttle_reasons(devices[i], &slot->reasons);
+    registered++;
+  }
+  if (registered == 0) {
+    events_stop();
+    return 0;
+  }
+
+  // Signals are for the control loop, whose wait they interrupt; keep them off this thread
+  pthread_mutex_init(&events.lock, NULL);
+  events.stopping = 0;
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  int err = pthread_create(&events.thread, NULL, events_main, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (err != 0) {
+    fprintf(stderr, "Error: Failed to start event thread\n");
+    pthread_mutex_destroy(&events.lock);
+    events_stop();
+    return -1;
+  }
+  events.active = 1;
+  return registered;
+}
+
+void events_stop(void) {
+  if (events.active) {
+    __atomic_store_n(&events.stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(events.thread, NULL);
+    pthread_mutex_destroy(&events.lock);
+    events.active = 0;
+  }
+  if (events.set) gpu->event_set_free(events.set);
+  if (events.wake_fd >= 0) close(events.wake_fd);
+  free(events.slots);
+  events.set = NULL;
+  events.wake_fd = -1;
+  events.slots = NULL;
+  events.count = 0;
+}
+
+unsigned int events_take(nvmlDevice_t device, gpu_event_t* event) {
+  event->flags = 0;
+  if (!events.active) return 0;
+  event_slot_t* slot = find_slot(device);
+  if (!slot) return 0;
+
+  pthread_mutex_lock(&events.lock);
+  *event = slot->posted;
+  slot->posted.flags = 0;
+  pthread_mutex_unlock(&events.lock);
+  return event->flags;
+}
+
+int events_wait(int fd) {
+  // poll() skips the negative descriptor while no event thread runs
+  struct pollfd pfd[2] = {{fd, POLLIN, 0}, {events.active ? events.wake_fd : -1, POLLIN, 0}};
+  if (ppoll(pfd, 2, NULL, NULL) <= 0) return 0; // EINTR from a signal
+
+  uint64_t pending;
+  if ((pfd[0].revents & POLLIN) && read(fd, &pending, sizeof(pending)) < 0 && errno != EAGAIN)
+    return 0;
+  if (!(pfd[1].revents & POLLIN)) return 0;
+  if (read(events.wake_fd, &pending, sizeof(pending)) < 0 && errno != EAGAIN) return 0;
+  return 1;
+}
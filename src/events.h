@@ -0,0 +1,35 @@
+#ifndef NVML_TOOL_EVENTS_H
+#define NVML_TOOL_EVENTS_H
+
+#include <nvml.h>
+
+// Flags posted for a device by the event thread
+#define GPU_EVENT_THERMAL (1u << 0)      // Entered thermal slowdown
+#define GPU_EVENT_LOST (1u << 1)         // Fell off the bus (XID 79) or otherwise inaccessible
+#define GPU_EVENT_XID (1u << 2)          // Any other critical XID error
+#define GPU_EVENT_POWER_SOURCE (1u << 3) // Power source changed
+
+#define GPU_XID_FALLEN_OFF_BUS 79
+
+typedef struct {
+  unsigned int flags;              // GPU_EVENT_* bits since the last events_take()
+  unsigned long long xid;          // Last XID for GPU_EVENT_XID or GPU_EVENT_LOST, 0 if none
+  unsigned long long power_source; // nvmlPowerSource_t for GPU_EVENT_POWER_SOURCE
+} gpu_event_t;
+
+// Register every device for the XID, clock, P-state and power source events it supports, and
+// start a thread waiting on them through the backend. Clock and P-state events are turned into
+// GPU_EVENT_THERMAL by checking the throttle reasons. Returns the number of devices registered,
+// 0 if the backend supports no events (polling still works), or -1 on error.
+int events_start(const nvmlDevice_t* devices, int count);
+
+void events_stop(void);
+
+// Take and clear what was posted for device. Returns the flags.
+unsigned int events_take(nvmlDevice_t device, gpu_event_t* event);
+
+// Sleep until fd, an eventfd of the caller's, becomes readable, an event is posted or a signal
+// arrives. fd is read back to zero if it was readable. Returns 1 if woken by an event.
+int events_wait(int fd);
+
+#endif
@@ -0,0 +1,420 @@
+#define _GNU_SOURCE
+#include "export.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "telemetry.h"
+#include "timeutil.h"
+
+#define EXPORT_DEVICE_BYTES 4096 // Page space reserved per device
+#define EXPORT_REQUEST_MAX 2048
+
+// Exporter state. The sampler renders into the spare page and swaps it in under the lock; the
+// server copies the current page out under the same lock, so a slow client never holds it
+// while writing.
+static struct {
+  int active;
+  int stopping;
+  int listen_fd;
+  const nvmlDevice_t* devices;
+  const int* device_ids;
+  int count;
+  unsigned int interval_ms;
+
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_t sampler;
+  pthread_t server;
+
+  char* pages[2];
+  size_t lengths[2];
+  int current;
+  size_t page_size;
+  unsigned long long scrapes;
+
+  telemetry_t* samples;
+  export_controller_t* controllers; // Guarded by lock
+  int* has_controller;
+} exporter;
+
+typedef enum {
+  M_TEMP,
+  M_FAN,
+  M_POWER,
+  M_POWER_LIMIT,
+  M_MEM_TOTAL,
+  M_MEM_USED,
+  M_MEM_FREE
+} metric_id_t;
+
+static const struct {
+  metric_id_t id;
+  const char* name;
+  const char* type;
+  const char* help;
+  unsigned int flag;
+} metrics[] = {
+    {M_TEMP, "nvml_temperature_celsius", "gauge", "GPU core temperature", TM_TEMP},
+    {M_FAN, "nvml_fan_speed_percent", "gauge", "Fan speed", TM_FAN},
+    {M_POWER, "nvml_power_usage_watts", "gauge", "Power draw", TM_POWER},
+    {M_POWER_LIMIT, "nvml_power_limit_watts", "gauge", "Power management limit", TM_POWER_LIMIT},
+    {M_MEM_TOTAL, "nvml_memory_total_bytes", "gauge", "Total framebuffer memory", TM_MEMORY},
+    {M_MEM_USED, "nvml_memory_used_bytes", "gauge", "Used framebuffer memory", TM_MEMORY},
+    {M_MEM_FREE, "nvml_memory_free_bytes", "gauge", "Free framebuffer memory", TM_MEMORY},
+};
+
+static double metric_value(metric_id_t id, const telemetry_t* t) {
+  switch (id) {
+  case M_TEMP: return t->temperature;
+  case M_FAN: return t->fan_speed;
+  case M_POWER: return t->power_usage / 1000.0;
+  case M_POWER_LIMIT: return t->power_limit / 1000.0;
+  case M_MEM_TOTAL: return (double)t->memory.total;
+  case M_MEM_USED: return (double)t->memory.used;
+  case M_MEM_FREE: return (double)t->memory.free;
+  }
+  return 0.0;
+}
+
+// Label values are NVML names and UUIDs; escape the characters the text format reserves
+static size_t append_label(char* buf, size_t size, const char* value) {
+  size_t n = 0;
+  for (; *value && n + 2 < size; value++) {
+    if (*value == '"' || *value == '\\') buf[n++] = '\\';
+    buf[n++] = *value;
+  }
+  buf[n] = '\0';
+  return n;
+}
+
+static size_t render_labels(char* buf, size_t size, int i) {
+  char name[2 * TELEMETRY_NAME_LEN], uuid[2 * TELEMETRY_UUID_LEN];
+  append_label(name, sizeof(name), exporter.samples[i].name);
+  append_label(uuid, sizeof(uuid), exporter.samples[i].uuid);
+  return snprintf(buf, size, "{gpu=\"%d\",uuid=\"%s\",name=\"%s\"}", exporter.device_ids[i], uuid,
+                  name);
+}
+
+static size_t render_page(char* buf, size_t size, uint64_t sample_ns) {
+  size_t n = 0;
+  char labels[512];
+
+  for (size_t m = 0; m < sizeof(metrics) / sizeof(metrics[0]); m++) {
+    n += snprintf(buf + n, size - n, "# HELP %s %s\n# TYPE %s %s\n", metrics[m].name,
+                  metrics[m].help, metrics[m].name, metrics[m].type);
+    for (int i = 0; i < exporter.count && n < size; i++) {
+      if (!(exporter.samples[i].valid & metrics[m].flag)) continue;
+      render_labels(labels, sizeof(labels), i);
+      n += snprintf(buf + n, size - n, "%s%s %.17g\n", metrics[m].name, labels,
+                    metric_value(metrics[m].id, &exporter.samples[i]));
+    }
+  }
+
+  // Controller state, present only while fanctl runs in this process
+  pthread_mutex_lock(&exporter.lock);
+  int any_controller = 0;
+  for (int i = 0; i < exporter.count; i++) any_controller |= exporter.has_controller[i];
+  if (any_controller) {
+    static const struct {
+      const char* name;
+      const char* type;
+      const char* help;
+    } ctl[] = {
+        {"nvml_fanctl_control_temperature_celsius", "gauge", "Temperature fed to the fan curve"},
+        {"nvml_fanctl_target_percent", "gauge", "Fan speed commanded by fanctl"},
+        {"nvml_fanctl_fan_writes_total", "counter", "Fan speed writes issued"},
+        {"nvml_fanctl_fan_writes_elided_total", "counter", "Fan speed writes skipped"},
+    };
+    for (int m = 0; m < 4; m++) {
+      n += snprintf(buf + n, size - n, "# HELP %s %s\n# TYPE %s %s\n", ctl[m].name, ctl[m].help,
+                    ctl[m].name, ctl[m].type);
+      for (int i = 0; i < exporter.count && n < size; i++) {
+        if (!exporter.has_controller[i]) continue;
+        const export_controller_t* c = &exporter.controllers[i];
+        double values[4] = {c->control_temp, c->target_fan, (double)c->writes,
+                            (double)c->writes_elided};
+        render_labels(labels, sizeof(labels), i);
+        n += snprintf(buf + n, size - n, "%s%s %.17g\n", ctl[m].name, labels, values[m]);
+      }
+    }
+  }
+  unsigned long long scrapes = exporter.scrapes;
+  pthread_mutex_unlock(&exporter.lock);
+
+  n += snprintf(buf + n, size - n,
+                "# HELP nvml_exporter_sample_duration_seconds Time to sample all devices\n"
+                "# TYPE nvml_exporter_sample_duration_seconds gauge\n"
+                "nvml_exporter_sample_duration_seconds %.9f\n"
+                "# HELP nvml_exporter_scrapes_total Requests served for /metrics\n"
+                "# TYPE nvml_exporter_scrapes_total counter\n"
+                "nvml_exporter_scrapes_total %llu\n",
+                sample_ns / 1e9, scrapes);
+  return n < size ? n : size - 1;
+}
+
+static void* sampler_main(void* arg) {
+  (void)arg;
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+  pthread_mutex_lock(&exporter.lock);
+  while (!exporter.stopping) {
+    pthread_mutex_unlock(&exporter.lock);
+
+    uint64_t start = monotonic_ns();
+    for (int i = 0; i < exporter.count; i++)
+      telemetry_read(exporter.devices[i], TM_ALL, &exporter.samples[i]);
+    uint64_t sample_ns = monotonic_ns() - start;
+
+    int spare = !exporter.current; // Only this thread changes current
+    size_t len = render_page(exporter.pages[spare], exporter.page_size, sample_ns);
+
+    pthread_mutex_lock(&exporter.lock);
+    exporter.lengths[spare] = len;
+    exporter.current = spare;
+
+    timespec_add_ms(&deadline, exporter.interval_ms);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    while (!timespec_before(&now, &deadline)) timespec_add_ms(&deadline, exporter.interval_ms);
+
+    // The condition variable uses CLOCK_MONOTONIC (see export_start), so the deadline applies
+    while (!exporter.stopping &&
+           pthread_cond_timedwait(&exporter.wake, &exporter.lock, &deadline) != ETIMEDOUT)
+      ;
+  }
+  pthread_mutex_unlock(&exporter.lock);
+  return NULL;
+}
+
+static void send_all(int fd, const char* buf, size_t len) {
+  while (len > 0) {
+    ssize_t w = send(fd, buf, len, MSG_NOSIGNAL);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return;
+    buf += w;
+    len -= w;
+  }
+}
+
+static void send_response(int fd, const char* status, const char* type, const char* body,
+                          size_t len, int head_only) {
+  char header[256];
+  int n = snprintf(header, sizeof(header),
+                   "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                   "Connection: close\r\n\r\n",
+                   status, type, len);
+  send_all(fd, header, n);
+  if (!head_only) send_all(fd, body, len);
+}
+
+static void handle_client(int fd, char* page) {
+  char request[EXPORT_REQUEST_MAX];
+  size_t got = 0;
+
+  // Read until the end of the request headers; the body, if any, is ignored
+  while (got < sizeof(request) - 1) {
+    ssize_t r = recv(fd, request + got, sizeof(request) - 1 - got, 0);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) break;
+    got += r;
+    request[got] = '\0';
+    if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+  }
+  request[got] = '\0';
+
+  char method[8] = "", path[256] = "";
+  if (sscanf(request, "%7s %255s", method, path) != 2) {
+    send_response(fd, "400 Bad Request", "text/plain", "Bad Request\n", 12, 0);
+    return;
+  }
+
+  int head_only = strcmp(method, "HEAD") == 0;
+  if (!head_only && strcmp(method, "GET") != 0) {
+    send_response(fd, "405 Method Not Allowed", "text/plain", "Method Not Allowed\n", 19, 0);
+    return;
+  }
+
+  char* query = strchr(path, '?');
+  if (query) *query = '\0';
+  if (strcmp(path, "/metrics") != 0) {
+    send_response(fd, "404 Not Found", "text/plain", "Not Found\n", 10, head_only);
+    return;
+  }
+
+  pthread_mutex_lock(&exporter.lock);
+  size_t len = exporter.lengths[exporter.current];
+  memcpy(page, exporter.pages[exporter.current], len);
+  exporter.scrapes++;
+  pthread_mutex_unlock(&exporter.lock);
+
+  send_response(fd, "200 OK", "text/plain; version=0.0.4; charset=utf-8", page, len, head_only);
+}
+
+static void* server_main(void* arg) {
+  (void)arg;
+  char* page = malloc(exporter.page_size);
+  if (!page) return NULL;
+
+  for (;;) {
+    int fd = accept(exporter.listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      break; // Listener shut down by export_stop()
+    }
+    struct timeval timeout = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    handle_client(fd, page);
+    close(fd);
+  }
+
+  free(page);
+  return NULL;
+}
+
+static int open_listener(const char* listen_spec) {
+  char host[64] = "0.0.0.0";
+  const char* port_str = listen_spec;
+  const char* colon = strrchr(listen_spec, ':');
+  if (colon) {
+    size_t host_len = colon - listen_spec;
+    if (host_len >= sizeof(host)) host_len = sizeof(host) - 1;
+    if (host_len > 0) {
+      memcpy(host, listen_spec, host_len);
+      host[host_len] = '\0';
+    }
+    port_str = colon + 1;
+  }
+
+  char* end = NULL;
+  long port = strtol(port_str, &end, 10);
+  struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons((uint16_t)port)};
+  if (!end || *end || port < 1 || port > 65535 || inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+    fprintf(stderr, "Error: Invalid listen address '%s'\n", listen_spec);
+    return -1;
+  }
+
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Failed to create socket: %s\n", strerror(errno));
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+    fprintf(stderr, "Error: Failed to listen on %s: %s\n", listen_spec, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void free_buffers(void) {
+  free(exporter.pages[0]);
+  free(exporter.pages[1]);
+  free(exporter.samples);
+  free(exporter.controllers);
+  free(exporter.has_controller);
+  exporter.pages[0] = exporter.pages[1] = NULL;
+  exporter.samples = NULL;
+  exporter.controllers = NULL;
+  exporter.has_controller = NULL;
+}
+
+// Ask the sampler to finish and wait for it; it checks stopping between samples
+static void stop_sampler(void) {
+  pthread_mutex_lock(&exporter.lock);
+  exporter.stopping = 1;
+  pthread_cond_signal(&exporter.wake);
+  pthread_mutex_unlock(&exporter.lock);
+  pthread_join(exporter.sampler, NULL);
+}
+
+// Everything export_start() sets up besides the threads
+static void release(void) {
+  close(exporter.listen_fd);
+  pthread_cond_destroy(&exporter.wake);
+  pthread_mutex_destroy(&exporter.lock);
+  free_buffers();
+}
+
+int export_start(const char* listen_spec, const nvmlDevice_t* devices, const int* device_ids,
+                 int count, unsigned int interval_ms) {
+  if (exporter.active) return 0;
+
+  exporter.listen_fd = open_listener(listen_spec);
+  if (exporter.listen_fd < 0) return -1;
+
+  exporter.devices = devices;
+  exporter.device_ids = device_ids;
+  exporter.count = count;
+  exporter.interval_ms = interval_ms;
+  exporter.stopping = 0;
+  exporter.page_size = (size_t)count * EXPORT_DEVICE_BYTES + EXPORT_DEVICE_BYTES;
+  exporter.pages[0] = malloc(exporter.page_size);
+  exporter.pages[1] = malloc(exporter.page_size);
+  exporter.samples = calloc(count, sizeof(telemetry_t));
+  exporter.controllers = calloc(count, sizeof(export_controller_t));
+  exporter.has_controller = calloc(count, sizeof(int));
+  if (!exporter.pages[0] || !exporter.pages[1] || !exporter.samples || !exporter.controllers ||
+      !exporter.has_controller) {
+    fprintf(stderr, "Error: Out of memory\n");
+    close(exporter.listen_fd);
+    free_buffers();
+    return -1;
+  }
+  exporter.lengths[0] = exporter.lengths[1] = 0;
+  exporter.current = 0;
+
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&exporter.wake, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_mutex_init(&exporter.lock, NULL);
+
+  // Render the first page before accepting scrapes so /metrics is never empty
+  for (int i = 0; i < count; i++) telemetry_read(devices[i], TM_ALL, &exporter.samples[i]);
+  exporter.lengths[0] = render_page(exporter.pages[0], exporter.page_size, 0);
+
+  if (pthread_create(&exporter.sampler, NULL, sampler_main, NULL) != 0) {
+    fprintf(stderr, "Error: Failed to start exporter threads\n");
+    release();
+    return -1;
+  }
+  if (pthread_create(&exporter.server, NULL, server_main, NULL) != 0) {
+    fprintf(stderr, "Error: Failed to start exporter threads\n");
+    stop_sampler();
+    release();
+    return -1;
+  }
+  exporter.active = 1;
+  return 0;
+}
+
+void export_update_controller(int index, const export_controller_t* state) {
+  if (!exporter.active || index < 0 || index >= exporter.count) return;
+  pthread_mutex_lock(&exporter.lock);
+  exporter.controllers[index] = *state;
+  exporter.has_controller[index] = 1;
+  pthread_mutex_unlock(&exporter.lock);
+}
+
+void export_stop(void) {
+  if (!exporter.active) return;
+
+  stop_sampler();
+  shutdown(exporter.listen_fd, SHUT_RDWR); // Unblocks accept()
+  pthread_join(exporter.server, NULL);
+  release();
+  exporter.active = 0;
+}
@@ -0,0 +1,27 @@
+#ifndef NVML_TOOL_EXPORT_H
+#define NVML_TOOL_EXPORT_H
+
+#include <nvml.h>
+
+#define DEFAULT_EXPORT_LISTEN "127.0.0.1:9400"
+
+// Fan-controller state published by fanctl when it runs in the same process
+typedef struct {
+  unsigned int control_temp; // C, after hysteresis
+  unsigned int target_fan;   // %
+  unsigned long writes;
+  unsigned long writes_elided;
+} export_controller_t;
+
+// Start the background sampler and the HTTP listener serving /metrics on listen
+// ("host:port", ":port" for all interfaces, or just "port"). The page is rendered from a
+// snapshot refreshed every interval_ms, so scrapes never touch NVML. Returns 0 on success.
+int export_start(const char* listen, const nvmlDevice_t* devices, const int* device_ids, int count,
+                 unsigned int interval_ms);
+
+// Publish controller state for the index-th exported device. No-op if the exporter is not running.
+void export_update_controller(int index, const export_controller_t* state);
+
+void export_stop(void);
+
+#endif
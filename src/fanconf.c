@@ -0,0 +1,630 @@
+#define _GNU_SOURCE
+#include "fanconf.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define FANCONF_WAIT_MS 200 // Bounds how long fanconf_watch_stop() waits for the thread
+#define FANCONF_NAME_LEN 80
+
+// Keys a section sets, as bits of section_t.set
+#define KEY_SENSOR (1u << 0)
+#define KEY_SETPOINTS (1u << 1)
+#define KEY_CURVE (1u << 2)
+#define KEY_CONTROLLER (1u << 3)
+#define KEY_TARGET (1u << 4)
+#define KEY_PID (1u << 5)
+#define KEY_FEED_FORWARD (1u << 6)
+#define KEY_SLEW (1u << 7)
+#define KEY_INTERVAL (1u << 8)
+#define KEY_MIN_INTERVAL (1u << 9)
+#define KEY_MAX_INTERVAL (1u << 10)
+#define KEY_DEADBAND (1u << 11)
+#define KEY_HYSTERESIS (1u << 12)
+#define KEY_DEVICES (1u << 13)
+
+typedef enum { SECTION_DEFAULTS, SECTION_GROUP, SECTION_DEVICE } section_kind_t;
+
+static const char* const section_kinds[] = {"defaults", "group", "device"};
+static const char* const sensor_names[] = {"core", "vram", "hotspot"};
+
+typedef struct {
+  section_kind_t kind;
+  char name[FANCONF_NAME_LEN]; // Group name, or device index or UUID
+  int line;
+  unsigned int set;      // KEY_* bits given in the section
+  fan_policy_t values;   // Only the fields of the keys in set are meaningful
+  unsigned int interval; // interval =, which sets both bounds
+  char* members;         // Group devices: indices, ranges A-B and UUIDs
+} section_t;
+
+typedef struct {
+  const char* path;
+  section_t* sections;
+  int count;
+} config_file_t;
+
+typedef struct {
+  const char* name;
+  unsigned int key;
+  int (*parse)(const char* value, section_t* s);
+} config_key_t;
+
+__attribute__((format(printf, 3, 4))) static void conf_error(const config_file_t* cf, int line,
+                                                             const char* fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  fprintf(stderr, "Error: %s:%d: ", cf->path, line);
+  vfprintf(stderr, fmt, ap);
+  fprintf(stderr, "\n");
+  va_end(ap);
+}
+
+static char* trim(char* s) {
+  while (isspace((unsigned char)*s)) s++;
+  char* end = s + strlen(s);
+  while (end > s && isspace((unsigned char)end[-1])) *--end = '\0';
+  return s;
+}
+
+static int parse_uint(const char* value, unsigned int lo, unsigned int hi, unsigned int* out) {
+  char* end;
+  errno = 0;
+  unsigned long n = strtoul(value, &end, 10);
+  if (end == value || *end || errno || !isdigit((unsigned char)*value) || n < lo || n > hi)
+    return -1;
+  *out = n;
+  return 0;
+}
+
+// Accepts [lo, hi); the negated comparison also rejects NaN
+static int parse_double(const char* value, double lo, double hi, double* out) {
+  char* end;
+  double n = strtod(value, &end);
+  if (end == value || *end || !(n >= lo && n < hi)) return -1;
+  *out = n;
+  return 0;
+}
+
+static int parse_sensor(const char* value, section_t* s) {
+  for (int i = 0; i < (int)(sizeof(sensor_names) / sizeof(sensor_names[0])); i++) {
+    if (strcmp(value, sensor_names[i]) == 0) {
+      s->values.sensor = (sensor_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static int parse_setpoints(const char* value, section_t* s) {
+  char* copy = strdup(value);
+  if (!copy) return -1;
+  int count = 0, rc = 0;
+  char* save;
+  for (char* tok = strtok_r(copy, ", \t", &save); tok; tok = strtok_r(NULL, ", \t", &save)) {
+    if (count == CURVE_MAX_SETPOINTS ||
+        curve_parse_setpoint(tok, &s->values.setpoints[count++]) != 0) {
+      rc = -1;
+      break;
+    }
+  }
+  free(copy);
+  if (rc != 0 || count == 0 || curve_sort_setpoints(s->values.setpoints, count) != 0) return -1;
+  s->values.setpoint_count = count;
+  return 0;
+}
+
+static int parse_curve(const char* value, section_t* s) {
+  return curve_parse_type(value, &s->values.curve_type);
+}
+
+static int parse_controller(const char* value, section_t* s) {
+  if (strcmp(value, "curve") == 0)
+    s->values.controller = CONTROLLER_CURVE;
+  else if (strcmp(value, "pid") == 0)
+    s->values.controller = CONTROLLER_PID;
+  else
+    return -1;
+  return 0;
+}
+
+static int parse_target(const char* value, section_t* s) {
+  return parse_double(value, 0, CURVE_MAX_TEMP_C, &s->values.pid.target);
+}
+
+static int parse_gains(const char* value, section_t* s) {
+  return pid_parse_gains(value, &s->values.pid);
+}
+
+static int parse_feed_forward(const char* value, section_t* s) {
+  return parse_double(value, 0, 100, &s->values.pid.feed_forward);
+}
+
+static int parse_slew(const char* value, section_t* s) {
+  return parse_double(value, 0, 100, &s->values.pid.slew);
+}
+
+static int parse_interval(const char* value, section_t* s) {
+  return parse_uint(value, MIN_INTERVAL_MS, UINT_MAX, &s->interval);
+}
+
+static int parse_min_interval(const char* value, section_t* s) {
+  return parse_uint(value, MIN_INTERVAL_MS, UINT_MAX, &s->values.min_interval_ms);
+}
+
+static int parse_max_interval(const char* value, section_t* s) {
+  return parse_uint(value, MIN_INTERVAL_MS, UINT_MAX, &s->values.max_interval_ms);
+}
+
+static int parse_deadband(const char* value, section_t* s) {
+  return parse_uint(value, 0, 100, &s->values.deadband);
+}
+
+static int parse_hysteresis(const char* value, section_t* s) {
+  return parse_uint(value, 0, 100, &s->values.hysteresis);
+}
+
+// A member is a device index, a range A-B, or part of a UUID (which never starts with a digit).
+// Returns 1 for an index or range, 0 for a UUID, -1 if malformed.
+static int parse_member(const char* token, int* lo, int* hi) {
+  if (!isdigit((unsigned char)*token)) return 0;
+  char* end;
+  *lo = *hi = (int)strtol(token, &end, 10);
+  if (*end == '-') {
+    const char* second = end + 1;
+    if (!isdigit((unsigned char)*second)) return -1;
+    *hi = (int)strtol(second, &end, 10);
+  }
+  return *end || *hi < *lo ? -1 : 1;
+}
+
+static int parse_devices(const char* value, section_t* s) {
+  char* copy = strdup(value);
+  if (!copy) return -1;
+  int count = 0, rc = 0, lo, hi;
+  char* save;
+  for (char* tok = strtok_r(copy, ", \t", &save); tok; tok = strtok_r(NULL, ", \t", &save)) {
+    count++;
+    if (parse_member(tok, &lo, &hi) < 0) rc = -1;
+  }
+  free(copy);
+  if (rc != 0 || count == 0) return -1;
+  free(s->members);
+  s->members = strdup(value);
+  return s->members ? 0 : -1;
+}
+
+static const config_key_t keys[] = {
+    {"sensor", KEY_SENSOR, parse_sensor},
+    {"setpoints", KEY_SETPOINTS, parse_setpoints},
+    {"curve", KEY_CURVE, parse_curve},
+    {"controller", KEY_CONTROLLER, parse_controller},
+    {"target", KEY_TARGET, parse_target},
+    {"pid", KEY_PID, parse_gains},
+    {"feed-forward", KEY_FEED_FORWARD, parse_feed_forward},
+    {"slew", KEY_SLEW, parse_slew},
+    {"interval", KEY_INTERVAL, parse_interval},
+    {"min-interval", KEY_MIN_INTERVAL, parse_min_interval},
+    {"max-interval", KEY_MAX_INTERVAL, parse_max_interval},
+    {"deadband", KEY_DEADBAND, parse_deadband},
+    {"hysteresis", KEY_HYSTERESIS, parse_hysteresis},
+    {"devices", KEY_DEVICES, parse_devices},
+};
+
+static int parse_key(const config_file_t* cf, section_t* s, const char* key, const char* value,
+                     int line) {
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+    if (strcmp(key, keys[i].name) != 0) continue;
+    if (keys[i].key == KEY_DEVICES && s->kind != SECTION_GROUP) {
+      conf_error(cf, line, "'devices' only belongs in a [group] section");
+      return 1;
+    }
+    if (s->set & keys[i].key) {
+      conf_error(cf, line, "'%s' given twice in the section", key);
+      return 1;
+    }
+    if (keys[i].parse(value, s) != 0) {
+      conf_error(cf, line, "Invalid %s '%s'", key, value);
+      return 1;
+    }
+    s->set |= keys[i].key;
+    return 0;
+  }
+  conf_error(cf, line, "Unknown key '%s'", key);
+  return 1;
+}
+
+// "[defaults]", "[group NAME]" or "[device INDEX|UUID]". Returns NULL on error.
+static section_t* add_section(config_file_t* cf, char* header, int line) {
+  size_t len = strlen(header);
+  if (header[len - 1] != ']') {
+    conf_error(cf, line, "Expected ']' at the end of the section header");
+    return NULL;
+  }
+  header[len - 1] = '\0';
+  char* kind = trim(header + 1);
+  char* name = kind + strcspn(kind, " \t");
+  if (*name) *name++ = '\0';
+  name = trim(name);
+
+  int k = -1;
+  for (int i = 0; i < (int)(sizeof(section_kinds) / sizeof(section_kinds[0])); i++)
+    if (strcmp(kind, section_kinds[i]) == 0) k = i;
+  if (k < 0) {
+    conf_error(cf, line, "Unknown section [%s]; use [defaults], [group NAME] or [device ID|UUID]",
+               kind);
+    return NULL;
+  }
+  if ((k == SECTION_DEFAULTS) != !*name || strpbrk(name, " \t") ||
+      strlen(name) >= FANCONF_NAME_LEN) {
+    conf_error(cf, line, "Invalid section name '%s'", name);
+    return NULL;
+  }
+  int lo = 0, hi = 0;
+  if (k == SECTION_DEVICE && (parse_member(name, &lo, &hi) < 0 || lo != hi)) {
+    conf_error(cf, line, "Invalid device '%s'; name one index or UUID, or use a [group]", name);
+    return NULL;
+  }
+  for (int i = 0; i < cf->count; i++) {
+    if ((int)cf->sections[i].kind == k && strcmp(cf->sections[i].name, name) == 0) {
+      conf_error(cf, line, "Section already defined on line %d", cf->sections[i].line);
+      return NULL;
+    }
+  }
+
+  section_t* grown = realloc(cf->sections, (cf->count + 1) * sizeof(section_t));
+  if (!grown) {
+    conf_error(cf, line, "Out of memory");
+    return NULL;
+  }
+  cf->sections = grown;
+  section_t* s = &cf->sections[cf->count++];
+  memset(s, 0, sizeof(*s));
+  s->kind = (section_kind_t)k;
+  snprintf(s->name, sizeof(s->name), "%s", name);
+  s->line = line;
+  return s;
+}
+
+// Parse every line, reporting all errors rather than only the first. Returns the error count.
+static int parse_file(config_file_t* cf, FILE* f) {
+  char* buf = NULL;
+  size_t cap = 0;
+  int line = 0, errors = 0, skipping = 0;
+  section_t* current = NULL;
+
+  while (getline(&buf, &cap, f) > 0) {
+    line++;
+    char* hash = strchr(buf, '#');
+    if (hash) *hash = '\0';
+    char* s = trim(buf);
+    if (!*s) continue;
+
+    if (*s == '[') {
+      // Keys below a bad header would only repeat the error, so skip them
+      current = add_section(cf, s, line);
+      skipping = !current;
+      errors += skipping;
+      continue;
+    }
+    if (skipping) continue;
+
+    char* eq = strchr(s, '=');
+    if (!eq) {
+      conf_error(cf, line, "Expected 'KEY = VALUE'");
+      errors++;
+      continue;
+    }
+    if (!current) {
+      conf_error(cf, line, "Key outside a section");
+      errors++;
+      continue;
+    }
+    *eq = '\0';
+    errors += parse_key(cf, current, trim(s), trim(eq + 1), line);
+  }
+  free(buf);
+
+  for (int i = 0; i < cf->count; i++) {
+    const section_t* s = &cf->sections[i];
+    if (s->kind == SECTION_GROUP && !(s->set & KEY_DEVICES)) {
+      conf_error(cf, s->line, "[group %s] has no 'devices'", s->name);
+      errors++;
+    }
+    if ((s->set & KEY_INTERVAL) && (s->set & (KEY_MIN_INTERVAL | KEY_MAX_INTERVAL))) {
+      conf_error(cf, s->line, "'interval' fixes the period; drop 'min-interval'/'max-interval'");
+      errors++;
+    }
+  }
+  return errors;
+}
+
+static void free_sections(config_file_t* cf) {
+  for (int i = 0; i < cf->count; i++) free(cf->sections[i].members);
+  free(cf->sections);
+  cf->sections = NULL;
+  cf->count = 0;
+}
+
+static int member_matches(const char* token, const fanconf_device_t* device) {
+  int lo, hi;
+  int kind = parse_member(token, &lo, &hi);
+  if (kind == 1) return device->id >= lo && device->id <= hi;
+  return kind == 0 && strstr(device->uuid, token) != NULL;
+}
+
+static int group_has(const section_t* group, const fanconf_device_t* device) {
+  char* copy = strdup(group->members);
+  if (!copy) return 0;
+  int found = 0;
+  char* save;
+  for (char* tok = strtok_r(copy, ", \t", &save); tok && !found;
+       tok = strtok_r(NULL, ", \t", &save))
+    found = member_matches(tok, device);
+  free(copy);
+  return found;
+}
+
+// Later layers override the keys they set
+static void apply_section(fan_policy_t* p, const section_t* s) {
+  const fan_policy_t* v = &s->values;
+  if (s->set & KEY_SENSOR) p->sensor = v->sensor;
+  if (s->set & KEY_SETPOINTS) {
+    memcpy(p->setpoints, v->setpoints, sizeof(p->setpoints));
+    p->setpoint_count = v->setpoint_count;
+  }
+  if (s->set & KEY_CURVE) p->curve_type = v->curve_type;
+  if (s->set & KEY_CONTROLLER) p->controller = v->controller;
+  if (s->set & KEY_TARGET) {
+    p->pid.target = v->pid.target;
+    p->target_set = 1;
+  }
+  if (s->set & KEY_PID) {
+    p->pid.kp = v->pid.kp;
+    p->pid.ki = v->pid.ki;
+    p->pid.kd = v->pid.kd;
+  }
+  if (s->set & KEY_FEED_FORWARD) p->pid.feed_forward = v->pid.feed_forward;
+  if (s->set & KEY_SLEW) p->pid.slew = v->pid.slew;
+  if (s->set & KEY_INTERVAL) p->min_interval_ms = p->max_interval_ms = s->interval;
+  if (s->set & KEY_MIN_INTERVAL) p->min_interval_ms = v->min_interval_ms;
+  if (s->set & KEY_MAX_INTERVAL) p->max_interval_ms = v->max_interval_ms;
+  if (s->set & KEY_DEADBAND) p->deadband = v->deadband;
+  if (s->set & KEY_HYSTERESIS) p->hysteresis = v->hysteresis;
+}
+
+// Check a merged policy and compile its curve. Returns 0 if it is usable.
+static int finish_policy(const config_file_t* cf, fan_policy_t* p, int device_id) {
+  const char* problem = NULL;
+  if (p->setpoint_count == 0)
+    problem = "No setpoints, on the command line or in the config";
+  else if (p->min_interval_ms > p->max_interval_ms)
+    problem = "min-interval exceeds max-interval";
+  else if (p->controller == CONTROLLER_PID && !p->target_set)
+    problem = "controller pid requires a target";
+  else if (curve_compile(&p->curve, p->curve_type, p->setpoints, p->setpoint_count) != 0)
+    problem = "Setpoints do not compile into a curve";
+  if (!problem) return 0;
+  fprintf(stderr, "Error: %s: Device %d: %s\n", cf->path, device_id, problem);
+  return -1;
+}
+
+// Resolve every device to its layers (command line, [defaults], its group, its device section)
+// and compile one policy per distinct pair of group and device section
+static fanconf_t* compile(const config_file_t* cf, const fan_policy_t* defaults,
+                          const fanconf_device_t* devices, int count) {
+  fanconf_t* conf = calloc(1, sizeof(fanconf_t));
+  int(*layers)[2] = calloc(count, sizeof(*layers)); // Group and device section of each policy
+  if (conf) {
+    conf->policies = calloc(count, sizeof(fan_policy_t));
+    conf->device = calloc(count, sizeof(const fan_policy_t*));
+  }
+  if (!conf || !layers || !conf->policies || !conf->device) {
+    fprintf(stderr, "Error: Out of memory\n");
+    free(layers);
+    fanconf_free(conf);
+    return NULL;
+  }
+  conf->device_count = count;
+
+  const section_t* base = NULL;
+  for (int s = 0; s < cf->count; s++)
+    if (cf->sections[s].kind == SECTION_DEFAULTS) base = &cf->sections[s];
+
+  int errors = 0;
+  for (int i = 0; i < count; i++) {
+    const fanconf_device_t* d = &devices[i];
+    int group = -1, dev = -1, ambiguous = 0;
+    for (int s = 0; s < cf->count; s++) {
+      const section_t* sec = &cf->sections[s];
+      if (sec->kind == SECTION_DEFAULTS) continue;
+      int* layer = sec->kind == SECTION_GROUP ? &group : &dev;
+      if (!(sec->kind == SECTION_GROUP ? group_has(sec, d) : member_matches(sec->name, d)))
+        continue;
+      if (*layer >= 0) {
+        fprintf(stderr, "Error: %s: Device %d matches both [%s %s] and [%s %s]\n", cf->path, d->id,
+                section_kinds[sec->kind], cf->sections[*layer].name, section_kinds[sec->kind],
+                sec->name);
+        ambiguous = 1;
+      }
+      *layer = s;
+    }
+    if (ambiguous) {
+      errors++;
+      continue;
+    }
+
+    int p = 0;
+    while (p < conf->policy_count && (layers[p][0] != group || layers[p][1] != dev)) p++;
+    fan_policy_t* policy = &conf->policies[p];
+    if (p == conf->policy_count) {
+      *policy = *defaults;
+      if (base) apply_section(policy, base);
+      if (group >= 0) apply_section(policy, &cf->sections[group]);
+      if (dev >= 0) apply_section(policy, &cf->sections[dev]);
+      if (finish_policy(cf, policy, d->id) != 0) {
+        errors++;
+        continue;
+      }
+      layers[p][0] = group;
+      layers[p][1] = dev;
+      conf->policy_count++;
+    }
+    if (!(d->sensors & (1u << policy->sensor))) {
+      fprintf(stderr, "Error: %s: Device %d: Sensor '%s' cannot be read on this device\n",
+              cf->path, d->id, sensor_names[policy->sensor]);
+      errors++;
+      continue;
+    }
+    conf->device[i] = policy;
+  }
+
+  free(layers);
+  if (errors > 0) {
+    fanconf_free(conf);
+    return NULL;
+  }
+  return conf;
+}
+
+fanconf_t* fanconf_load(const char* path, const fan_policy_t* defaults,
+                        const fanconf_device_t* devices, int count) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "Error: Cannot open %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+  config_file_t cf = {path, NULL, 0};
+  int errors = parse_file(&cf, f);
+  fclose(f);
+
+  fanconf_t* conf = errors == 0 && count > 0 ? compile(&cf, defaults, devices, count) : NULL;
+  free_sections(&cf);
+  return conf;
+}
+
+void fanconf_free(fanconf_t* conf) {
+  if (!conf) return;
+  free(conf->policies);
+  free(conf->device);
+  free(conf);
+}
+
+// Reloads are compiled on the watcher thread and handed to the control loop through one
+// pointer, so the loop never waits on file I/O or parsing
+static struct {
+  int active;
+  int stopping;
+  int fd; // inotify on the directory, so that replacing the file by a rename is seen as well
+  char path[PATH_MAX];
+  const char* name; // File name within the directory, in path
+  fan_policy_t defaults;
+  fanconf_device_t* devices;
+  int count;
+  fanconf_t* pending;
+  pthread_t thread;
+} reload = {.fd = -1};
+
+static void* reload_main(void* arg) {
+  (void)arg;
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  while (!__atomic_load_n(&reload.stopping, __ATOMIC_ACQUIRE)) {
+    struct pollfd pfd = {reload.fd, POLLIN, 0};
+    if (poll(&pfd, 1, FANCONF_WAIT_MS) <= 0) continue;
+    ssize_t len = read(reload.fd, buf, sizeof(buf));
+
+    // An editor's save can take several events; they are read together and reload once
+    int changed = 0;
+    for (ssize_t off = 0; off < len;) {
+      const struct inotify_event* ev = (const struct inotify_event*)(buf + off);
+      if (ev->len && strcmp(ev->name, reload.name) == 0) changed = 1;
+      off += sizeof(struct inotify_event) + ev->len;
+    }
+    if (!changed) continue;
+
+    fanconf_t* conf = fanconf_load(reload.path, &reload.defaults, reload.devices, reload.count);
+    if (!conf) {
+      fprintf(stderr, "Error: %s rejected; the running configuration stays in effect\n",
+              reload.path);
+      continue;
+    }
+    // A config the loop has not taken yet is simply superseded
+    fanconf_free(__atomic_exchange_n(&reload.pending, conf, __ATOMIC_ACQ_REL));
+    fprintf(stderr, "Reloaded %s: %d device(s), %d distinct policies\n", reload.path,
+            conf->device_count, conf->policy_count);
+  }
+  return NULL;
+}
+
+int fanconf_watch_start(const char* path, const fan_policy_t* defaults,
+                        const fanconf_device_t* devices, int count) {
+  if (reload.active) return -1;
+  snprintf(reload.path, sizeof(reload.path), "%s", path);
+  const char* slash = strrchr(reload.path, '/');
+  reload.name = slash ? slash + 1 : reload.path;
+
+  char dir[PATH_MAX];
+  if (!slash)
+    snprintf(dir, sizeof(dir), ".");
+  else
+    snprintf(dir, sizeof(dir), "%.*s", slash == reload.path ? 1 : (int)(slash - reload.path),
+             reload.path);
+
+  reload.defaults = *defaults;
+  reload.count = count;
+  reload.devices = malloc(count * sizeof(fanconf_device_t));
+  if (!reload.devices) {
+    fprintf(stderr, "Error: Out of memory\n");
+    return -1;
+  }
+  memcpy(reload.devices, devices, count * sizeof(fanconf_device_t));
+
+  reload.fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  if (reload.fd < 0 || inotify_add_watch(reload.fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    fprintf(stderr, "Error: Cannot watch %s: %s\n", dir, strerror(errno));
+    fanconf_watch_stop();
+    return -1;
+  }
+
+  // Signals are for the control loop; keep them off this thread
+  reload.stopping = 0;
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  int err = pthread_create(&reload.thread, NULL, reload_main, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (err != 0) {
+    fprintf(stderr, "Error: Failed to start config watcher thread\n");
+    fanconf_watch_stop();
+    return -1;
+  }
+  reload.active = 1;
+  return 0;
+}
+
+void fanconf_watch_stop(void) {
+  if (reload.active) {
+    __atomic_store_n(&reload.stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(reload.thread, NULL);
+    reload.active = 0;
+  }
+  if (reload.fd >= 0) close(reload.fd);
+  reload.fd = -1;
+  free(reload.devices);
+  reload.devices = NULL;
+  fanconf_free(fanconf_take());
+}
+
+fanconf_t* fanconf_take(void) {
+  return __atomic_exchange_n(&reload.pending, NULL, __ATOMIC_ACQ_REL);
+}
@@ -0,0 +1,70 @@
+#ifndef NVML_TOOL_FANCONF_H
+#define NVML_TOOL_FANCONF_H
+
+#include "curve.h"
+#include "pid.h"
+
+// fanctl configuration file: per-device and per-group control policies layered over the ones
+// given on the command line, compiled into one policy per controlled device and reloaded from a
+// watcher thread whenever the file changes.
+
+#define MIN_INTERVAL_MS 100 // Shortest fanctl sampling interval
+#define FANCONF_UUID_LEN 80
+
+typedef enum { SENSOR_CORE, SENSOR_VRAM, SENSOR_HOTSPOT } sensor_t;
+
+typedef enum {
+  CONTROLLER_CURVE, // Fan speed straight from the setpoint curve
+  CONTROLLER_PID    // PID on a target temperature, bounded by the curve
+} controller_t;
+
+// How fanctl controls a device
+typedef struct {
+  sensor_t sensor;
+  setpoint_t setpoints[CURVE_MAX_SETPOINTS];
+  int setpoint_count;
+  curve_type_t curve_type;
+  fan_curve_t curve; // Compiled from setpoints
+  controller_t controller;
+  pid_params_t pid;
+  int target_set; // A target temperature was given: also report time above it
+  unsigned int min_interval_ms;
+  unsigned int max_interval_ms;
+  unsigned int deadband;
+  unsigned int hysteresis;
+} fan_policy_t;
+
+// A controlled device as the config file can name it: by index, or by (part of) its UUID
+typedef struct {
+  int id;
+  char uuid[FANCONF_UUID_LEN];
+  unsigned int sensors; // Bit (1 << sensor_t) for every sensor that can be read on the device
+} fanconf_device_t;
+
+typedef struct {
+  int policy_count;
+  fan_policy_t* policies;
+  int device_count;
+  const fan_policy_t** device; // Policy of each device, in the order they were given
+} fanconf_t;
+
+// Read path and compile a policy for each of devices[0..count-1], starting from defaults.
+// Returns NULL, with the reasons on stderr, if the file cannot be read or any section, key or
+// resulting policy is invalid.
+fanconf_t* fanconf_load(const char* path, const fan_policy_t* defaults,
+                        const fanconf_device_t* devices, int count);
+
+void fanconf_free(fanconf_t* conf);
+
+// Watch path with inotify and recompile it on a thread of its own each time it is written or
+// replaced. Configs that fail to load are reported and dropped. Returns 0 on success.
+int fanconf_watch_start(const char* path, const fan_policy_t* defaults,
+                        const fanconf_device_t* devices, int count);
+
+void fanconf_watch_stop(void);
+
+// Take the most recently reloaded config, NULL if there is none since the last call. Never
+// blocks; the caller owns the result.
+fanconf_t* fanconf_take(void);
+
+#endif
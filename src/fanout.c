@@ -0,0 +1,117 @@
+#define _GNU_SOURCE
+#include "fanout.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+
+typedef struct {
+  char* out;
+  size_t out_len;
+  char* err;
+  size_t err_len;
+  int result;
+  int done;
+} fanout_slot_t;
+
+// One fanout_run_joined() call, shared by the threads it starts; nothing outlives the call, so
+// calls may nest or run concurrently
+typedef struct {
+  fanout_fn_t fn;
+  void* ctx;
+  int count;
+  int next; // Next item to hand out, guarded by lock
+  fanout_slot_t* slots;
+  pthread_mutex_t lock;
+  pthread_cond_t done; // Signalled whenever a slot completes
+} fanout_call_t;
+
+static void run_item(fanout_call_t* call, int index) {
+  fanout_slot_t* slot = &call->slots[index];
+  FILE* out = open_memstream(&slot->out, &slot->out_len);
+  FILE* err = open_memstream(&slot->err, &slot->err_len);
+
+  // Without buffers the item still runs; only its position in the output is lost
+  slot->result = call->fn(index, out ? out : stdout, err ? err : stderr, call->ctx);
+  if (out) fclose(out);
+  if (err) fclose(err);
+}
+
+static void* worker_main(void* arg) {
+  fanout_call_t* call = arg;
+  for (;;) {
+    pthread_mutex_lock(&call->lock);
+    int index = call->next < call->count ? call->next++ : -1;
+    pthread_mutex_unlock(&call->lock);
+    if (index < 0) return NULL;
+
+    run_item(call, index);
+
+    pthread_mutex_lock(&call->lock);
+    call->slots[index].done = 1;
+    pthread_cond_signal(&call->done);
+    pthread_mutex_unlock(&call->lock);
+  }
+}
+
+int fanout_run(int count, int jobs, fanout_fn_t fn, void* ctx) {
+  return fanout_run_joined(count, jobs, fn, ctx, NULL, NULL);
+}
+
+int fanout_run_joined(int count, int jobs, fanout_fn_t fn, void* ctx, const char* separator,
+                      int* joined) {
+  if (jobs <= 0) jobs = FANOUT_AUTO_JOBS;
+  if (jobs > count) jobs = count;
+  if (jobs > FANOUT_MAX_JOBS) jobs = FANOUT_MAX_JOBS;
+
+  int errors = 0, printed = 0;
+  pthread_t threads[FANOUT_MAX_JOBS];
+  fanout_call_t call = {.fn = fn, .ctx = ctx, .count = count};
+  // Joining needs each item's output in hand before it is written, even with one job
+  call.slots = jobs > 1 || separator ? calloc(count, sizeof(fanout_slot_t)) : NULL;
+  if (!call.slots) {
+    for (int i = 0; i < count; i++) errors += fn(i, stdout, stderr, ctx);
+    if (joined) *joined = count; // Out of memory while joining: no way to know
+    return errors;
+  }
+  pthread_mutex_init(&call.lock, NULL);
+  pthread_cond_init(&call.done, NULL);
+
+  // Signal handlers belong to the calling thread; keep them off the threads started per call
+  int started = 0;
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  while (jobs > 1 && started < jobs &&
+         pthread_create(&threads[started], NULL, worker_main, &call) == 0)
+    started++;
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (started == 0) worker_main(&call); // No threads available: do the work here, then print
+
+  // Stream results in order: item i is printed once it and everything before it is done
+  fflush(stdout);
+  for (int i = 0; i < count; i++) {
+    pthread_mutex_lock(&call.lock);
+    while (!call.slots[i].done) pthread_cond_wait(&call.done, &call.lock);
+    pthread_mutex_unlock(&call.lock);
+
+    fanout_slot_t* slot = &call.slots[i];
+    if (slot->out_len) {
+      if (separator && printed) fputs(separator, stdout);
+      fwrite(slot->out, 1, slot->out_len, stdout);
+      printed++;
+    }
+    fflush(stdout);
+    if (slot->err_len) fwrite(slot->err, 1, slot->err_len, stderr);
+    free(slot->out);
+    free(slot->err);
+    errors += slot->result;
+  }
+
+  for (int t = 0; t < started; t++) pthread_join(threads[t], NULL);
+  pthread_cond_destroy(&call.done);
+  pthread_mutex_destroy(&call.lock);
+  free(call.slots);
+  if (joined) *joined = printed;
+  return errors;
+}
@@ -0,0 +1,25 @@
+#ifndef NVML_TOOL_FANOUT_H
+#define NVML_TOOL_FANOUT_H
+
+#include <stdio.h>
+
+#define FANOUT_AUTO_JOBS 16 // Upper bound for -j auto; NVML calls mostly wait on the driver
+#define FANOUT_MAX_JOBS 256
+
+// Work for one item. Everything it prints must go to out/err; returns its error count.
+typedef int (*fanout_fn_t)(int index, FILE* out, FILE* err, void* ctx);
+
+// Run fn for items 0..count-1 on up to jobs threads (0 for automatic), started for this call and
+// joined before it returns, with all signals blocked. Each item writes into its own buffers,
+// which are copied to stdout/stderr strictly in item order as soon as every earlier item has
+// finished. With one job, fn runs inline on stdout/stderr. Calls keep no shared state, so they
+// may nest or run concurrently. Returns the sum of the fn results.
+int fanout_run(int count, int jobs, fanout_fn_t fn, void* ctx);
+
+// fanout_run() for items that are elements of one list: separator is written between the
+// items that printed anything, so an item that fails with output on err only leaves no gap.
+// Items always run into buffers. joined, if not NULL, receives the number of items printed.
+int fanout_run_joined(int count, int jobs, fanout_fn_t fn, void* ctx, const char* separator,
+                      int* joined);
+
+#endif
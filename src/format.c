@@ -0,0 +1,62 @@
+#define _GNU_SOURCE
+#include "format.h"
+
+double convert_temperature(double temp_c, char unit) {
+  switch (unit) {
+  case 'C': return temp_c;
+  case 'F': return (temp_c * 9.0 / 5.0) + 32.0;
+  case 'K': return temp_c + 273.15;
+  default: return temp_c;
+  }
+}
+
+void print_device_info_human(FILE* out, const telemetry_t* t, int device_id, char temp_unit) {
+  fprintf(out, "=== Device %d", device_id);
+  if (t->valid & TM_NAME) fprintf(out, ": %s", t->name);
+  fprintf(out, " ===\n");
+
+  if (t->valid & TM_UUID) fprintf(out, "UUID:        %s\n", t->uuid);
+
+  if (t->valid & TM_TEMP) {
+    double temp = convert_temperature(t->temperature, temp_unit);
+    fprintf(out, "Temperature: %.1f%c\n", temp, temp_unit);
+  }
+
+  if (t->valid & TM_MEMORY) {
+    double used_pct = (double)t->memory.used / t->memory.total * 100.0;
+    fprintf(out, "Memory:      %llu MB / %llu MB (%.1f%%)\n", t->memory.used / (1024 * 1024),
+           t->memory.total / (1024 * 1024), used_pct);
+  }
+
+  if (t->valid & TM_FAN) fprintf(out, "Fan Speed:   %u%%\n", t->fan_speed);
+
+  if (t->valid & TM_POWER) {
+    double power_pct = (double)t->power_usage / t->power_limit * 100.0;
+    fprintf(out, "Power:       %.2fW / %.2fW (%.1f%%)\n", t->power_usage / 1000.0,
+           t->power_limit / 1000.0, power_pct);
+  }
+
+  fprintf(out, "\n");
+}
+
+void print_device_info_json(FILE* out, const telemetry_t* t, int device_id, char temp_unit) {
+  fprintf(out, "  {\n");
+  fprintf(out, "    \"device_id\": %d,\n", device_id);
+  fprintf(out, "    \"name\": \"%s\",\n", t->name);
+  fprintf(out, "    \"uuid\": \"%s\",\n", t->uuid);
+  fprintf(out, "    \"temperature\": %.1f,\n", convert_temperature(t->temperature, temp_unit));
+  fprintf(out, "    \"temperature_unit\": \"%c\",\n", temp_unit);
+  fprintf(out, "    \"memory_total_mb\": %llu,\n", t->memory.total / (1024 * 1024));
+  fprintf(out, "    \"memory_used_mb\": %llu,\n", t->memory.used / (1024 * 1024));
+  fprintf(out, "    \"memory_free_mb\": %llu,\n", t->memory.free / (1024 * 1024));
+  fprintf(out, "    \"fan_speed_percent\": %u,\n", t->fan_speed);
+  fprintf(out, "    \"power_usage_watts\": %.2f,\n", t->power_usage / 1000.0);
+  fprintf(out, "    \"power_limit_watts\": %.2f\n", t->power_limit / 1000.0);
+  fprintf(out, "  }");
+}
+
+void print_status_cli(FILE* out, const telemetry_t* t, int device_id, char temp_unit) {
+  double temp = convert_temperature(t->temperature, temp_unit);
+  fprintf(out, "%d:%.1f%c,%u%%,%.1fW\n", device_id, temp, temp_unit, t->fan_speed,
+          t->power_usage / 1000.0);
+}
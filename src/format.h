@@ -0,0 +1,24 @@
+#ifndef NVML_TOOL_FORMAT_H
+#define NVML_TOOL_FORMAT_H
+
+#include <stdio.h>
+
+#include "telemetry.h"
+
+// Text and JSON formatters for one device reading, shared by the direct, daemon and shm-read
+// paths of info and status
+
+// Convert a Celsius reading (or an aggregate of readings) to unit 'C', 'F' or 'K'
+double convert_temperature(double temp_c, char unit);
+
+// info: a block per device with the fields that were read
+void print_device_info_human(FILE* out, const telemetry_t* t, int device_id, char temp_unit);
+
+// info json: one object of the device array, without a separator or final newline; callers
+// write ",\n" before every object but the first they print
+void print_device_info_json(FILE* out, const telemetry_t* t, int device_id, char temp_unit);
+
+// status: "ID:TEMP,FAN%,POWERW"
+void print_status_cli(FILE* out, const telemetry_t* t, int device_id, char temp_unit);
+
+#endif
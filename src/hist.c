@@ -0,0 +1,56 @@
+#define _GNU_SOURCE
+#include "hist.h"
+
+// Last value that lands in bucket index
+static uint64_t bucket_upper(unsigned int index) {
+  unsigned int group = index >> HIST_SUB_BITS;
+  uint64_t sub = index & ((1u << HIST_SUB_BITS) - 1);
+  if (group == 0) return sub;
+  uint64_t width = 1ULL << (group - 1);
+  return (((1ULL << HIST_SUB_BITS) + sub) << (group - 1)) + width - 1;
+}
+
+void hist_merge(hist_t* dst, const hist_t* src) {
+  if (src->count == 0) return;
+  if (dst->count == 0 || src->min < dst->min) dst->min = src->min;
+  if (src->max > dst->max) dst->max = src->max;
+  dst->count += src->count;
+  dst->sum += src->sum;
+  for (unsigned int i = 0; i < HIST_BUCKETS; i++) dst->buckets[i] += src->buckets[i];
+}
+
+uint64_t hist_percentile(const hist_t* h, double p) {
+  if (h->count == 0) return 0;
+  uint64_t rank = (uint64_t)(p / 100.0 * h->count + 0.5);
+  if (rank < 1) rank = 1;
+  if (rank > h->count) rank = h->count;
+
+  uint64_t seen = 0;
+  for (unsigned int i = 0; i < HIST_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen >= rank) {
+      uint64_t upper = bucket_upper(i);
+      return upper < h->max && i < HIST_BUCKETS - 1 ? upper : h->max;
+    }
+  }
+  return h->max;
+}
+
+void hist_print_json(FILE* out, const hist_t* h) {
+  fprintf(out,
+          "{\"count\":%llu,\"min_ns\":%llu,\"mean_ns\":%llu,\"p50_ns\":%llu,\"p90_ns\":%llu,"
+          "\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu,\"buckets\":[",
+          (unsigned long long)h->count, (unsigned long long)h->min,
+          (unsigned long long)(h->count ? h->sum / h->count : 0),
+          (unsigned long long)hist_percentile(h, 50), (unsigned long long)hist_percentile(h, 90),
+          (unsigned long long)hist_percentile(h, 99), (unsigned long long)hist_percentile(h, 99.9),
+          (unsigned long long)h->max);
+  int first = 1;
+  for (unsigned int i = 0; i < HIST_BUCKETS; i++) {
+    if (!h->buckets[i]) continue;
+    fprintf(out, "%s[%llu,%u]", first ? "" : ",", (unsigned long long)bucket_upper(i),
+            h->buckets[i]);
+    first = 0;
+  }
+  fprintf(out, "]}");
+}
@@ -0,0 +1,50 @@
+#ifndef NVML_TOOL_HIST_H
+#define NVML_TOOL_HIST_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Log-linear latency histogram in fixed memory. Values below 2^HIST_SUB_BITS ns get a bucket
+// each; every power of two above that is split into 2^HIST_SUB_BITS equal buckets, so a recorded
+// value is known to within 1/2^HIST_SUB_BITS (12.5%) of itself. Values of 2^HIST_MAX_BITS ns
+// (about 69 s) and above share the last bucket; min, max and sum stay exact.
+#define HIST_SUB_BITS 3
+#define HIST_MAX_BITS 36
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+typedef struct {
+  uint64_t count;
+  uint64_t sum; // ns
+  uint64_t min;
+  uint64_t max;
+  uint32_t buckets[HIST_BUCKETS];
+} hist_t;
+
+static inline unsigned int hist_bucket(uint64_t ns) {
+  if (ns < (1u << HIST_SUB_BITS)) return (unsigned int)ns;
+  int msb = 63 - __builtin_clzll(ns);
+  if (msb >= HIST_MAX_BITS) return HIST_BUCKETS - 1;
+  return ((msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS) +
+         (unsigned int)((ns >> (msb - HIST_SUB_BITS)) & ((1u << HIST_SUB_BITS) - 1));
+}
+
+// A few shifts and increments, cheap enough for every NVML call of the control loop
+static inline void hist_record(hist_t* h, uint64_t ns) {
+  if (h->count == 0 || ns < h->min) h->min = ns;
+  if (ns > h->max) h->max = ns;
+  h->count++;
+  h->sum += ns;
+  h->buckets[hist_bucket(ns)]++;
+}
+
+// Add every value recorded in src to dst
+void hist_merge(hist_t* dst, const hist_t* src);
+
+// Upper bound of the bucket holding the p-th percentile (0-100), at most the maximum; 0 if empty
+uint64_t hist_percentile(const hist_t* h, double p);
+
+// One JSON object: count, min, mean, p50, p90, p99, p99.9 and max in ns, then the non-empty
+// buckets as [upper bound ns, count] pairs
+void hist_print_json(FILE* out, const hist_t* h);
+
+#endif
@@ -4,25 +4,77 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
 #include <nvml.h>
 #include <pci/pci.h> // Added for PCI access
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h> // Added for memory mapping
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
-#define MAX_DEVICES 64
+#include "apply.h"
+#include "args.h"
+#include "backend.h"
+#include "curve.h"
+#include "daemon.h"
+#include "events.h"
+#include "export.h"
+#include "fanconf.h"
+#include "fanout.h"
+#include "format.h"
+#include "hist.h"
+#include "pacer.h"
+#include "pid.h"
+#include "powerctl.h"
+#include "profile.h"
+#include "regs.h"
+#include "render.h"
+#include "rollup.h"
+#include "shm.h"
+#include "telemetry.h"
+#include "timeutil.h"
+#include "tlog.h"
+#include "topology.h"
+#include "watch.h"
+
+#define MAX_DEVICES 1024
 #define MAX_NAME_LEN 256
 #define MAX_UUID_LEN 80
-#define MAX_SETPOINTS 16
+#define MAX_FANS 16
+
+// fanctl control period
+#define DEFAULT_INTERVAL_MS 2000
+
+// fanctl adaptive sampling: unless -i fixes the period, each device is polled between the min
+// and max interval, aiming for one sample per ADAPT_STEP_C of temperature change, and at the
+// minimum while within ADAPT_NEAR_SETPOINT_C of a setpoint. Intervals shorten immediately and
+// lengthen by at most ADAPT_BACKOFF per sample.
+#define DEFAULT_MIN_INTERVAL_MS 250
+#define DEFAULT_MAX_INTERVAL_MS 5000
+#define ADAPT_STEP_C 1.0
+#define ADAPT_NEAR_SETPOINT_C 2.0
+#define ADAPT_BACKOFF 1.5
+
+// fanctl write elision: fan speeds within the deadband of the last commanded value are not
+// re-sent, and falling temperatures must drop by the hysteresis before the curve follows
+#define DEFAULT_DEADBAND_PCT 1
+#define DEFAULT_HYSTERESIS_C 2
+
+#define THERMAL_THROTTLE_REASONS \
+  (nvmlClocksThrottleReasonSwThermalSlowdown | nvmlClocksThrottleReasonHwThermalSlowdown)
+#define THERMAL_HOLD_FAN_PCT 100 // Fan speed from a thermal slowdown event until it clears
+
+// fanctl --dashboard table width in columns
+#define DASHBOARD_WIDTH 64
 
 // VRAM Temperature Constants
-#define MEM_PATH "/dev/mem"
-#define VRAM_REGISTER_OFFSET 0x0000E2A8
-#define PG_SZ sysconf(_SC_PAGE_SIZE)
+#define MEM_PATH "/dev/mem" // Default, override with --mem-path
 
 typedef enum {
   CMD_NONE,
@@ -33,17 +85,24 @@ typedef enum {
   CMD_STATUS,
   CMD_LIST,
   CMD_FANCTL,
-  CMD_VRAMTEMP  // Add new command here
+  CMD_VRAMTEMP,
+  CMD_PROFILE,
+  CMD_WATCH,
+  CMD_EXPORT,
+  CMD_PUBLISH,
+  CMD_SHM_READ,
+  CMD_DAEMON,
+  CMD_POWERCTL,
+  CMD_RECORD,
+  CMD_REPLAY,
+  CMD_QUERY // Add new command here
 } command_t;
 
-typedef enum { SUBCMD_NONE, SUBCMD_SET, SUBCMD_RESTORE, SUBCMD_JSON } subcommand_t;
-
-typedef enum { SENSOR_CORE, SENSOR_VRAM } sensor_t; // Added for sensor selection
+typedef enum { SUBCMD_NONE, SUBCMD_SET, SUBCMD_RESTORE, SUBCMD_JSON, SUBCMD_CSV } subcommand_t;
 
-typedef struct {
-  unsigned int temp;
-  unsigned int fan;
-} setpoint_t;
+// Per-device register sensors (VRAM, hotspot). The register layout, the BAR and its mapping are
+// resolved once and kept for the lifetime of the process, so a read is a single volatile load.
+typedef gpu_regs_t vram_sensor_t;
 
 typedef struct {
   int devices[MAX_DEVICES];
@@ -55,23 +114,115 @@ typedef struct {
   subcommand_t subcommand;
   unsigned int set_value;
   char temp_unit;
-  setpoint_t setpoints[MAX_SETPOINTS];
-  int setpoint_count;
-  sensor_t sensor; // Added sensor preference
+  // fanctl/replay sensor, curve (compiled once arguments are parsed), controller and sampling.
+  // A --target also reports time above it and throttle events.
+  fan_policy_t policy;
+  const char* config_path; // fanctl per-device policies, reloaded when the file changes
+  int dashboard;           // fanctl shows a table of all readings instead of status lines on a TTY
+  unsigned int budget_w;    // powerctl node budget
+  unsigned int max_step_w;  // powerctl raise limit per interval
+  const char* log_path;     // Telemetry log for record/replay/query
+  double from_s;            // query window as Unix times, 0 for the log's start and end
+  double to_s;
+  unsigned int last_s;      // query the last N seconds of the log instead
+  const char* mem_path;
+  reg_access_t reg_access; // How VRAM and hotspot registers are reached
+  const char* sysfs_root;
+  unsigned int interval_ms;
+  int interval_set; // -i given: fanctl polls at a fixed period
+  int count; // Iterations for profile, frames for watch (0: command default)
+  unsigned int duration_s;
+  unsigned int fields; // TM_* mask for watch
+  const char* listen;  // Exporter address, NULL unless export or --listen
+  const char* shm_name; // Shared-memory segment, NULL unless publish/shm-read or --shm
+  const char* socket_path; // Daemon socket from --socket, NULL for the default
+  int direct;              // Skip the daemon and always query NVML
+  int jobs;                // Worker threads for per-device queries, 0 for automatic
 } cli_args_t;
 
+// Per-device fanctl state. Each device keeps its own deadline on CLOCK_MONOTONIC and is updated
+// by its own thread; while an update runs, the state belongs to that thread.
+typedef struct {
+  nvmlDevice_t device;
+  int id;
+  const fan_policy_t* policy; // From the command line, or the device's entry in the config
+  vram_sensor_t* sensor;
+  unsigned int interval_ms; // Current period; varies unless min and max interval are equal
+  struct timespec deadline;
+  struct timespec started; // When the last update began
+  int dropped;             // Lost; kept in place until the loop ends, as threads index controlled[]
+  unsigned int last_temp;
+  uint64_t last_sample_ns;
+  uint64_t first_sample_ns;
+  double slope; // Smoothed |dT/dt| in C/s
+  unsigned long samples;
+  unsigned int num_fans;     // Queried once at registration
+  int commanded[MAX_FANS];   // Last speed written per fan, -1 if none yet
+  unsigned int control_temp; // Temperature the curve is currently evaluated at
+  int have_control_temp;
+  unsigned int target_fan;
+  unsigned long writes;
+  unsigned long writes_elided;
+  pid_state_t pid;
+  unsigned int power_mw; // Last power reading, for feed-forward
+  uint64_t above_target_ns;
+  unsigned long long throttle_reasons; // Last nvmlClocksThrottleReason* bits
+  unsigned long throttle_events;       // Transitions into thermal slowdown
+  int thermal_hold;                    // Fans at THERMAL_HOLD_FAN_PCT after a slowdown event
+  int slot; // Index among the devices fanctl started with (exporter list, config devices)
+  char line[64]; // Last status line, redrawn in terminal mode
+  unsigned int dash_valid; // TM_* bits read for the dashboard
+  unsigned int core_temp;
+  unsigned int fan_speed; // Reported by the device, not commanded
+  unsigned int power_limit_mw;
+  unsigned int vram_temp;
+  int have_vram_temp;
+} controlled_device_t;
+
+// fanctl self-instrumentation, per device slot so the numbers of a dropped device are kept
+typedef struct {
+  int id;
+  hist_t jitter_ns; // How late each update started after the device's deadline
+  unsigned long deadline_misses; // Whole periods skipped because an update started too late
+  pthread_mutex_t lock; // The rest is recorded by the device's thread during an update
+  hist_t sensor_ns;     // Control temperature read, including any fallback to the core sensor
+  hist_t fan_set_ns;    // One fan speed write
+  unsigned long sensor_fallbacks; // VRAM or hotspot reads that fell back to the core sensor
+} fanctl_device_stats_t;
+
+typedef struct {
+  uint64_t start_ns;
+  unsigned long passes; // Loop passes that updated at least one device
+  hist_t output_ns;     // Writing and flushing the status lines or frame of a pass
+  int device_count;
+  fanctl_device_stats_t device[MAX_DEVICES];
+} fanctl_stats_t;
+
 // Global variables for signal handling and PCI context
 static volatile int running = 1;
-static nvmlDevice_t controlled_devices[MAX_DEVICES];
-static int controlled_device_ids[MAX_DEVICES];
+static volatile sig_atomic_t stats_requested = 0; // SIGUSR1 during fanctl
+static fanctl_stats_t fanctl_stats;
+static controlled_device_t controlled[MAX_DEVICES];
+static controlled_device_t shown[MAX_DEVICES]; // As of each device's last collected update
 static int controlled_device_count = 0;
+static fanconf_t* fan_config; // fanctl --config, NULL while the command-line policy applies
 static int is_terminal = 0;
+static render_t screen; // fanctl display region when is_terminal
 
 // PCI context for VRAM access
 static struct pci_access *pacc = NULL;
 static int pci_initialized = 0;
 
+static vram_sensor_t vram_sensors[MAX_DEVICES];
+static int vram_sensor_count = 0;
+
+static void close_vram_sensors(void) {
+  for (int i = 0; i < vram_sensor_count; i++) regs_close(&vram_sensors[i]);
+  vram_sensor_count = 0;
+}
+
 static void cleanup_pci(void) {
+  close_vram_sensors();
   if (pacc) {
     pci_cleanup(pacc);
     pacc = NULL;
@@ -96,7 +247,7 @@ static int init_pci(void) {
 // Helper to find pci_dev matching NVML device
 static struct pci_dev* find_pci_dev(nvmlDevice_t device) {
   nvmlPciInfo_t pci_info;
-  if (nvmlDeviceGetPciInfo(device, &pci_info) != NVML_SUCCESS) return NULL;
+  if (gpu->get_pci_info(device, &pci_info) != NVML_SUCCESS) return NULL;
 
   for (struct pci_dev *dev = pacc->devices; dev; dev = dev->next) {
     pci_fill_info(dev, PCI_FILL_IDENT | PCI_FILL_BASES);
@@ -113,39 +264,69 @@ static struct pci_dev* find_pci_dev(nvmlDevice_t device) {
   return NULL;
 }
 
-static int read_vram_temp(nvmlDevice_t device, unsigned int *temp) {
-  struct pci_dev *dev = find_pci_dev(device);
-  if (!dev) {
-    return -1; // Device not found in PCI list
+// Map the VRAM and hotspot registers of a device, laid out as the register table says for its
+// PCI device ID. With --reg-access sysfs the BAR is mapped from its sysfs resource0 file, found
+// from the PCI address NVML reports. Otherwise BAR0 comes from the cached topology entry or a PCI
+// bus scan and is mapped from mem_path (normally /dev/mem; any file laid out like physical memory
+// works). Returns NULL on failure.
+static vram_sensor_t* open_vram_sensor(nvmlDevice_t device, const topology_device_t* topo,
+                                       const cli_args_t* args) {
+  if (vram_sensor_count >= MAX_DEVICES) return NULL;
+
+  nvmlPciInfo_t pci;
+  memset(&pci, 0, sizeof(pci));
+  if (topo && (topo->valid & TOPO_PCI)) {
+    pci.domain = topo->pci_domain;
+    pci.bus = topo->pci_bus;
+    pci.device = topo->pci_device;
+    pci.pciDeviceId = topo->pci_device_id;
+    snprintf(pci.busId, sizeof(pci.busId), "%s", topo->bus_id);
+  } else if (gpu->get_pci_info(device, &pci) != NVML_SUCCESS) {
+    return NULL;
   }
-
-  int fd = open(MEM_PATH, O_RDWR | O_SYNC);
-  if (fd < 0) {
-    fprintf(stderr, "Error: Failed to open %s (root required): %s\n", MEM_PATH, strerror(errno));
-    return -1;
+  const reg_layout_t* layout = regs_layout(pci.pciDeviceId >> 16);
+  vram_sensor_t* sensor = &vram_sensors[vram_sensor_count];
+
+  if (args->reg_access == REG_ACCESS_SYSFS) {
+    // nvmlPciInfo_t has no function number; it is the last digit of the bus ID
+    const char* dot = strrchr(pci.busId, '.');
+    unsigned int function = dot ? (unsigned int)strtoul(dot + 1, NULL, 16) : 0;
+    char address[32];
+    snprintf(address, sizeof(address), "%04x:%02x:%02x.%x", pci.domain, pci.bus, pci.device,
+             function);
+    if (regs_open_sysfs(sensor, layout, address, args->sysfs_root) != 0) return NULL;
+    vram_sensor_count++;
+    return sensor;
   }
 
-  // Calculate register address
-  // dev->base_addr[0] is the BAR0 base address
-  uint32_t reg_addr = (dev->base_addr[0] & 0xFFFFFFFF) + VRAM_REGISTER_OFFSET;
-  uint32_t base_offset = reg_addr & ~(PG_SZ - 1);
-  void *map_base = mmap(0, PG_SZ, PROT_READ, MAP_SHARED, fd, base_offset);
-  
-  if (map_base == MAP_FAILED) {
-    fprintf(stderr, "Error: Failed to map memory: %s\n", strerror(errno));
-    close(fd);
-    return -1;
+  uint64_t bar0;
+  if (topo && (topo->valid & TOPO_BAR0)) {
+    bar0 = topo->bar0;
+  } else {
+    if (init_pci() != 0) return NULL;
+    struct pci_dev *dev = find_pci_dev(device);
+    if (!dev) {
+      return NULL; // Device not found in PCI list
+    }
+    bar0 = dev->base_addr[0];
   }
 
-  uint32_t reg_value = *((uint32_t *)((char *)map_base + (reg_addr - base_offset)));
-  
-  // VRAM temp calculation: bits 0-11, divided by 32
-  *temp = (reg_value & 0x00000fff) / 0x20;
+  if (regs_open_mem(sensor, layout, bar0, args->mem_path) != 0) return NULL;
+  vram_sensor_count++;
+  return sensor;
+}
+
+static int read_vram_temp(const vram_sensor_t *sensor, unsigned int *temp) {
+  return regs_read(sensor, REG_VRAM, temp);
+}
 
-  munmap(map_base, PG_SZ);
-  close(fd);
+// Temperature of the sensor fan control follows, for the register-backed sensors
+static int read_sensor_temp(const vram_sensor_t* sensor, sensor_t which, unsigned int* temp) {
+  return regs_read(sensor, which == SENSOR_HOTSPOT ? REG_HOTSPOT : REG_VRAM, temp);
+}
 
-  return (*temp < 0x7f) ? 0 : -1; // Sanity check from gputemps
+static const char* sensor_name(sensor_t sensor) {
+  return sensor == SENSOR_VRAM ? "VRAM" : sensor == SENSOR_HOTSPOT ? "Hotspot" : "Core";
 }
 
 static void signal_handler(int signum) {
@@ -154,84 +335,31 @@ static void signal_handler(int signum) {
   printf("\nRestoring automatic fan control...\n");
 
   for (int i = 0; i < controlled_device_count; i++) {
-    unsigned int num_fans = 0;
-    if (nvmlDeviceGetNumFans(controlled_devices[i], &num_fans) == NVML_SUCCESS) {
-      for (unsigned int fan = 0; fan < num_fans; fan++) {
-        nvmlDeviceSetFanControlPolicy(controlled_devices[i], fan,
-                                      NVML_FAN_POLICY_TEMPERATURE_CONTINOUS_SW);
-      }
+    if (controlled[i].dropped) continue;
+    for (unsigned int fan = 0; fan < controlled[i].num_fans; fan++) {
+      gpu->set_fan_control_policy(controlled[i].device, fan,
+                                    NVML_FAN_POLICY_TEMPERATURE_CONTINOUS_SW);
     }
   }
 }
 
-static int parse_setpoints(int argc, char* argv[], int start_idx, setpoint_t* setpoints,
-                           int max_setpoints) {
-  int count = 0;
-
-  for (int i = start_idx; i < argc && count < max_setpoints; i++) {
-    if (argv[i][0] == '-') break;
-
-    char* colon = strchr(argv[i], ':');
-    if (!colon) continue;
-
-    *colon = '\0';
-    unsigned int temp = atoi(argv[i]);
-    unsigned int fan = atoi(colon + 1);
-    *colon = ':';
-
-    if (temp == 0 || fan > 100) {
-      fprintf(stderr, "Error: Invalid setpoint '%s' (temp must be >0, fan 0-100%%)\n", argv[i]);
-      return -1;
-    }
-
-    setpoints[count].temp = temp;
-    setpoints[count].fan = fan;
-    count++;
-  }
-
-  if (count == 0) {
-    fprintf(stderr, "Error: No valid setpoints provided\n");
-    return -1;
-  }
-
-  // Sort setpoints by temperature
-  for (int i = 0; i < count - 1; i++) {
-    for (int j = i + 1; j < count; j++) {
-      if (setpoints[i].temp > setpoints[j].temp) {
-        setpoint_t temp_sp = setpoints[i];
-        setpoints[i] = setpoints[j];
-        setpoints[j] = temp_sp;
-      }
-    }
-  }
-
-  return count;
+static void power_signal_handler(int signum) {
+  (void)signum;
+  running = 0;
+  printf("\nRestoring power limits...\n");
+  powerctl_restore();
 }
 
-static unsigned int interpolate_fan_speed(unsigned int current_temp, const setpoint_t* setpoints,
-                                          int count) {
-  if (count == 0) return 0;
-
-  if (current_temp <= setpoints[0].temp) return setpoints[0].fan;
-  if (current_temp >= setpoints[count - 1].temp) return setpoints[count - 1].fan;
-
-  for (int i = 0; i < count - 1; i++) {
-    if (current_temp >= setpoints[i].temp && current_temp <= setpoints[i + 1].temp) {
-      unsigned int temp_range = setpoints[i + 1].temp - setpoints[i].temp;
-      unsigned int fan_range = setpoints[i + 1].fan - setpoints[i].fan;
-      unsigned int temp_offset = current_temp - setpoints[i].temp;
-
-      return setpoints[i].fan + (fan_range * temp_offset) / temp_range;
-    }
-  }
-
-  return setpoints[0].fan;
+// Stop long-running commands that have no device state to restore
+static void stop_handler(int signum) {
+  (void)signum;
+  running = 0;
 }
 
-static void clear_lines(int count) {
-  if (is_terminal && count > 0) {
-    for (int i = 0; i < count; i++) printf("\033[1A\033[2K");
-  }
+// The loop prints the statistics itself, outside the handler
+static void stats_handler(int signum) {
+  (void)signum;
+  stats_requested = 1;
 }
 
 static void print_usage(const char* name) {
@@ -241,18 +369,96 @@ static void print_usage(const char* name) {
   printf("  power [set VALUE]   Show/set power usage and limits\n");
   printf("  fan [set VALUE]     Show/set fan speed (NVML v12+)\n");
   printf("  fan restore         Restore automatic fan control\n");
-  printf("  fanctl SETPOINTS    Dynamic fan control with temperature setpoints\n");
+  printf("  fanctl [SETPOINTS]  Dynamic fan control with temperature setpoints (or --config)\n");
   printf("  temp                Show GPU core temperature\n");
-  printf("  vramtemp            Show VRAM temperature (requires root)\n"); // Add this
+  printf("  vramtemp            Show VRAM (or with -s hotspot, hotspot) temperature\n"); // Add this
   printf("  status              Show compact status overview\n");
   printf("  list                List all GPUs with index, UUID, and name\n");
+  printf("  profile [json]      Measure per-call NVML latency for each device\n");
+  printf("  watch [csv]         Stream samples as NDJSON (default) or CSV\n");
+  printf("  export              Serve Prometheus metrics over HTTP\n");
+  printf("  publish             Publish samples to a shared-memory segment\n");
+  printf("  shm-read [json]     Read the shared-memory segment (no NVML init)\n");
+  printf("  daemon              Keep NVML open and answer info/status/temp/list over a socket\n");
+  printf("  powerctl BUDGET     Share a node power budget in watts across GPUs by demand\n");
+  printf("  record FILE         Record samples to a compact binary telemetry log\n");
+  printf("  replay FILE SETPOINTS\n");
+  printf("                      Run a recorded log through fanctl offline (no NVML)\n");
+  printf("  query FILE          Min/max/mean/p95 per device over a window of a log, as JSON\n");
   printf("\nDevice Selection:\n");
   printf("  -d, --device LIST   Select devices (default: all)\n");
   printf("  -u, --uuid UUID     Select device by UUID\n");
+  printf("  -j, --jobs N|auto   Query devices in parallel for info/power/fan/temp/status/list\n");
+  printf("                      (default: auto, up to %d; output stays in device order)\n",
+         FANOUT_AUTO_JOBS);
   printf("\nFan Control Options:\n");
   printf("  -s, --sensor TYPE   Sensor for fan control (default: core)\n");
   printf("                      core - Use GPU Core temperature\n");
   printf("                      vram - Use GDDR6 VRAM temperature (requires root)\n");
+  printf("                      hotspot - Use the GPU hotspot temperature (requires root)\n");
+  printf("  -i, --interval MS   Fixed control period per device (min: %d)\n", MIN_INTERVAL_MS);
+  printf("  --min-interval MS   Without -i, each device adapts its period to the temperature\n");
+  printf("  --max-interval MS   slope within these bounds (default: %d-%d)\n",
+         DEFAULT_MIN_INTERVAL_MS, DEFAULT_MAX_INTERVAL_MS);
+  printf("  --deadband PCT      Skip fan writes within PCT of the last value (default: %d)\n",
+         DEFAULT_DEADBAND_PCT);
+  printf("  --hysteresis DEG    Degrees C a falling temperature must drop before the fan slows\n");
+  printf("                      (default: %d)\n", DEFAULT_HYSTERESIS_C);
+  printf("  --mem-path PATH     Physical memory source for VRAM reads (default: %s)\n", MEM_PATH);
+  printf("  --reg-access TYPE   How VRAM/hotspot registers are mapped (default: mem)\n");
+  printf("                      mem - BAR0 from a PCI bus scan, mapped from --mem-path\n");
+  printf("                      sysfs - the BAR's sysfs resource0 file, at the PCI address\n");
+  printf("                      NVML reports\n");
+  printf("  --sysfs-root PATH   sysfs mount point for --reg-access sysfs (default: %s)\n",
+         REGS_SYSFS_ROOT);
+  printf("  --curve TYPE        Curve between setpoints: linear, cubic, step (default: linear)\n");
+  printf("  --controller TYPE   curve - Fan speed from the curve (default)\n");
+  printf("                      pid - PID on --target, never below the curve\n");
+  printf("  --target DEG        PID target; with either controller, report time above it\n");
+  printf("                      and thermal throttle events on exit\n");
+  printf("  --pid KP,KI,KD      PID gains (default: %g,%g,%g)\n", PID_DEFAULT_KP, PID_DEFAULT_KI,
+         PID_DEFAULT_KD);
+  printf("  --feed-forward K    Add K %% fan per watt of power draw (default: 0, off)\n");
+  printf("  --slew PCT          Limit PID output changes to PCT %%/s, 0 for none (default: %g)\n",
+         PID_DEFAULT_SLEW);
+  printf("  --dashboard         On a terminal, show temperature, VRAM temperature, fan, power\n");
+  printf("                      and limit for every device in a table\n");
+  printf("  --config FILE       Per-device and per-group sensors, curves and intervals over\n");
+  printf("                      these options; reloaded without a gap when the file changes\n");
+  printf("  SIGUSR1             Print loop timing histograms and counters as JSON on stderr\n");
+  printf("\nPower Budget Options:\n");
+  printf("  -i, --interval MS   Rebalancing period (default: %d)\n", DEFAULT_INTERVAL_MS);
+  printf("  --max-step W        Largest raise of one limit per interval, 0 for no limit\n");
+  printf("                      (default: %d)\n", POWERCTL_DEFAULT_MAX_STEP_W);
+  printf("\nRecord/Replay/Query Options:\n");
+  printf("  -i, --interval MS   Record sample period (default: %d)\n", DEFAULT_INTERVAL_MS);
+  printf("  -n, --count N       Stop record after N frames\n");
+  printf("  --duration SEC      Stop record after SEC seconds\n");
+  printf("  -s, --sensor vram   Also record VRAM temperatures (requires root)\n");
+  printf("                      replay takes the fanctl options; -s picks the column it uses\n");
+  printf("  --from TIME         Start of the query window, as Unix seconds or\n");
+  printf("                      YYYY-MM-DD HH:MM[:SS] (default: start of the log)\n");
+  printf("  --to TIME           End of the query window (default: end of the log)\n");
+  printf("  --last DUR          Query the last DUR (N[s|m|h|d]) of the log\n");
+  printf("\nProfile/Watch Options:\n");
+  printf("  -n, --count N       Calls per query for profile (default: %d),\n",
+         DEFAULT_PROFILE_ITERATIONS);
+  printf("                      frames for watch (default: unlimited)\n");
+  printf("  -i, --interval MS   Watch sample period (default: %d)\n", DEFAULT_INTERVAL_MS);
+  printf("  --duration SEC      Stop watch after SEC seconds\n");
+  printf("  -f, --fields LIST   Watch fields: name,uuid,temp,fan,power,power_limit,memory\n");
+  printf("                      (default: temp,fan,power)\n");
+  printf("\nExporter Options:\n");
+  printf("  -l, --listen ADDR   HTTP address for export, or with fanctl to also serve\n");
+  printf("                      controller state (default: %s)\n", DEFAULT_EXPORT_LISTEN);
+  printf("  -i, --interval MS   Snapshot refresh period (default: %d)\n", DEFAULT_INTERVAL_MS);
+  printf("\nShared Memory Options:\n");
+  printf("  --shm NAME          Segment for publish/shm-read, or with fanctl/export to also\n");
+  printf("                      publish (default: %s)\n", NVML_TOOL_SHM_DEFAULT_NAME);
+  printf("\nDaemon Options:\n");
+  printf("  --socket PATH       Daemon socket (default: $%s or %s)\n", DAEMON_SOCKET_ENV,
+         DEFAULT_DAEMON_SOCKET);
+  printf("  --direct            Query NVML directly even if a daemon is running\n");
   printf("\nOutput Options:\n");
   printf("  --temp-unit UNIT    Temperature unit: C, F, K (default: C)\n");
   printf("  -h, --help          Show this help\n");
@@ -261,603 +467,2011 @@ static void print_usage(const char* name) {
   printf("  %s fanctl 70:30 85:60 -d 0 -s vram  # VRAM temp control\n", name);
 }
 
-static double convert_temperature(unsigned int temp_c, char unit) {
-  switch (unit) {
-  case 'C': return temp_c;
-  case 'F': return (temp_c * 9.0 / 5.0) + 32.0;
-  case 'K': return temp_c + 273.15;
-  default: return temp_c;
-  }
-}
-
-static int parse_device_range(const char* range_str, int* devices, int max_devices) {
-  char* str = strdup(range_str);
-  char* token = strtok(str, ",");
-  int count = 0;
-
-  while (token && count < max_devices) {
-    char* dash = strchr(token, '-');
-    if (dash) {
-      *dash = '\0';
-      int start = atoi(token);
-      int end = atoi(dash + 1);
-      for (int i = start; i <= end && count < max_devices; i++) devices[count++] = i;
-    } else {
-      devices[count++] = atoi(token);
-    }
-    token = strtok(NULL, ",");
+static int find_device_by_uuid(const char* uuid, unsigned int device_count) {
+  const topology_device_t* topo = topology_get(device_count);
+  if (topo) {
+    for (unsigned int i = 0; i < device_count; i++)
+      if ((topo[i].valid & TOPO_UUID) && strstr(topo[i].uuid, uuid) != NULL) return i;
+    return -1;
   }
 
-  free(str);
-  return count;
-}
-
-static int find_device_by_uuid(const char* uuid, unsigned int device_count) {
   for (unsigned int i = 0; i < device_count; i++) {
     nvmlDevice_t device;
     char device_uuid[MAX_UUID_LEN];
 
-    if (nvmlDeviceGetHandleByIndex(i, &device) == NVML_SUCCESS &&
-        nvmlDeviceGetUUID(device, device_uuid, sizeof(device_uuid)) == NVML_SUCCESS) {
+    if (gpu->get_handle_by_index(i, &device) == NVML_SUCCESS &&
+        gpu->get_uuid(device, device_uuid, sizeof(device_uuid)) == NVML_SUCCESS) {
       if (strstr(device_uuid, uuid) != NULL) return i;
     }
   }
   return -1;
 }
 
-static void print_device_info_human(nvmlDevice_t device, int device_id, char temp_unit) {
-  nvmlReturn_t result;
-  char name[MAX_NAME_LEN];
-  char uuid[MAX_UUID_LEN];
-  unsigned int temperature;
-  nvmlMemory_t memory;
-  unsigned int fan_speed;
-  unsigned int power_usage, power_limit;
-
-  printf("=== Device %d", device_id);
-
-  result = nvmlDeviceGetName(device, name, sizeof(name));
-  if (result == NVML_SUCCESS) printf(": %s", name);
-  printf(" ===\n");
-
-  result = nvmlDeviceGetUUID(device, uuid, sizeof(uuid));
-  if (result == NVML_SUCCESS) printf("UUID:        %s\n", uuid);
-
-  result = nvmlDeviceGetTemperature(device, NVML_TEMPERATURE_GPU, &temperature);
-  if (result == NVML_SUCCESS) {
-    double temp = convert_temperature(temperature, temp_unit);
-    printf("Temperature: %.1f%c\n", temp, temp_unit);
-  }
-
-  result = nvmlDeviceGetMemoryInfo(device, &memory);
-  if (result == NVML_SUCCESS) {
-    double used_pct = (double)memory.used / memory.total * 100.0;
-    printf("Memory:      %llu MB / %llu MB (%.1f%%)\n", memory.used / (1024 * 1024),
-           memory.total / (1024 * 1024), used_pct);
-  }
-
-  result = nvmlDeviceGetFanSpeed(device, &fan_speed);
-  if (result == NVML_SUCCESS) printf("Fan Speed:   %u%%\n", fan_speed);
-
-  result = nvmlDeviceGetPowerUsage(device, &power_usage);
-  if (result == NVML_SUCCESS) {
-    nvmlDeviceGetPowerManagementLimit(device, &power_limit);
-    double power_pct = (double)power_usage / power_limit * 100.0;
-    printf("Power:       %.2fW / %.2fW (%.1f%%)\n", power_usage / 1000.0, power_limit / 1000.0,
-           power_pct);
-  }
-
-  printf("\n");
-}
-
-static void print_device_info_json(nvmlDevice_t device, int device_id, char temp_unit,
-                                   int is_last) {
-  char name[MAX_NAME_LEN] = "Unknown";
-  char uuid[MAX_UUID_LEN] = "Unknown";
-  unsigned int temperature = 0;
-  nvmlMemory_t memory = {0};
-  unsigned int fan_speed = 0;
-  unsigned int power_usage = 0, power_limit = 0;
-
-  nvmlDeviceGetName(device, name, sizeof(name));
-  nvmlDeviceGetUUID(device, uuid, sizeof(uuid));
-  nvmlDeviceGetTemperature(device, NVML_TEMPERATURE_GPU, &temperature);
-  nvmlDeviceGetMemoryInfo(device, &memory);
-  nvmlDeviceGetFanSpeed(device, &fan_speed);
-  nvmlDeviceGetPowerUsage(device, &power_usage);
-  nvmlDeviceGetPowerManagementLimit(device, &power_limit);
-
-  printf("  {\n");
-  printf("    \"device_id\": %d,\n", device_id);
-  printf("    \"name\": \"%s\",\n", name);
-  printf("    \"uuid\": \"%s\",\n", uuid);
-  printf("    \"temperature\": %.1f,\n", convert_temperature(temperature, temp_unit));
-  printf("    \"temperature_unit\": \"%c\",\n", temp_unit);
-  printf("    \"memory_total_mb\": %llu,\n", memory.total / (1024 * 1024));
-  printf("    \"memory_used_mb\": %llu,\n", memory.used / (1024 * 1024));
-  printf("    \"memory_free_mb\": %llu,\n", memory.free / (1024 * 1024));
-  printf("    \"fan_speed_percent\": %u,\n", fan_speed);
-  printf("    \"power_usage_watts\": %.2f,\n", power_usage / 1000.0);
-  printf("    \"power_limit_watts\": %.2f\n", power_limit / 1000.0);
-  printf("  }%s\n", is_last ? "" : ",");
-}
-
-static void print_power_cli(nvmlDevice_t device, int device_id) {
+static void print_power_cli(FILE* out, FILE* err, nvmlDevice_t device, int device_id) {
   unsigned int power_usage;
-  nvmlReturn_t result = nvmlDeviceGetPowerUsage(device, &power_usage);
+  nvmlReturn_t result = gpu->get_power_usage(device, &power_usage);
 
   if (result == NVML_SUCCESS)
-    printf("%d:%.2f\n", device_id, power_usage / 1000.0);
+    fprintf(out, "%d:%.2f\n", device_id, power_usage / 1000.0);
   else
-    fprintf(stderr, "%d:Error: %s\n", device_id, nvmlErrorString(result));
+    fprintf(err, "%d:Error: %s\n", device_id, gpu->error_string(result));
 }
 
-static void print_fan_cli(nvmlDevice_t device, int device_id) {
+static void print_fan_cli(FILE* out, FILE* err, nvmlDevice_t device, int device_id) {
   unsigned int fan_speed;
-  nvmlReturn_t result = nvmlDeviceGetFanSpeed(device, &fan_speed);
+  nvmlReturn_t result = gpu->get_fan_speed(device, &fan_speed);
 
   if (result == NVML_SUCCESS)
-    printf("%d:%u\n", device_id, fan_speed);
+    fprintf(out, "%d:%u\n", device_id, fan_speed);
   else
-    fprintf(stderr, "%d:Error: %s\n", device_id, nvmlErrorString(result));
+    fprintf(err, "%d:Error: %s\n", device_id, gpu->error_string(result));
 }
 
-static void print_temp_cli(nvmlDevice_t device, int device_id, char temp_unit) {
+static void print_temp_cli(FILE* out, FILE* err, nvmlDevice_t device, int device_id,
+                           char temp_unit) {
   unsigned int temperature;
-  nvmlReturn_t result = nvmlDeviceGetTemperature(device, NVML_TEMPERATURE_GPU, &temperature);
+  nvmlReturn_t result = gpu->get_temperature(device, NVML_TEMPERATURE_GPU, &temperature);
 
   if (result == NVML_SUCCESS) {
     double temp = convert_temperature(temperature, temp_unit);
-    printf("%d:%.1f\n", device_id, temp);
+    fprintf(out, "%d:%.1f\n", device_id, temp);
   } else {
-    fprintf(stderr, "%d:Error: %s\n", device_id, nvmlErrorString(result));
+    fprintf(err, "%d:Error: %s\n", device_id, gpu->error_string(result));
   }
 }
 
-static void print_vram_temp_cli(nvmlDevice_t device, int device_id) {
-  // Ensure PCI is initialized if it hasn't been yet
-  if (!pci_initialized) {
-    if (init_pci() != 0) {
-      fprintf(stderr, "%d:Error: Failed to initialize PCI for VRAM access\n", device_id);
-      return;
-    }
+// VRAM temperature, or the hotspot with -s hotspot
+static void print_vram_temp_cli(nvmlDevice_t device, int device_id,
+                                const topology_device_t* topo, const cli_args_t* args) {
+  vram_sensor_t* sensor = open_vram_sensor(device, topo, args);
+  if (!sensor) {
+    fprintf(stderr, "%d:Error: Failed to set up VRAM access\n", device_id);
+    return;
   }
 
   unsigned int temp;
-  if (read_vram_temp(device, &temp) == 0) {
+  if (read_sensor_temp(sensor, args->policy.sensor, &temp) == 0) {
     printf("%d:%u\n", device_id, temp);
+  } else if (args->policy.sensor == SENSOR_HOTSPOT) {
+    fprintf(stderr, "%d:Error: Failed to read hotspot temp (not in the register table)\n",
+            device_id);
   } else {
     fprintf(stderr, "%d:Error: Failed to read VRAM temp (root required or unsupported GPU)\n", device_id);
   }
 }
 
-static void print_status_cli(nvmlDevice_t device, int device_id, char temp_unit) {
-  unsigned int temperature = 0, fan_speed = 0, power_usage = 0;
+// Pick the next sampling interval from the temperature slope and the distance to the nearest
+// setpoint
+static void adapt_interval(controlled_device_t* cd, unsigned int temp) {
+  const fan_policy_t* p = cd->policy;
+  uint64_t now = monotonic_ns();
+  if (cd->samples++ == 0) cd->first_sample_ns = now;
+
+  if (cd->last_sample_ns && now > cd->last_sample_ns) {
+    double dt = (now - cd->last_sample_ns) / 1e9;
+    double delta = temp > cd->last_temp ? temp - cd->last_temp : cd->last_temp - temp;
+    cd->slope = 0.5 * cd->slope + 0.5 * delta / dt;
+  }
+  cd->last_temp = temp;
+  cd->last_sample_ns = now;
+  if (p->min_interval_ms == p->max_interval_ms) return;
+
+  double target = cd->slope > 0 ? ADAPT_STEP_C / cd->slope * 1000.0 : p->max_interval_ms;
+  for (int i = 0; i < p->setpoint_count; i++) {
+    double distance = temp - p->setpoints[i].temp;
+    if (distance >= -ADAPT_NEAR_SETPOINT_C && distance <= ADAPT_NEAR_SETPOINT_C)
+      target = p->min_interval_ms;
+  }
+  if (p->controller == CONTROLLER_PID && temp + ADAPT_NEAR_SETPOINT_C >= p->pid.target)
+    target = p->min_interval_ms; // Hold the loop rate up wherever the PID is working
 
-  nvmlDeviceGetTemperature(device, NVML_TEMPERATURE_GPU, &temperature);
-  nvmlDeviceGetFanSpeed(device, &fan_speed);
-  nvmlDeviceGetPowerUsage(device, &power_usage);
+  if (target > cd->interval_ms * ADAPT_BACKOFF) target = cd->interval_ms * ADAPT_BACKOFF;
+  if (target < p->min_interval_ms) target = p->min_interval_ms;
+  if (target > p->max_interval_ms) target = p->max_interval_ms;
+  cd->interval_ms = (unsigned int)target;
+}
 
-  double temp = convert_temperature(temperature, temp_unit);
-  printf("%d:%.1f%c,%u%%,%.1fW\n", device_id, temp, temp_unit, fan_speed, power_usage / 1000.0);
+// Samples a fixed loop at the minimum interval would have taken beyond the ones actually taken
+static unsigned long samples_saved(const controlled_device_t* cd) {
+  if (cd->samples == 0) return 0;
+  uint64_t elapsed_ms = (monotonic_ns() - cd->first_sample_ns) / 1000000;
+  unsigned long baseline = elapsed_ms / cd->policy->min_interval_ms + 1;
+  return baseline > cd->samples ? baseline - cd->samples : 0;
 }
 
-static int parse_args(int argc, char* argv[], cli_args_t* args) {
-  memset(args, 0, sizeof(cli_args_t));
-  args->temp_unit = 'C';
-  args->all_devices = 1;
-  args->sensor = SENSOR_CORE; // Default to core
+// Account time spent above the target and count entries into thermal slowdown
+static void track_target(controlled_device_t* cd, unsigned int temp, double dt) {
+  if (temp > cd->policy->pid.target) cd->above_target_ns += (uint64_t)(dt * 1e9);
 
-  if (argc < 2) return -1;
-  static const struct {
-    const char* name;
-    command_t cmd;
-  } commands[] = {{"info", CMD_INFO},     {"power", CMD_POWER}, {"fan", CMD_FAN},
-                  {"fanctl", CMD_FANCTL}, {"temp", CMD_TEMP},   {"status", CMD_STATUS},
-                  {"list", CMD_LIST},     {"vramtemp", CMD_VRAMTEMP}}; // Add here
+  const unsigned long long thermal = THERMAL_THROTTLE_REASONS;
+  unsigned long long reasons;
+  if (gpu->get_throttle_reasons(cd->device, &reasons) != NVML_SUCCESS) return;
+  if ((reasons & thermal) && !(cd->throttle_reasons & thermal)) cd->throttle_events++;
+  cd->throttle_reasons = reasons;
+}
 
-  args->command = CMD_NONE;
-  for (int i = 0; i < 8; i++) { // Update loop limit from 7 to 8
-    if (strcmp(argv[1], commands[i].name) == 0) {
-      args->command = commands[i].cmd;
-      break;
-    }
+// Fan speed for one temperature sample, dt seconds after the previous one: the curve, and with
+// --controller pid the PID bounded by it. Shared by the fanctl loop and replay.
+static unsigned int control_fan_speed(controlled_device_t* cd, unsigned int temp, double dt) {
+  const fan_policy_t* p = cd->policy;
+  // Rising temperatures are followed immediately; falling ones only once they have dropped by
+  // the hysteresis, so the fans do not hunt around a setpoint
+  if (!cd->have_control_temp || temp >= cd->control_temp ||
+      temp + p->hysteresis <= cd->control_temp) {
+    cd->control_temp = temp;
+    cd->have_control_temp = 1;
   }
-  if (args->command == CMD_NONE) return -1;
 
-  // Check for subcommand or fanctl setpoints
-  int start_idx = 2;
-  if (args->command == CMD_FANCTL) {
-    args->setpoint_count = parse_setpoints(argc, argv, 2, args->setpoints, MAX_SETPOINTS);
-    if (args->setpoint_count < 0) return -1;
+  unsigned int target_fan = curve_fan_speed(&p->curve, cd->control_temp);
+  if (p->controller != CONTROLLER_PID) return target_fan;
 
-    for (int i = 2; i < argc; i++) {
-      if (argv[i][0] == '-') {
-        start_idx = i;
-        break;
+  // The PID may run the fans harder than the curve but never slower, and never past its top
+  unsigned int ceiling = p->curve.max_fan > target_fan ? p->curve.max_fan : target_fan;
+  double output =
+      pid_update(&p->pid, &cd->pid, temp, cd->power_mw / 1000.0, dt, target_fan, ceiling);
+  return (unsigned int)(output + 0.5);
+}
+
+// Skip the write if the fan (last commanded speed, -1 if none) is already within the deadband,
+// but always let the curve endpoints through so the fans can reach their configured minimum and
+// maximum
+static int fan_write_needed(int last, unsigned int target_fan, const fan_policy_t* p) {
+  unsigned int delta = last < 0 ? UINT_MAX : (unsigned int)abs((int)target_fan - last);
+  return delta != 0 && (delta > p->deadband || target_fan == p->curve.min_fan ||
+                        target_fan == p->curve.max_fan);
+}
+
+// Read the sensor and apply the curve for one device. Returns 0 on success, 1 if the GPU is lost,
+// -1 if fanctl should stop.
+static int update_controlled_device(controlled_device_t* cd, const cli_args_t* args) {
+  const fan_policy_t* p = cd->policy;
+  fanctl_device_stats_t* st = &fanctl_stats.device[cd->slot];
+  nvmlReturn_t result;
+  unsigned int current_temp = 0;
+  int temp_result = 0;
+
+  uint64_t read_start = monotonic_ns();
+  if (p->sensor != SENSOR_CORE) {
+    temp_result = read_sensor_temp(cd->sensor, p->sensor, &current_temp);
+    if (temp_result != 0) {
+      pthread_mutex_lock(&st->lock);
+      st->sensor_fallbacks++;
+      pthread_mutex_unlock(&st->lock);
+      fprintf(stderr, "%d:Error reading %s temp. Falling back to Core temp.\n", cd->id,
+              p->sensor == SENSOR_HOTSPOT ? "hotspot" : "VRAM");
+      // Fallback to core if VRAM read fails
+      temp_result = gpu->get_temperature(cd->device, NVML_TEMPERATURE_GPU, &current_temp);
+      if (temp_result == NVML_ERROR_GPU_IS_LOST) return 1;
+      if (temp_result != NVML_SUCCESS) {
+        fprintf(stderr, "%d:Error reading Core temp. Aborting.\n", cd->id);
+        return -1;
       }
-      if (i == argc - 1) start_idx = argc;
     }
-  } else if (argc > 2 && strcmp(argv[2], "set") == 0) {
-    args->subcommand = SUBCMD_SET;
-    if (argc > 3) {
-      args->set_value = atoi(argv[3]);
-      start_idx = 4;
-    } else {
-      fprintf(stderr, "Error: 'set' requires a value\n");
+  } else {
+    temp_result = gpu->get_temperature(cd->device, NVML_TEMPERATURE_GPU, &current_temp);
+    if (temp_result == NVML_ERROR_GPU_IS_LOST) return 1;
+    if (temp_result != NVML_SUCCESS) {
+      fprintf(stderr, "%d:Error: Cannot read temperature (%s)\n", cd->id,
+              gpu->error_string(temp_result));
       return -1;
     }
-  } else if (argc > 2 && strcmp(argv[2], "restore") == 0) {
-    args->subcommand = SUBCMD_RESTORE;
-    start_idx = 3;
-  } else if (argc > 2 && strcmp(argv[2], "json") == 0) {
-    args->subcommand = SUBCMD_JSON;
-    start_idx = 3;
+  }
+  uint64_t read_ns = monotonic_ns() - read_start;
+  pthread_mutex_lock(&st->lock);
+  hist_record(&st->sensor_ns, read_ns);
+  pthread_mutex_unlock(&st->lock);
+
+  uint64_t prev_sample_ns = cd->last_sample_ns;
+  adapt_interval(cd, current_temp);
+  double dt = prev_sample_ns ? (cd->last_sample_ns - prev_sample_ns) / 1e9 : 0.0;
+  if (p->target_set) track_target(cd, current_temp, dt);
+
+  if (p->controller == CONTROLLER_PID && p->pid.feed_forward > 0) {
+    unsigned int power_mw;
+    if (gpu->get_power_usage(cd->device, &power_mw) == NVML_SUCCESS) cd->power_mw = power_mw;
+  }
+  unsigned int target_fan = control_fan_speed(cd, current_temp, dt);
+
+  // After a thermal slowdown event the fans stay at full speed until the slowdown clears; the PID
+  // then slews down from there
+  if (cd->thermal_hold) {
+    unsigned long long reasons;
+    if (gpu->get_throttle_reasons(cd->device, &reasons) == NVML_SUCCESS &&
+        !(reasons & THERMAL_THROTTLE_REASONS)) {
+      cd->thermal_hold = 0;
+    } else {
+      target_fan = THERMAL_HOLD_FAN_PCT;
+      cd->pid.output = THERMAL_HOLD_FAN_PCT;
+    }
   }
 
-  static struct option long_options[] = {{"device", required_argument, 0, 'd'},
-                                         {"uuid", required_argument, 0, 'u'},
-                                         {"sensor", required_argument, 0, 's'}, // Added sensor
-                                         {"temp-unit", required_argument, 0, 't'},
-                                         {"help", no_argument, 0, 'h'},
-                                         {0, 0, 0, 0}};
+  int fan_errors = 0;
+  for (unsigned int fan = 0; fan < cd->num_fans; fan++) {
+    if (!fan_write_needed(cd->commanded[fan], target_fan, p)) {
+      cd->writes_elided++;
+      continue;
+    }
 
-  int opt;
-  optind = start_idx;
-  while ((opt = getopt_long(argc, argv, "d:u:s:t:h", long_options, NULL)) != -1) {
-    switch (opt) {
-    case 'd':
-      args->device_count = parse_device_range(optarg, args->devices, MAX_DEVICES);
-      args->all_devices = 0;
-      break;
-    case 'u':
-      strncpy(args->uuid, optarg, sizeof(args->uuid) - 1);
-      args->use_uuid = 1;
-      args->all_devices = 0;
-      break;
-    case 's': // Handle sensor selection
-      if (strcmp(optarg, "core") == 0) {
-        args->sensor = SENSOR_CORE;
-      } else if (strcmp(optarg, "vram") == 0) {
-        args->sensor = SENSOR_VRAM;
-      } else {
-        fprintf(stderr, "Error: Invalid sensor '%s'. Use 'core' or 'vram'.\n", optarg);
-        return -1;
-      }
-      break;
-    case 't':
-      args->temp_unit = 0;
-      if (!strcmp(optarg, "C")) args->temp_unit = 'C';
-      if (!strcmp(optarg, "F")) args->temp_unit = 'F';
-      if (!strcmp(optarg, "K")) args->temp_unit = 'K';
-      if (!args->temp_unit) {
-        fprintf(stderr, "Error: Invalid temperature unit '%s'\n", optarg);
-        return -1;
-      }
-      break;
-    default: return -1;
+    uint64_t set_start = monotonic_ns();
+    result = gpu->set_fan_speed(cd->device, fan, target_fan);
+    uint64_t set_ns = monotonic_ns() - set_start;
+    pthread_mutex_lock(&st->lock);
+    hist_record(&st->fan_set_ns, set_ns);
+    pthread_mutex_unlock(&st->lock);
+    cd->writes++;
+    if (result == NVML_ERROR_GPU_IS_LOST) return 1;
+    if (result != NVML_SUCCESS) {
+      fprintf(stderr, "%d:Fan%u:Error: %s\n", cd->id, fan, gpu->error_string(result));
+      cd->commanded[fan] = -1;
+      fan_errors++;
+    } else {
+      cd->commanded[fan] = target_fan;
     }
   }
-
+  if (fan_errors > 0) return -1;
+  cd->target_fan = target_fan;
+
+  double temp_display = convert_temperature(current_temp, args->temp_unit);
+  // Mark VRAM and hotspot readings
+  const char* sensor_label = p->sensor == SENSOR_VRAM      ? "V"
+                             : p->sensor == SENSOR_HOTSPOT ? "H"
+                                                              : "";
+  int n = snprintf(cd->line, sizeof(cd->line), "%d:%.1f%c%s -> %u%%%s", cd->id, temp_display,
+                   args->temp_unit, sensor_label, target_fan,
+                   cd->thermal_hold ? " (thermal)" : "");
+  if (p->min_interval_ms != p->max_interval_ms && n > 0 && (size_t)n < sizeof(cd->line))
+    snprintf(cd->line + n, sizeof(cd->line) - n, " (%u ms, %lu saved)", cd->interval_ms,
+             samples_saved(cd));
+
+  if (args->dashboard) {
+    // The controlling sensor was just read; only the other temperature needs a query
+    telemetry_t t;
+    unsigned int want = TM_FAN | TM_POWER | TM_POWER_LIMIT;
+    if (p->sensor != SENSOR_CORE) want |= TM_TEMP;
+    telemetry_read(cd->device, want, &t);
+    cd->dash_valid = t.valid | (p->sensor != SENSOR_CORE ? 0 : TM_TEMP);
+    cd->core_temp = p->sensor != SENSOR_CORE ? t.temperature : current_temp;
+    cd->fan_speed = t.fan_speed;
+    cd->power_mw = t.power_usage;
+    cd->power_limit_mw = t.power_limit;
+    cd->have_vram_temp = cd->sensor && read_vram_temp(cd->sensor, &cd->vram_temp) == 0;
+  }
   return 0;
 }
 
-int main(int argc, char* argv[]) {
-  nvmlReturn_t result;
-  cli_args_t args;
-  unsigned int device_count;
+static void format_temp(char* buf, size_t size, int valid, unsigned int temp_c, char unit) {
+  if (valid)
+    snprintf(buf, size, "%.1f%c", convert_temperature(temp_c, unit), unit);
+  else
+    snprintf(buf, size, "-");
+}
 
-  if (parse_args(argc, argv, &args) != 0) {
-    print_usage(argv[0]);
-    return 1;
-  }
+// Compose the terminal frame from the last collected state of every device and redraw what
+// changed. Devices dropped from control close up; the rows they leave at the bottom are blanked.
+static void draw_fanctl_frame(const cli_args_t* args) {
+  int row = 0;
+  if (args->dashboard)
+    render_printf(&screen, row++, "%-4s %8s %8s %5s %6s %8s %8s %8s", "GPU", "Temp", "VRAM",
+                  "Fan", "Target", "Power", "Limit", "Period");
+  for (int i = 0; i < controlled_device_count; i++) {
+    const controlled_device_t* cd = &shown[i];
+    if (controlled[i].dropped) continue;
+    if (!args->dashboard) {
+      render_printf(&screen, row++, "%s", cd->line);
+      continue;
+    }
 
-  result = nvmlInit();
-  if (result != NVML_SUCCESS) {
-    fprintf(stderr, "Error: Failed to initialize NVML (%s)\n", nvmlErrorString(result));
-    return 1;
+    char temp[16], vram[16], fan[8] = "-", power[16] = "-", limit[16] = "-";
+    format_temp(temp, sizeof(temp), cd->dash_valid & TM_TEMP, cd->core_temp, args->temp_unit);
+    format_temp(vram, sizeof(vram), cd->have_vram_temp, cd->vram_temp, args->temp_unit);
+    if (cd->dash_valid & TM_FAN) snprintf(fan, sizeof(fan), "%u%%", cd->fan_speed);
+    if (cd->dash_valid & TM_POWER) snprintf(power, sizeof(power), "%.1fW", cd->power_mw / 1000.0);
+    if (cd->dash_valid & TM_POWER_LIMIT)
+      snprintf(limit, sizeof(limit), "%.1fW", cd->power_limit_mw / 1000.0);
+    render_printf(&screen, row++, "%-4d %8s %8s %5s %5u%% %8s %8s %6ums", cd->id, temp, vram,
+                  fan, cd->target_fan, power, limit, cd->interval_ms);
   }
+  while (row < screen.rows) render_printf(&screen, row++, "%s", "");
+  render_flush(&screen);
+}
 
-  result = nvmlDeviceGetCount(&device_count);
-  if (result != NVML_SUCCESS) {
-    fprintf(stderr, "Error: Failed to get device count (%s)\n", nvmlErrorString(result));
-    nvmlShutdown();
-    return 1;
-  }
+// Take the index-th device out of fan control. Its thread is left parked, and the entry is
+// removed once the loop has ended.
+static void drop_controlled_device(int index, const char* reason) {
+  fprintf(stderr, "%d:Error: GPU %s; dropping it from fan control\n", controlled[index].id,
+          reason);
+  controlled[index].dropped = 1;
+}
 
-  if (device_count == 0) {
-    fprintf(stderr, "No NVIDIA GPUs found\n");
-    nvmlShutdown();
+// Act on what the event thread posted for the index-th device: a thermal slowdown holds the fans
+// at full speed, and every event brings the device's next update forward to now. Returns 1 if
+// the device was dropped.
+static int apply_device_events(int index, const struct timespec* now) {
+  controlled_device_t* cd = &controlled[index];
+  gpu_event_t event;
+  if (!events_take(cd->device, &event)) return 0;
+
+  if (event.flags & GPU_EVENT_LOST) {
+    drop_controlled_device(index, event.xid == GPU_XID_FALLEN_OFF_BUS
+                                      ? "has fallen off the bus (XID 79)"
+                                      : "is lost");
     return 1;
   }
+  if (event.flags & GPU_EVENT_XID)
+    fprintf(stderr, "%d:Warning: XID %llu critical error\n", cd->id, event.xid);
+  if (event.flags & GPU_EVENT_POWER_SOURCE)
+    fprintf(stderr, "%d:Power source changed to %s\n", cd->id,
+            event.power_source == 0 ? "AC" : event.power_source == 1 ? "battery" : "undersized");
+  if (event.flags & GPU_EVENT_THERMAL) cd->thermal_hold = 1;
+  cd->deadline = *now;
+  return 0;
+}
 
-  // Handle UUID selection
-  if (args.use_uuid) {
-    int device_id = find_device_by_uuid(args.uuid, device_count);
-    if (device_id < 0) {
-      fprintf(stderr, "Error: Device with UUID '%s' not found\n", args.uuid);
-      nvmlShutdown();
-      return 1;
-    }
-    args.devices[0] = device_id;
-    args.device_count = 1;
-    args.all_devices = 0;
+// Print a policy's setpoints and controller, every line starting with prefix
+static void print_policy(const char* prefix, const fan_policy_t* p) {
+  printf("%sSetpoints: ", prefix);
+  for (int sp = 0; sp < p->setpoint_count; sp++) {
+    printf("%g:%g%%", p->setpoints[sp].temp, p->setpoints[sp].fan);
+    if (sp < p->setpoint_count - 1) printf(" ");
   }
+  if (p->min_interval_ms == p->max_interval_ms)
+    printf(" (%s, every %u ms)\n", curve_type_name(p->curve_type), p->min_interval_ms);
+  else
+    printf(" (%s, every %u-%u ms)\n", curve_type_name(p->curve_type), p->min_interval_ms,
+           p->max_interval_ms);
+  if (p->controller == CONTROLLER_PID)
+    printf("%sPID: target %g C, gains %g,%g,%g, feed-forward %g %%/W, slew %g %%/s\n", prefix,
+           p->pid.target, p->pid.kp, p->pid.ki, p->pid.kd, p->pid.feed_forward, p->pid.slew);
+}
 
-  // Setup device list
-  static int all_devs[MAX_DEVICES];
-  int* target_devices = args.devices;
-  int target_count = args.device_count;
+// What the config file can name a controlled device by, and the sensors it may follow there
+static void describe_config_device(const controlled_device_t* cd, fanconf_device_t* d) {
+  d->id = cd->id;
+  if (gpu->get_uuid(cd->device, d->uuid, sizeof(d->uuid)) != NVML_SUCCESS) d->uuid[0] = '\0';
+  d->sensors = 1u << SENSOR_CORE;
+  if (cd->sensor && cd->sensor->layout->field[REG_VRAM].offset) d->sensors |= 1u << SENSOR_VRAM;
+  if (cd->sensor && cd->sensor->layout->field[REG_HOTSPOT].offset)
+    d->sensors |= 1u << SENSOR_HOTSPOT;
+}
 
-  if (args.all_devices) {
-    for (unsigned int i = 0; i < device_count && i < MAX_DEVICES; i++) all_devs[i] = i;
-    target_devices = all_devs;
-    target_count = device_count;
+// Move a device to its policy in a reloaded config. Fan and controller state carry over, so the
+// fans neither return to automatic control nor jump, and the device is updated right away under
+// its new policy. Returns 0 if it already had it.
+static int install_policy(controlled_device_t* cd, const fanconf_t* conf,
+                          const struct timespec* now) {
+  const fan_policy_t* p = conf->device[cd->slot];
+  if (cd->policy == p) return 0;
+  if (p->sensor != cd->policy->sensor) cd->have_control_temp = 0; // Another sensor's scale
+  if (p->controller != cd->policy->controller) memset(&cd->pid, 0, sizeof(cd->pid));
+  if (cd->interval_ms < p->min_interval_ms) cd->interval_ms = p->min_interval_ms;
+  if (cd->interval_ms > p->max_interval_ms) cd->interval_ms = p->max_interval_ms;
+  cd->policy = p;
+  cd->deadline = *now;
+  return 1;
+}
+
+// Print the loop statistics as one line of JSON; reason is "signal" or "exit"
+static void print_fanctl_stats(FILE* out, const char* reason) {
+  const fanctl_stats_t* fs = &fanctl_stats;
+  unsigned long misses = 0, fallbacks = 0;
+  static hist_t jitter_ns;
+  memset(&jitter_ns, 0, sizeof(jitter_ns));
+  for (int i = 0; i < fs->device_count; i++) {
+    misses += fs->device[i].deadline_misses;
+    hist_merge(&jitter_ns, &fs->device[i].jitter_ns);
+    pthread_mutex_lock(&fanctl_stats.device[i].lock);
+    fallbacks += fs->device[i].sensor_fallbacks;
+    pthread_mutex_unlock(&fanctl_stats.device[i].lock);
   }
 
-  // JSON output header
-  if (args.subcommand == SUBCMD_JSON && args.command == CMD_INFO) printf("[\n");
+  fprintf(out,
+          "{\"fanctl_stats\":{\"reason\":\"%s\",\"uptime_s\":%.3f,\"passes\":%lu,"
+          "\"deadline_misses\":%lu,\"sensor_fallbacks\":%lu,\"period_jitter\":",
+          reason, (monotonic_ns() - fs->start_ns) / 1e9, fs->passes, misses, fallbacks);
+  hist_print_json(out, &jitter_ns);
+  fprintf(out, ",\"output\":");
+  hist_print_json(out, &fs->output_ns);
+  fprintf(out, ",\"devices\":[");
+  for (int i = 0; i < fs->device_count; i++) {
+    fanctl_device_stats_t* st = &fanctl_stats.device[i];
+    pthread_mutex_lock(&st->lock);
+    fprintf(out,
+            "%s{\"device_id\":%d,\"deadline_misses\":%lu,\"sensor_fallbacks\":%lu,"
+            "\"period_jitter\":",
+            i ? "," : "", st->id, st->deadline_misses, st->sensor_fallbacks);
+    hist_print_json(out, &st->jitter_ns);
+    fprintf(out, ",\"sensor_read\":");
+    hist_print_json(out, &st->sensor_ns);
+    fprintf(out, ",\"fan_set\":");
+    hist_print_json(out, &st->fan_set_ns);
+    fprintf(out, "}");
+    pthread_mutex_unlock(&st->lock);
+  }
+  fprintf(out, "]}}\n");
+  fflush(out);
+}
 
-  // Execute command for each device
-  int error_count = 0;
-  for (int i = 0; i < target_count; i++) {
-    int device_id = target_devices[i];
+// Runs on the index-th device's own thread whenever the device is due
+static int update_device_when_due(int index, void* ctx) {
+  controlled_device_t* cd = &controlled[index];
+  clock_gettime(CLOCK_MONOTONIC, &cd->started);
+  return update_controlled_device(cd, ctx);
+}
 
-    if (device_id >= (int)device_count) {
-      fprintf(stderr, "Error: Device ID %d not found (available: 0-%d)\n", device_id,
-              device_count - 1);
-      error_count++;
-      continue;
-    }
+// Act on a finished update of the index-th device: print and export its state and set its next
+// deadline. Returns 0, or -1 if fanctl should stop.
+static int collect_update(int index, int result, uint64_t* output_ns) {
+  controlled_device_t* cd = &controlled[index];
+  if (result > 0) {
+    drop_controlled_device(index, "is lost");
+    return 0;
+  }
+  if (result < 0) return -1;
+
+  fanctl_device_stats_t* st = &fanctl_stats.device[cd->slot];
+  uint64_t start_ns = timespec_to_ns(&cd->started), due_ns = timespec_to_ns(&cd->deadline);
+  hist_record(&st->jitter_ns, start_ns > due_ns ? start_ns - due_ns : 0);
+  if (!is_terminal) {
+    uint64_t print_start = monotonic_ns();
+    printf("%s\n", cd->line);
+    *output_ns += monotonic_ns() - print_start;
+  }
+  shown[index] = *cd;
 
-    nvmlDevice_t device;
-    result = nvmlDeviceGetHandleByIndex(device_id, &device);
-    if (result != NVML_SUCCESS) {
-      fprintf(stderr, "Error: Failed to get device handle for device %d (%s)\n", device_id,
-              nvmlErrorString(result));
-      error_count++;
-      continue;
-    }
+  export_controller_t state = {cd->control_temp, cd->target_fan, cd->writes, cd->writes_elided};
+  export_update_controller(cd->slot, &state);
 
-    switch (args.command) {
-    case CMD_INFO:
-      if (args.subcommand == SUBCMD_JSON)
-        print_device_info_json(device, device_id, args.temp_unit, i == target_count - 1);
-      else
-        print_device_info_human(device, device_id, args.temp_unit);
-      break;
+  // Every further period the deadline has to be moved by was missed outright
+  timespec_add_ms(&cd->deadline, cd->interval_ms);
+  while (!timespec_before(&cd->started, &cd->deadline)) {
+    timespec_add_ms(&cd->deadline, cd->interval_ms);
+    st->deadline_misses++;
+  }
+  return 0;
+}
 
-    case CMD_POWER:
-      if (args.subcommand == SUBCMD_SET) {
-        unsigned int limit_mw = args.set_value * 1000;
-        unsigned int min_limit, max_limit;
+// Absolute-deadline scheduler: every device has its own thread, which sleeps until the device's
+// deadline on CLOCK_MONOTONIC and updates it, so time spent in NVML calls neither accumulates as
+// drift nor delays any other device. Missed periods are skipped rather than run back to back.
+// This thread only collects the finished updates, and changes a device (events from the event
+// thread, a reloaded config) while its thread is not updating it. Returns 0, or -1 if the
+// threads could not be started.
+static int run_fanctl_loop(const cli_args_t* args) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  fanctl_stats.start_ns = timespec_to_ns(&now);
+  fanctl_stats.device_count = controlled_device_count;
+  for (int i = 0; i < controlled_device_count; i++) {
+    controlled[i].deadline = now;
+    shown[i] = controlled[i];
+    fanctl_stats.device[controlled[i].slot].id = controlled[i].id;
+    pthread_mutex_init(&fanctl_stats.device[controlled[i].slot].lock, NULL);
+  }
+  if (pacer_start(controlled_device_count, update_device_when_due, (void*)args, &now) != 0)
+    return -1;
 
-        result = nvmlDeviceGetPowerManagementLimitConstraints(device, &min_limit, &max_limit);
-        if (result != NVML_SUCCESS) {
-          fprintf(stderr, "%d:Error: Cannot get power limit constraints (%s)\n", device_id,
-                  nvmlErrorString(result));
-          error_count++;
-          continue;
+  int live = controlled_device_count;
+  fanconf_t* installing = NULL; // Reloaded config, until every device has moved to it
+  while (running) {
+    int updated = 0;
+    uint64_t output_ns = 0;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (!installing) installing = fanconf_take();
+
+    int unmoved = 0; // Devices still to be moved to installing
+    for (int i = 0; i < controlled_device_count && running; i++) {
+      controlled_device_t* cd = &controlled[i];
+      if (cd->dropped) continue;
+      int result, taken = pacer_take(i, &result);
+      if (taken < 0) {
+        unmoved += installing && cd->policy != installing->device[cd->slot];
+        continue;
+      }
+      if (taken > 0) {
+        if (collect_update(i, result, &output_ns) != 0) {
+          running = 0;
+          break;
         }
-
-        if (limit_mw < min_limit || limit_mw > max_limit) {
-          fprintf(stderr, "%d:Error: Power limit %uW outside valid range (%.2f-%.2fW)\n", device_id,
-                  args.set_value, min_limit / 1000.0, max_limit / 1000.0);
-          error_count++;
+        updated = 1;
+        if (cd->dropped) {
+          live--;
           continue;
         }
-
-        result = nvmlDeviceSetPowerManagementLimit(device, limit_mw);
-        if (result == NVML_SUCCESS) {
-          printf("%d:Power limit set to %uW\n", device_id, args.set_value);
-        } else {
-          fprintf(stderr, "%d:Error: Failed to set power limit (%s)\n", device_id,
-                  nvmlErrorString(result));
-          error_count++;
-        }
-      } else {
-        print_power_cli(device, device_id);
       }
+      if (apply_device_events(i, &now)) {
+        live--;
+        updated = 1;
+        continue;
+      }
+      if (installing) install_policy(cd, installing, &now);
+      pacer_release(i, &cd->deadline);
+    }
+    if (installing && unmoved == 0 && running) {
+      fanconf_free(fan_config);
+      fan_config = installing;
+      installing = NULL;
+    }
+
+    if (live == 0) {
+      fprintf(stderr, "Error: No devices left under fan control\n");
+      running = 0;
+    }
+    if (updated) {
+      uint64_t output_start = monotonic_ns();
+      if (is_terminal && running) draw_fanctl_frame(args);
+      fflush(stdout);
+      hist_record(&fanctl_stats.output_ns, output_ns + monotonic_ns() - output_start);
+      fanctl_stats.passes++;
+    }
+    if (stats_requested) {
+      stats_requested = 0;
+      print_fanctl_stats(stderr, "signal");
+    }
+    if (!running) break;
+
+    events_wait(pacer_fd());
+  }
+  pacer_stop();
+
+  // With the threads gone every device can be moved and the lost ones removed
+  if (installing) {
+    for (int i = 0; i < controlled_device_count; i++)
+      if (!controlled[i].dropped) install_policy(&controlled[i], installing, &now);
+    fanconf_free(fan_config);
+    fan_config = installing;
+  }
+  int kept = 0;
+  for (int i = 0; i < controlled_device_count; i++)
+    if (!controlled[i].dropped) controlled[kept++] = controlled[i];
+  controlled_device_count = kept;
+  return 0;
+}
+
+static int shm_device_selected(const cli_args_t* args, int device_id) {
+  if (args->all_devices) return 1;
+  for (int i = 0; i < args->device_count; i++)
+    if (args->devices[i] == device_id) return 1;
+  return 0;
+}
+
+// shm-read: print the published samples in the status (or info json) format
+static int run_shm_read(const cli_args_t* args) {
+  nvml_tool_shm_t shm;
+  if (nvml_tool_shm_open(args->shm_name, &shm) != 0) {
+    fprintf(stderr, "Error: No telemetry published at %s (start 'nvml-tool publish')\n",
+            args->shm_name);
+    return 1;
+  }
+
+  const nvml_tool_shm_header_t* h = shm.header;
+  uint64_t updated_ns = __atomic_load_n(&h->updated_ns, __ATOMIC_ACQUIRE);
+  uint64_t age_ms = (monotonic_ns() - updated_ns) / 1000000;
+  if (!__atomic_load_n(&h->alive, __ATOMIC_ACQUIRE) || kill(h->publisher_pid, 0) != 0 ||
+      age_ms > 3ull * h->interval_ms)
+    fprintf(stderr, "Warning: Publisher %u is not updating %s (last sample %llu ms ago)\n",
+            h->publisher_pid, args->shm_name, (unsigned long long)age_ms);
+
+  // Copy everything out first so the JSON array knows its last element
+  static telemetry_t samples[MAX_DEVICES];
+  static int ids[MAX_DEVICES];
+  int count = 0, errors = 0;
+  for (uint32_t i = 0; i < h->device_count && count < MAX_DEVICES; i++) {
+    nvml_tool_shm_sample_t s;
+    if (nvml_tool_shm_read(&shm, i, &s) != 0) {
+      fprintf(stderr, "Error: No consistent sample in slot %u of %s (not sampled yet, or the "
+              "publisher died while writing it)\n", i, args->shm_name);
+      errors++;
+      continue;
+    }
+    if (!shm_device_selected(args, s.device_id)) continue;
+
+    telemetry_t* t = &samples[count];
+    memset(t, 0, sizeof(*t));
+    t->valid = s.valid;
+    t->timestamp_ns = s.timestamp_ns;
+    t->temperature = s.temperature;
+    t->fan_speed = s.fan_speed;
+    t->power_usage = s.power_usage;
+    t->power_limit = s.power_limit;
+    t->memory.total = s.memory_total;
+    t->memory.used = s.memory_used;
+    t->memory.free = s.memory_free;
+    snprintf(t->name, sizeof(t->name), "%.*s", (int)sizeof(s.name), s.name);
+    snprintf(t->uuid, sizeof(t->uuid), "%.*s", (int)sizeof(s.uuid), s.uuid);
+    ids[count++] = s.device_id;
+  }
+  nvml_tool_shm_close(&shm);
+
+  int json = args->subcommand == SUBCMD_JSON;
+  if (json) printf("[\n");
+  for (int i = 0; i < count; i++) {
+    if (json) {
+      if (i) printf(",\n");
+      print_device_info_json(stdout, &samples[i], ids[i], args->temp_unit);
+    } else {
+      print_status_cli(stdout, &samples[i], ids[i], args->temp_unit);
+    }
+  }
+  if (json) printf("%s]\n", count ? "\n" : "");
+
+  return errors > 0 || count == 0;
+}
+
+static void tlog_set(tlog_sample_t* s, int column, uint32_t value) {
+  s->value[column] = value;
+  s->valid |= TLOG_VALID(column);
+}
+
+// record: append a frame (a sample per device) to the telemetry log every interval until
+// --count frames, --duration or SIGINT/SIGTERM. sensors[i] is NULL unless -s vram.
+static int run_record(const cli_args_t* args, const nvmlDevice_t* devices, const int* ids,
+                      vram_sensor_t* const* sensors, int count) {
+  tlog_device_t* table = calloc(count, sizeof(tlog_device_t));
+  tlog_sample_t* frame = calloc(count, sizeof(tlog_sample_t));
+  if (!table || !frame) {
+    fprintf(stderr, "Error: Out of memory\n");
+    free(table);
+    free(frame);
+    return -1;
+  }
+  for (int i = 0; i < count; i++) {
+    telemetry_t t;
+    telemetry_read(devices[i], TM_NAME | TM_UUID, &t);
+    table[i].device_id = ids[i];
+    snprintf(table[i].uuid, sizeof(table[i].uuid), "%s", t.uuid);
+    snprintf(table[i].name, sizeof(table[i].name), "%s", t.name);
+  }
+
+  struct timespec realtime;
+  clock_gettime(CLOCK_REALTIME, &realtime);
+  uint64_t start_ns = monotonic_ns();
+  uint64_t start_realtime_ns = (uint64_t)realtime.tv_sec * 1000000000ULL + realtime.tv_nsec;
+  tlog_writer_t log;
+  rollup_writer_t rollups;
+  int rc = tlog_create(&log, args->log_path, table, count, args->interval_ms, start_realtime_ns);
+  free(table);
+  if (rc == 0 && rollup_create(&rollups, args->log_path, count, start_realtime_ns) != 0) {
+    tlog_close(&log);
+    rc = -1;
+  }
+  if (rc != 0) {
+    free(frame);
+    return -1;
+  }
+  fprintf(stderr, "Recording %d device(s) to %s every %u ms (Ctrl-C to stop)\n", count,
+          args->log_path, args->interval_ms);
+
+  const unsigned int want = TM_TEMP | TM_FAN | TM_POWER | TM_POWER_LIMIT | TM_MEMORY;
+  uint64_t end_ns = args->duration_s ? start_ns + args->duration_s * 1000000000ULL : 0;
+  unsigned long frames = 0;
+  struct timespec deadline, now;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  while (running) {
+    uint64_t sample_ns = monotonic_ns();
+    if (end_ns && sample_ns >= end_ns) break;
+
+    for (int i = 0; i < count; i++) {
+      telemetry_t t;
+      tlog_sample_t* s = &frame[i];
+      telemetry_read(devices[i], want, &t);
+      s->valid = 0;
+      if (t.valid & TM_TEMP) tlog_set(s, TLOG_TEMP, t.temperature);
+      if (t.valid & TM_FAN) tlog_set(s, TLOG_FAN, t.fan_speed);
+      if (t.valid & TM_POWER) tlog_set(s, TLOG_POWER, t.power_usage);
+      if (t.valid & TM_POWER_LIMIT) tlog_set(s, TLOG_POWER_LIMIT, t.power_limit);
+      if (t.valid & TM_MEMORY) tlog_set(s, TLOG_MEMORY_USED, t.memory.used >> 20);
+      unsigned int vram_temp;
+      if (sensors[i] && read_vram_temp(sensors[i], &vram_temp) == 0)
+        tlog_set(s, TLOG_VRAM_TEMP, vram_temp);
+    }
+    uint64_t ms = (sample_ns - start_ns) / 1000000;
+    if (tlog_append(&log, ms, frame) != 0 || rollup_add(&rollups, ms, frame) != 0) {
+      rc = -1;
       break;
+    }
+    if (++frames == (unsigned long)args->count) break;
 
-    case CMD_FAN:
-      if (args.subcommand == SUBCMD_SET || args.subcommand == SUBCMD_RESTORE) {
-        unsigned int num_fans = 0;
-        result = nvmlDeviceGetNumFans(device, &num_fans);
-        if (result != NVML_SUCCESS) {
-          fprintf(stderr, "%d:Error: Cannot get number of fans (%s)\n", device_id,
-                  nvmlErrorString(result));
-          error_count++;
-          continue;
+    // Missed periods are skipped rather than sampled back to back
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    while (!timespec_before(&now, &deadline)) timespec_add_ms(&deadline, args->interval_ms);
+    // Returns early with EINTR on SIGINT/SIGTERM; the loop condition picks that up
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+  }
+  free(frame);
+
+  // A failed append leaves the writer in the same state as a close
+  if (tlog_close(&log) != 0) rc = -1;
+  if (rollup_close(&rollups) != 0) rc = -1;
+  size_t header = sizeof(tlog_header_t) + count * sizeof(tlog_device_t);
+  fprintf(stderr, "Recorded %lu frame(s), %llu bytes (%.1f bytes per device sample)\n", frames,
+          log.bytes, frames ? (log.bytes - header) / (double)(frames * count) : 0.0);
+  return rc;
+}
+
+typedef struct {
+  unsigned long samples;
+  uint64_t first_ms;
+  uint64_t last_ms;
+  uint64_t above_target_ms;
+  double temp_sum; // In --temp-unit
+  unsigned int temp_max;
+  double fan_sum;
+  unsigned int fan_max;
+  double recorded_fan_sum;
+  unsigned long recorded_fan_samples;
+} replay_stats_t;
+
+// replay: feed a telemetry log through the fanctl control path as fast as it decodes. The
+// recorded sample times stand in for the control period and nothing is written to a device, so
+// the trace does not react to the commanded speeds (open loop).
+static int run_replay(const cli_args_t* args) {
+  tlog_reader_t log;
+  if (tlog_open(&log, args->log_path) != 0) return 1;
+  const tlog_header_t* h = log.header;
+  int count = h->device_count;
+
+  // controlled[] holds the controller state of the selected devices; slot maps a recorded
+  // device to its entry, or -1
+  int* slot = malloc(count * sizeof(int));
+  replay_stats_t* stats = calloc(MAX_DEVICES, sizeof(replay_stats_t));
+  tlog_sample_t* samples = malloc(sizeof(tlog_sample_t) * TLOG_BLOCK_FRAMES * count);
+  uint64_t ms[TLOG_BLOCK_FRAMES];
+  if (!slot || !stats || !samples) {
+    fprintf(stderr, "Error: Out of memory\n");
+    free(slot);
+    free(stats);
+    free(samples);
+    tlog_close_reader(&log);
+    return 1;
+  }
+  for (int d = 0; d < count; d++) {
+    const tlog_device_t* dev = &log.devices[d];
+    int selected = args->use_uuid ? strncmp(dev->uuid, args->uuid, sizeof(dev->uuid)) == 0
+                                  : shm_device_selected(args, dev->device_id);
+    slot[d] = -1;
+    if (!selected || controlled_device_count >= MAX_DEVICES) continue;
+    controlled_device_t* cd = &controlled[controlled_device_count];
+    cd->id = dev->device_id;
+    cd->policy = &args->policy;
+    cd->num_fans = 1;
+    cd->commanded[0] = -1;
+    slot[d] = controlled_device_count++;
+  }
+
+  time_t start = h->start_realtime_ns / 1000000000ULL;
+  char when[32];
+  strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&start));
+  printf("Replaying %s: %d of %d device(s) recorded %s every %u ms\n", args->log_path,
+         controlled_device_count, count, when, h->interval_ms);
+
+  const char* sensor_label = args->policy.sensor == SENSOR_VRAM ? "V" : "";
+  uint64_t replay_start = monotonic_ns();
+  unsigned long total = 0;
+  int frames, errors = 0;
+  while ((frames = tlog_read_block(&log, ms, samples)) > 0) {
+    for (int f = 0; f < frames; f++) {
+      for (int d = 0; d < count; d++) {
+        if (slot[d] < 0) continue;
+        const tlog_sample_t* s = &samples[f * count + d];
+        controlled_device_t* cd = &controlled[slot[d]];
+        replay_stats_t* st = &stats[slot[d]];
+
+        // Same sensor choice as fanctl, falling back to the core when VRAM was not read
+        int column =
+            args->policy.sensor == SENSOR_VRAM && (s->valid & TLOG_VALID(TLOG_VRAM_TEMP))
+                ? TLOG_VRAM_TEMP
+                : TLOG_TEMP;
+        if (!(s->valid & TLOG_VALID(column))) continue;
+        unsigned int temp = s->value[column];
+        double dt = st->samples ? (ms[f] - st->last_ms) / 1000.0 : 0.0;
+        if (s->valid & TLOG_VALID(TLOG_POWER)) cd->power_mw = s->value[TLOG_POWER];
+
+        unsigned int target_fan = control_fan_speed(cd, temp, dt);
+        if (fan_write_needed(cd->commanded[0], target_fan, cd->policy)) {
+          cd->commanded[0] = target_fan;
+          cd->writes++;
+          printf("+%.3fs %d:%.1f%c%s -> %u%%\n", ms[f] / 1000.0, cd->id,
+                 convert_temperature(temp, args->temp_unit), args->temp_unit, sensor_label,
+                 target_fan);
+        } else {
+          cd->writes_elided++;
         }
 
-        if (num_fans == 0) {
-          fprintf(stderr, "%d:Error: Device has no controllable fans\n", device_id);
-          error_count++;
-          continue;
+        if (st->samples++ > 0 && args->policy.target_set && temp > args->policy.pid.target)
+          st->above_target_ms += ms[f] - st->last_ms;
+        if (st->samples == 1) st->first_ms = ms[f];
+        st->last_ms = ms[f];
+        st->temp_sum += convert_temperature(temp, args->temp_unit);
+        if (temp > st->temp_max) st->temp_max = temp;
+        st->fan_sum += target_fan;
+        if (target_fan > st->fan_max) st->fan_max = target_fan;
+        if (s->valid & TLOG_VALID(TLOG_FAN)) {
+          st->recorded_fan_sum += s->value[TLOG_FAN];
+          st->recorded_fan_samples++;
         }
+        total++;
+      }
+    }
+  }
+  if (frames < 0) {
+    fprintf(stderr, "Error: %s: Corrupt block at offset %zu\n", args->log_path, log.offset);
+    errors++;
+  }
+  double elapsed_s = (monotonic_ns() - replay_start) / 1e9;
+
+  uint64_t span_ms = 0;
+  for (int i = 0; i < controlled_device_count; i++)
+    if (stats[i].samples && stats[i].last_ms - stats[i].first_ms > span_ms)
+      span_ms = stats[i].last_ms - stats[i].first_ms;
+  printf("Replayed %lu sample(s) covering %.1f s in %.3f s (%.0fx real time)\n", total,
+         span_ms / 1000.0, elapsed_s, elapsed_s > 0 ? span_ms / 1000.0 / elapsed_s : 0.0);
+  for (int i = 0; i < controlled_device_count; i++) {
+    const replay_stats_t* st = &stats[i];
+    const controlled_device_t* cd = &controlled[i];
+    if (st->samples == 0) {
+      printf("%d: No samples\n", cd->id);
+      continue;
+    }
+    printf("%d: Temp mean %.1f%c max %.1f%c, fan mean %.1f%% max %u%%", cd->id,
+           st->temp_sum / st->samples, args->temp_unit,
+           convert_temperature(st->temp_max, args->temp_unit), args->temp_unit,
+           st->fan_sum / st->samples, st->fan_max);
+    if (st->recorded_fan_samples)
+      printf(" (recorded %.1f%%)", st->recorded_fan_sum / st->recorded_fan_samples);
+    printf(", %lu write(s), %lu elided", cd->writes, cd->writes_elided);
+    if (args->policy.target_set)
+      printf(", %.1f s above %g C", st->above_target_ms / 1000.0, args->policy.pid.target);
+    printf("\n");
+  }
 
-        if (args.subcommand == SUBCMD_SET && args.set_value > 100) {
-          fprintf(stderr, "%d:Error: Fan speed must be between 0-100%%\n", device_id);
-          error_count++;
+  free(slot);
+  free(stats);
+  free(samples);
+  tlog_close_reader(&log);
+  return errors > 0 || total == 0;
+}
+
+// Build the rollups of a log that has none, e.g. after they were deleted
+static int build_rollups(tlog_reader_t* log, const char* path) {
+  int count = log->header->device_count;
+  tlog_sample_t* samples = malloc(sizeof(tlog_sample_t) * TLOG_BLOCK_FRAMES * count);
+  uint64_t ms[TLOG_BLOCK_FRAMES];
+  rollup_writer_t w;
+  if (!samples || rollup_create(&w, path, count, log->header->start_realtime_ns) != 0) {
+    free(samples);
+    return -1;
+  }
+
+  int frames, rc = 0;
+  while (rc == 0 && (frames = tlog_read_block(log, ms, samples)) > 0)
+    for (int f = 0; f < frames && rc == 0; f++) rc = rollup_add(&w, ms[f], &samples[f * count]);
+  if (rc == 0 && frames < 0) {
+    fprintf(stderr, "Error: %s: Corrupt block at offset %zu\n", path, log->offset);
+    rc = -1;
+  }
+  free(samples);
+  if (rollup_close(&w) != 0) rc = -1;
+  return rc;
+}
+
+static const struct {
+  const char* key;
+  double scale; // Stored units per output unit
+  int precision;
+  int temperature;
+} query_columns[TLOG_COLUMNS] = {
+    [TLOG_TEMP] = {"temperature", 1, 1, 1},
+    [TLOG_VRAM_TEMP] = {"vram_temperature", 1, 1, 1},
+    [TLOG_FAN] = {"fan_speed_percent", 1, 1, 0},
+    [TLOG_POWER] = {"power_usage_watts", 1000, 2, 0},
+    [TLOG_POWER_LIMIT] = {"power_limit_watts", 1000, 2, 0},
+    [TLOG_MEMORY_USED] = {"memory_used_mb", 1, 1, 0},
+};
+
+static double query_value(int column, double value, char temp_unit) {
+  value /= query_columns[column].scale;
+  return query_columns[column].temperature ? convert_temperature(value, temp_unit) : value;
+}
+
+// query: min/max/mean/p95 of every recorded reading of the selected devices over a window of a
+// log, answered from its rollups in the info json style
+static int run_query(const cli_args_t* args) {
+  tlog_reader_t log;
+  if (tlog_open(&log, args->log_path) != 0) return 1;
+  const tlog_header_t* h = log.header;
+  int count = h->device_count;
+
+  rollup_reader_t rollups;
+  if (rollup_open(&rollups, args->log_path) != 0) {
+    if (errno != ENOENT) {
+      fprintf(stderr, "Error: Rollups of %s are not readable\n", args->log_path);
+      tlog_close_reader(&log);
+      return 1;
+    }
+    fprintf(stderr, "Building rollups for %s\n", args->log_path);
+    if (build_rollups(&log, args->log_path) != 0 ||
+        rollup_open(&rollups, args->log_path) != 0) {
+      tlog_close_reader(&log);
+      return 1;
+    }
+  }
+  if (rollups.device_count != count || rollups.start_realtime_ns != h->start_realtime_ns) {
+    fprintf(stderr, "Error: Rollups of %s belong to another recording\n", args->log_path);
+    rollup_close_reader(&rollups);
+    tlog_close_reader(&log);
+    return 1;
+  }
+
+  // Window in ms from the start of the log, within the rolled-up data
+  double start_s = h->start_realtime_ns / 1e9;
+  uint64_t end_ms = rollup_end_ms(&rollups);
+  uint64_t from_ms = 0, to_ms = end_ms;
+  if (args->from_s) from_ms = args->from_s > start_s ? (args->from_s - start_s) * 1000 : 0;
+  if (args->to_s) to_ms = args->to_s > start_s ? (args->to_s - start_s) * 1000 : 0;
+  if (to_ms > end_ms) to_ms = end_ms;
+  if (args->last_s) from_ms = to_ms > args->last_s * 1000ULL ? to_ms - args->last_s * 1000ULL : 0;
+  // Whole buckets of the finest level
+  uint64_t step = rollup_period_ms[0];
+  from_ms = from_ms / step * step;
+  to_ms = (to_ms + step - 1) / step * step;
+  if (from_ms >= to_ms) {
+    fprintf(stderr, "Error: The window holds no samples (%s covers %.0f to %.0f)\n",
+            args->log_path, start_s, start_s + end_ms / 1000.0);
+    rollup_close_reader(&rollups);
+    tlog_close_reader(&log);
+    return 1;
+  }
+
+  rollup_acc_t* acc = calloc(count * TLOG_COLUMNS, sizeof(rollup_acc_t));
+  long reads = acc ? rollup_query(&rollups, from_ms, to_ms, acc) : -1;
+  if (reads < 0) fprintf(stderr, "Error: Out of memory\n");
+
+  int printed = 0;
+  if (reads >= 0) {
+    printf("[\n");
+    for (int d = 0; d < count; d++) {
+      const tlog_device_t* dev = &log.devices[d];
+      if (args->use_uuid ? strncmp(dev->uuid, args->uuid, sizeof(dev->uuid)) != 0
+                         : !shm_device_selected(args, dev->device_id))
+        continue;
+      if (printed++) printf(",\n");
+
+      rollup_acc_t* a = &acc[d * TLOG_COLUMNS];
+      uint32_t samples = 0;
+      for (int c = 0; c < TLOG_COLUMNS; c++)
+        if (a[c].count > samples) samples = a[c].count;
+      printf("  {\n");
+      printf("    \"device_id\": %d,\n", dev->device_id);
+      printf("    \"name\": \"%.*s\",\n", (int)sizeof(dev->name), dev->name);
+      printf("    \"uuid\": \"%.*s\",\n", (int)sizeof(dev->uuid), dev->uuid);
+      printf("    \"window_start\": %.3f,\n", start_s + from_ms / 1000.0);
+      printf("    \"window_end\": %.3f,\n", start_s + to_ms / 1000.0);
+      printf("    \"samples\": %u,\n", samples);
+      printf("    \"temperature_unit\": \"%c\",\n", args->temp_unit);
+      for (int c = 0; c < TLOG_COLUMNS; c++) {
+        const char* sep = c == TLOG_COLUMNS - 1 ? "" : ",";
+        int p = query_columns[c].precision;
+        if (a[c].count == 0) {
+          printf("    \"%s\": null%s\n", query_columns[c].key, sep);
           continue;
         }
+        printf("    \"%s\": {\"min\": %.*f, \"max\": %.*f, \"mean\": %.*f, \"p95\": %.*f}%s\n",
+               query_columns[c].key, p, query_value(c, a[c].min, args->temp_unit), p,
+               query_value(c, a[c].max, args->temp_unit), p,
+               query_value(c, (double)a[c].sum / a[c].count, args->temp_unit), p,
+               query_value(c, rollup_acc_quantile(&a[c], 0.95), args->temp_unit), sep);
+      }
+      printf("  }");
+    }
+    printf("%s]\n", printed ? "\n" : "");
+  }
 
-        int fan_errors = 0;
-        for (unsigned int fan = 0; fan < num_fans; fan++) {
-          if (args.subcommand == SUBCMD_SET) {
-            result = nvmlDeviceSetFanSpeed_v2(device, fan, args.set_value);
-            if (result == NVML_SUCCESS)
-              printf("%d:Fan%u:Set to %u%%\n", device_id, fan, args.set_value);
-          } else {
-            result = nvmlDeviceSetFanControlPolicy(device, fan,
-                                                   NVML_FAN_POLICY_TEMPERATURE_CONTINOUS_SW);
-            if (result == NVML_SUCCESS)
-              printf("%d:Fan%u:Restored to automatic control\n", device_id, fan);
-          }
+  if (acc)
+    for (int i = 0; i < count * TLOG_COLUMNS; i++) rollup_acc_free(&acc[i]);
+  free(acc);
+  rollup_close_reader(&rollups);
+  tlog_close_reader(&log);
+  return reads < 0 || printed == 0;
+}
 
-          if (result != NVML_SUCCESS) {
-            fprintf(stderr, "%d:Fan%u:Error: %s\n", device_id, fan, nvmlErrorString(result));
-            fan_errors++;
-          }
-        }
+// Commands whose per-device work is independent and can run under -j
+static int is_device_query(command_t command) {
+  return command == CMD_INFO || command == CMD_POWER || command == CMD_FAN ||
+         command == CMD_TEMP || command == CMD_STATUS || command == CMD_LIST;
+}
 
-        if (fan_errors > 0) {
-          error_count++;
-        } else if (args.subcommand == SUBCMD_SET) {
-          printf("%d:Warning: Fan control is now MANUAL - monitor temperatures!\n", device_id);
-          printf("%d:Note: Use 'nvml-tool fan restore -d %d' to restore automatic control\n",
-                 device_id, device_id);
+typedef struct {
+  const cli_args_t* args;
+  const int* targets;
+  int target_count;
+  unsigned int device_count;
+  const topology_device_t* topo;
+} device_query_t;
+
+// Query one device for info/power/fan/temp/status/list, or restore its fans. Runs on a fanout
+// worker, so all output goes to out/err. Returns the number of errors.
+static int run_device_query(int index, FILE* out, FILE* err, void* ctx) {
+  const device_query_t* q = ctx;
+  const cli_args_t* args = q->args;
+  int device_id = q->targets[index];
+  int errors = 0;
+  nvmlReturn_t result;
+
+  if (device_id >= (int)q->device_count) {
+    fprintf(err, "Error: Device ID %d not found (available: 0-%d)\n", device_id,
+            q->device_count - 1);
+    return 1;
+  }
+
+  // list needs nothing that is not cached, so it does not even look up handles
+  if (args->command == CMD_LIST && q->topo && q->topo[device_id].status == NVML_SUCCESS) {
+    fprintf(out, "%d:%s %s\n", device_id, q->topo[device_id].uuid, q->topo[device_id].name);
+    return 0;
+  }
+
+  nvmlDevice_t device;
+  result = gpu->get_handle_by_index(device_id, &device);
+  if (result != NVML_SUCCESS) {
+    fprintf(err, "Error: Failed to get device handle for device %d (%s)\n", device_id,
+            gpu->error_string(result));
+    return 1;
+  }
+
+  switch (args->command) {
+  case CMD_INFO: {
+    telemetry_t t;
+    telemetry_read(device, TM_ALL, &t);
+    if (args->subcommand == SUBCMD_JSON)
+      print_device_info_json(out, &t, device_id, args->temp_unit);
+    else
+      print_device_info_human(out, &t, device_id, args->temp_unit);
+  } break;
+
+  case CMD_POWER: print_power_cli(out, err, device, device_id); break;
+
+  case CMD_FAN:
+    if (args->subcommand == SUBCMD_RESTORE) {
+      unsigned int num_fans = 0;
+      result = gpu->get_num_fans(device, &num_fans);
+      if (result != NVML_SUCCESS) {
+        fprintf(err, "%d:Error: Cannot get number of fans (%s)\n", device_id,
+                gpu->error_string(result));
+        return 1;
+      }
+
+      if (num_fans == 0) {
+        fprintf(err, "%d:Error: Device has no controllable fans\n", device_id);
+        return 1;
+      }
+
+      int fan_errors = 0;
+      for (unsigned int fan = 0; fan < num_fans; fan++) {
+        result =
+            gpu->set_fan_control_policy(device, fan, NVML_FAN_POLICY_TEMPERATURE_CONTINOUS_SW);
+        if (result == NVML_SUCCESS) {
+          fprintf(out, "%d:Fan%u:Restored to automatic control\n", device_id, fan);
         } else {
-          printf("%d:All fans restored to automatic temperature-based control\n", device_id);
+          fprintf(err, "%d:Fan%u:Error: %s\n", device_id, fan, gpu->error_string(result));
+          fan_errors++;
         }
+      }
+
+      if (fan_errors > 0)
+        errors++;
+      else
+        fprintf(out, "%d:All fans restored to automatic temperature-based control\n", device_id);
+    } else {
+      print_fan_cli(out, err, device, device_id);
+    }
+    break;
+
+  case CMD_TEMP: print_temp_cli(out, err, device, device_id, args->temp_unit); break;
+
+  case CMD_STATUS: {
+    telemetry_t t;
+    telemetry_read(device, TM_TEMP | TM_FAN | TM_POWER, &t);
+    print_status_cli(out, &t, device_id, args->temp_unit);
+  } break;
+
+  case CMD_LIST: {
+    char uuid[NVML_DEVICE_UUID_BUFFER_SIZE];
+    char name[NVML_DEVICE_NAME_BUFFER_SIZE];
+
+    gpu->get_uuid(device, uuid, sizeof(uuid));
+    gpu->get_name(device, name, sizeof(name));
+
+    fprintf(out, "%d:%s %s\n", device_id, uuid, name);
+  } break;
+
+
+  default: break;
+  }
+  return errors;
+}
+
+// Answer info/status/temp/list through the daemon, printing exactly what the direct path would.
+// Returns the exit status (1 if the daemon refused the query), or -1 if no daemon answered.
+static int run_daemon_query(const cli_args_t* args) {
+  static daemon_record_t records[MAX_DEVICES];
+  unsigned int want = TM_ALL;
+  switch (args->command) {
+  case CMD_STATUS: want = TM_TEMP | TM_FAN | TM_POWER; break;
+  case CMD_TEMP: want = TM_TEMP; break;
+  case CMD_LIST: want = TM_NAME | TM_UUID; break;
+  default: break;
+  }
+
+  daemon_response_t resp;
+  const char* uuid = args->use_uuid ? args->uuid : NULL;
+  int rc = daemon_query(daemon_socket_path(args->socket_path), want, args->devices,
+                        args->all_devices ? 0 : args->device_count, uuid, &resp, records,
+                        MAX_DEVICES);
+  if (rc != 0) return rc < 0 ? -1 : 1;
+
+  if (resp.device_count == 0) {
+    fprintf(stderr, "No NVIDIA GPUs found\n");
+    return 1;
+  }
+  if (resp.count < 0) {
+    fprintf(stderr, "Error: Device with UUID '%s' not found\n", args->uuid);
+    return 1;
+  }
+
+  int error_count = 0, printed = 0;
+  int json = args->command == CMD_INFO && args->subcommand == SUBCMD_JSON;
+  if (json) printf("[\n");
+  for (int i = 0; i < resp.count; i++) {
+    const daemon_record_t* rec = &records[i];
+    const telemetry_t* t = &rec->telemetry;
+
+    if (rec->device_id < 0 || (unsigned int)rec->device_id >= resp.device_count) {
+      fprintf(stderr, "Error: Device ID %d not found (available: 0-%d)\n", rec->device_id,
+              resp.device_count - 1);
+      error_count++;
+      continue;
+    }
+    if (rec->status != NVML_SUCCESS) {
+      fprintf(stderr, "Error: Failed to get device handle for device %d (%s)\n", rec->device_id,
+              gpu->error_string(rec->status));
+      error_count++;
+      continue;
+    }
+
+    switch (args->command) {
+    case CMD_INFO:
+      if (json) {
+        if (printed++) printf(",\n"); // Failed records print nothing here
+        print_device_info_json(stdout, t, rec->device_id, args->temp_unit);
       } else {
-        print_fan_cli(device, device_id);
+        print_device_info_human(stdout, t, rec->device_id, args->temp_unit);
       }
       break;
+    case CMD_STATUS: print_status_cli(stdout, t, rec->device_id, args->temp_unit); break;
+    case CMD_TEMP:
+      if (rec->temp_status == NVML_SUCCESS)
+        printf("%d:%.1f\n", rec->device_id, convert_temperature(t->temperature, args->temp_unit));
+      else
+        fprintf(stderr, "%d:Error: %s\n", rec->device_id, gpu->error_string(rec->temp_status));
+      break;
+    case CMD_LIST: printf("%d:%s %s\n", rec->device_id, t->uuid, t->name); break;
+    default: break;
+    }
+  }
+  if (json) printf("%s]\n", printed ? "\n" : "");
 
-    case CMD_TEMP: print_temp_cli(device, device_id, args.temp_unit); break;
+  return !!error_count;
+}
 
-    case CMD_VRAMTEMP: print_vram_temp_cli(device, device_id); break;
+static int parse_args(int argc, char* argv[], cli_args_t* args) {
+  memset(args, 0, sizeof(cli_args_t));
+  args->temp_unit = 'C';
+  args->all_devices = 1;
+  args->policy.sensor = SENSOR_CORE; // Default to core
+  args->mem_path = MEM_PATH;
+  args->reg_access = REG_ACCESS_MEM;
+  args->sysfs_root = REGS_SYSFS_ROOT;
+  args->interval_ms = DEFAULT_INTERVAL_MS;
+  args->policy.min_interval_ms = DEFAULT_MIN_INTERVAL_MS;
+  args->policy.max_interval_ms = DEFAULT_MAX_INTERVAL_MS;
+  args->policy.deadband = DEFAULT_DEADBAND_PCT;
+  args->policy.hysteresis = DEFAULT_HYSTERESIS_C;
+  args->policy.curve_type = CURVE_LINEAR;
+  args->policy.controller = CONTROLLER_CURVE;
+  args->policy.pid.kp = PID_DEFAULT_KP;
+  args->policy.pid.ki = PID_DEFAULT_KI;
+  args->policy.pid.kd = PID_DEFAULT_KD;
+  args->policy.pid.slew = PID_DEFAULT_SLEW;
+  args->fields = WATCH_DEFAULT_FIELDS;
+  args->max_step_w = POWERCTL_DEFAULT_MAX_STEP_W;
 
-    case CMD_STATUS: print_status_cli(device, device_id, args.temp_unit); break;
+  if (argc < 2) return -1;
+  static const struct {
+    const char* name;
+    command_t cmd;
+  } commands[] = {{"info", CMD_INFO},     {"power", CMD_POWER}, {"fan", CMD_FAN},
+                  {"fanctl", CMD_FANCTL}, {"temp", CMD_TEMP},   {"status", CMD_STATUS},
+                  {"list", CMD_LIST},     {"vramtemp", CMD_VRAMTEMP},
+                  {"profile", CMD_PROFILE}, {"watch", CMD_WATCH},
+                  {"export", CMD_EXPORT},   {"publish", CMD_PUBLISH},
+                  {"shm-read", CMD_SHM_READ}, {"daemon", CMD_DAEMON},
+                  {"powerctl", CMD_POWERCTL}, {"record", CMD_RECORD},
+                  {"replay", CMD_REPLAY}, {"query", CMD_QUERY}}; // Add here
 
-    case CMD_LIST: {
-      char uuid[NVML_DEVICE_UUID_BUFFER_SIZE];
-      char name[NVML_DEVICE_NAME_BUFFER_SIZE];
+  args->command = CMD_NONE;
+  for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+    if (strcmp(argv[1], commands[i].name) == 0) {
+      args->command = commands[i].cmd;
+      break;
+    }
+  }
+  if (args->command == CMD_NONE) return -1;
 
-      nvmlDeviceGetUUID(device, uuid, sizeof(uuid));
-      nvmlDeviceGetName(device, name, sizeof(name));
+  // Check for subcommand or fanctl setpoints
+  int start_idx = 2;
+  if (args->command == CMD_RECORD || args->command == CMD_REPLAY || args->command == CMD_QUERY) {
+    if (argc < 3 || argv[2][0] == '-') {
+      fprintf(stderr, "Error: '%s' requires a log file\n", argv[1]);
+      return -1;
+    }
+    args->log_path = argv[2];
+    start_idx = 3;
+  }
+  if (args->command == CMD_FANCTL || args->command == CMD_REPLAY) {
+    int first = start_idx;
+    // fanctl --config may leave the setpoints to the file; that is checked once options are in
+    if (first < argc && argv[first][0] != '-') {
+      args->policy.setpoint_count =
+          parse_setpoints(argc, argv, first, args->policy.setpoints, CURVE_MAX_SETPOINTS);
+      if (args->policy.setpoint_count < 0) return -1;
+    }
 
-      printf("%d:%s %s\n", device_id, uuid, name);
+    for (int i = first; i < argc; i++) {
+      if (argv[i][0] == '-') {
+        start_idx = i;
+        break;
+      }
+      if (i == argc - 1) start_idx = argc;
+    }
+  } else if (args->command == CMD_RECORD || args->command == CMD_QUERY) {
+    // Only the log path, taken above
+  } else if (args->command == CMD_POWERCTL) {
+    char* end;
+    long budget = argc > 2 ? strtol(argv[2], &end, 10) : 0;
+    if (argc < 3 || end == argv[2] || *end || budget < 1 || budget > UINT_MAX / 1000) {
+      fprintf(stderr, "Error: 'powerctl' requires a budget in watts\n");
+      return -1;
+    }
+    args->budget_w = budget;
+    start_idx = 3;
+  } else if (argc > 2 && strcmp(argv[2], "set") == 0) {
+    args->subcommand = SUBCMD_SET;
+    if (argc > 3) {
+      args->set_value = atoi(argv[3]);
+      start_idx = 4;
+    } else {
+      fprintf(stderr, "Error: 'set' requires a value\n");
+      return -1;
+    }
+  } else if (argc > 2 && strcmp(argv[2], "restore") == 0) {
+    args->subcommand = SUBCMD_RESTORE;
+    start_idx = 3;
+  } else if (argc > 2 && strcmp(argv[2], "json") == 0) {
+    args->subcommand = SUBCMD_JSON;
+    start_idx = 3;
+  } else if (argc > 2 && strcmp(argv[2], "csv") == 0) {
+    args->subcommand = SUBCMD_CSV;
+    start_idx = 3;
+  }
+
+  static struct option long_options[] = {{"device", required_argument, 0, 'd'},
+                                         {"uuid", required_argument, 0, 'u'},
+                                         {"sensor", required_argument, 0, 's'}, // Added sensor
+                                         {"temp-unit", required_argument, 0, 't'},
+                                         {"mem-path", required_argument, 0, 'M'},
+                                         {"reg-access", required_argument, 0, 'R'},
+                                         {"sysfs-root", required_argument, 0, 'Y'},
+                                         {"interval", required_argument, 0, 'i'},
+                                         {"min-interval", required_argument, 0, 'm'},
+                                         {"max-interval", required_argument, 0, 'x'},
+                                         {"deadband", required_argument, 0, 'D'},
+                                         {"hysteresis", required_argument, 0, 'H'},
+                                         {"count", required_argument, 0, 'n'},
+                                         {"duration", required_argument, 0, 'T'},
+                                         {"fields", required_argument, 0, 'f'},
+                                         {"listen", required_argument, 0, 'l'},
+                                         {"shm", required_argument, 0, 'S'},
+                                         {"curve", required_argument, 0, 'C'},
+                                         {"controller", required_argument, 0, 'P'},
+                                         {"target", required_argument, 0, 'G'},
+                                         {"pid", required_argument, 0, 'I'},
+                                         {"feed-forward", required_argument, 0, 'F'},
+                                         {"slew", required_argument, 0, 'W'},
+                                         {"dashboard", no_argument, 0, 'B'},
+                                         {"config", required_argument, 0, 'c'},
+                                         {"max-step", required_argument, 0, 'Z'},
+                                         {"from", required_argument, 0, 'A'},
+                                         {"to", required_argument, 0, 'E'},
+                                         {"last", required_argument, 0, 'L'},
+                                         {"socket", required_argument, 0, 'K'},
+                                         {"direct", no_argument, 0, 'X'},
+                                         {"jobs", required_argument, 0, 'j'},
+                                         {"help", no_argument, 0, 'h'},
+                                         {0, 0, 0, 0}};
+
+  int opt;
+  optind = start_idx;
+  while ((opt = getopt_long(argc, argv, "d:u:s:i:n:f:l:t:j:h", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'd':
+      args->device_count = parse_device_range(optarg, args->devices, MAX_DEVICES);
+      args->all_devices = 0;
+      break;
+    case 'u':
+      strncpy(args->uuid, optarg, sizeof(args->uuid) - 1);
+      args->use_uuid = 1;
+      args->all_devices = 0;
+      break;
+    case 's': // Handle sensor selection
+      if (strcmp(optarg, "core") == 0) {
+        args->policy.sensor = SENSOR_CORE;
+      } else if (strcmp(optarg, "vram") == 0) {
+        args->policy.sensor = SENSOR_VRAM;
+      } else if (strcmp(optarg, "hotspot") == 0) {
+        args->policy.sensor = SENSOR_HOTSPOT;
+      } else {
+        fprintf(stderr, "Error: Invalid sensor '%s'. Use 'core', 'vram' or 'hotspot'.\n",
+                optarg);
+        return -1;
+      }
+      break;
+    case 'M': args->mem_path = optarg; break;
+    case 'R':
+      if (strcmp(optarg, "mem") == 0) {
+        args->reg_access = REG_ACCESS_MEM;
+      } else if (strcmp(optarg, "sysfs") == 0) {
+        args->reg_access = REG_ACCESS_SYSFS;
+      } else {
+        fprintf(stderr, "Error: Invalid register access '%s'. Use 'mem' or 'sysfs'.\n", optarg);
+        return -1;
+      }
+      break;
+    case 'Y': args->sysfs_root = optarg; break;
+    case 'i': {
+      int interval = atoi(optarg);
+      if (interval < MIN_INTERVAL_MS) {
+        fprintf(stderr, "Error: Interval must be at least %d ms\n", MIN_INTERVAL_MS);
+        return -1;
+      }
+      args->interval_ms = interval;
+      args->interval_set = 1;
+    } break;
+    case 'm':
+    case 'x': {
+      int interval = atoi(optarg);
+      if (interval < MIN_INTERVAL_MS) {
+        fprintf(stderr, "Error: Interval must be at least %d ms\n", MIN_INTERVAL_MS);
+        return -1;
+      }
+      if (opt == 'm')
+        args->policy.min_interval_ms = interval;
+      else
+        args->policy.max_interval_ms = interval;
+    } break;
+    case 'n':
+      args->count = atoi(optarg);
+      if (args->count < 1) {
+        fprintf(stderr, "Error: Count must be at least 1\n");
+        return -1;
+      }
+      break;
+    case 'T': {
+      int duration = atoi(optarg);
+      if (duration < 1) {
+        fprintf(stderr, "Error: Duration must be at least 1 second\n");
+        return -1;
+      }
+      args->duration_s = duration;
+    } break;
+    case 'l': args->listen = optarg; break;
+    case 'S': args->shm_name = optarg; break;
+    case 'K': args->socket_path = optarg; break;
+    case 'j':
+      if (strcmp(optarg, "auto") == 0) {
+        args->jobs = 0;
+      } else {
+        args->jobs = atoi(optarg);
+        if (args->jobs < 1 || args->jobs > FANOUT_MAX_JOBS) {
+          fprintf(stderr, "Error: Jobs must be 'auto' or 1-%d\n", FANOUT_MAX_JOBS);
+          return -1;
+        }
+      }
+      break;
+    case 'X': args->direct = 1; break;
+    case 'B': args->dashboard = 1; break;
+    case 'c': args->config_path = optarg; break;
+    case 'Z': {
+      int step = atoi(optarg);
+      if (step < 0) {
+        fprintf(stderr, "Error: Invalid max-step '%s'\n", optarg);
+        return -1;
+      }
+      args->max_step_w = step;
     } break;
+    case 'A':
+    case 'E':
+      if (parse_time(optarg, opt == 'A' ? &args->from_s : &args->to_s) != 0) {
+        fprintf(stderr, "Error: Invalid time '%s'. Use Unix seconds or YYYY-MM-DD HH:MM[:SS].\n",
+                optarg);
+        return -1;
+      }
+      break;
+    case 'L':
+      if (parse_duration(optarg, &args->last_s) != 0) {
+        fprintf(stderr, "Error: Invalid duration '%s'. Use N[s|m|h|d].\n", optarg);
+        return -1;
+      }
+      break;
+    case 'C':
+      if (curve_parse_type(optarg, &args->policy.curve_type) != 0) {
+        fprintf(stderr, "Error: Invalid curve '%s'. Use 'linear', 'cubic' or 'step'.\n", optarg);
+        return -1;
+      }
+      break;
+    case 'P':
+      if (strcmp(optarg, "curve") == 0) {
+        args->policy.controller = CONTROLLER_CURVE;
+      } else if (strcmp(optarg, "pid") == 0) {
+        args->policy.controller = CONTROLLER_PID;
+      } else {
+        fprintf(stderr, "Error: Invalid controller '%s'. Use 'curve' or 'pid'.\n", optarg);
+        return -1;
+      }
+      break;
+    case 'I':
+      if (pid_parse_gains(optarg, &args->policy.pid) != 0) {
+        fprintf(stderr, "Error: Invalid PID gains '%s'. Use KP,KI,KD.\n", optarg);
+        return -1;
+      }
+      break;
+    case 'G':
+    case 'F':
+    case 'W': {
+      char* end;
+      double value = strtod(optarg, &end);
+      double limit = opt == 'G' ? CURVE_MAX_TEMP_C : 100.0;
+      // The negated comparison also rejects NaN
+      if (end == optarg || *end || !(value >= 0 && value < limit)) {
+        fprintf(stderr, "Error: Invalid %s '%s'\n",
+                opt == 'G' ? "target" : opt == 'F' ? "feed-forward" : "slew", optarg);
+        return -1;
+      }
+      if (opt == 'G') {
+        args->policy.pid.target = value;
+        args->policy.target_set = 1;
+      } else if (opt == 'F') {
+        args->policy.pid.feed_forward = value;
+      } else {
+        args->policy.pid.slew = value;
+      }
+    } break;
+    case 'f':
+      args->fields = watch_parse_fields(optarg);
+      if (!args->fields) return -1;
+      break;
+    case 'D':
+    case 'H': {
+      int value = atoi(optarg);
+      if (value < 0 || value > 100) {
+        fprintf(stderr, "Error: Invalid %s '%s'\n", opt == 'D' ? "deadband" : "hysteresis",
+                optarg);
+        return -1;
+      }
+      if (opt == 'D')
+        args->policy.deadband = value;
+      else
+        args->policy.hysteresis = value;
+    } break;
+    case 't':
+      args->temp_unit = 0;
+      if (!strcmp(optarg, "C")) args->temp_unit = 'C';
+      if (!strcmp(optarg, "F")) args->temp_unit = 'F';
+      if (!strcmp(optarg, "K")) args->temp_unit = 'K';
+      if (!args->temp_unit) {
+        fprintf(stderr, "Error: Invalid temperature unit '%s'\n", optarg);
+        return -1;
+      }
+      break;
+    default: return -1;
+    }
+  }
 
-    case CMD_FANCTL: {
-      unsigned int num_fans = 0;
-      result = nvmlDeviceGetNumFans(device, &num_fans);
-      if (result != NVML_SUCCESS || num_fans == 0) {
-        fprintf(stderr, "%d:Error: Device has no controllable fans\n", device_id);
+  if (args->command == CMD_EXPORT && !args->listen) args->listen = DEFAULT_EXPORT_LISTEN;
+  if (args->policy.min_interval_ms > args->policy.max_interval_ms) {
+    fprintf(stderr, "Error: --min-interval must not exceed --max-interval\n");
+    return -1;
+  }
+  if (args->interval_set)
+    args->policy.min_interval_ms = args->policy.max_interval_ms = args->interval_ms;
+  if (args->policy.controller == CONTROLLER_PID && !args->policy.target_set &&
+      !args->config_path) {
+    fprintf(stderr, "Error: --controller pid requires --target\n");
+    return -1;
+  }
+  if (args->policy.sensor == SENSOR_HOTSPOT &&
+      (args->command == CMD_RECORD || args->command == CMD_REPLAY)) {
+    fprintf(stderr, "Error: Logs hold core and VRAM temperatures; use -s core or -s vram\n");
+    return -1;
+  }
+
+  // Sample the curve once so the control loop only does a table lookup
+  if (args->command == CMD_FANCTL || args->command == CMD_REPLAY) {
+    fan_policy_t* p = &args->policy;
+    if (p->setpoint_count == 0 && !(args->command == CMD_FANCTL && args->config_path)) {
+      fprintf(stderr, "Error: No valid setpoints provided\n");
+      return -1;
+    }
+    if (p->setpoint_count > 0 &&
+        curve_compile(&p->curve, p->curve_type, p->setpoints, p->setpoint_count) != 0)
+      return -1;
+  }
+
+  if ((args->command == CMD_PUBLISH || args->command == CMD_SHM_READ) && !args->shm_name)
+    args->shm_name = NVML_TOOL_SHM_DEFAULT_NAME;
+
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  nvmlReturn_t result;
+  cli_args_t args;
+  unsigned int device_count;
+
+  if (parse_args(argc, argv, &args) != 0) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  // Readers of the shared-memory segment never touch NVML
+  if (args.command == CMD_SHM_READ) return run_shm_read(&args);
+  if (args.command == CMD_REPLAY) return run_replay(&args);
+  if (args.command == CMD_QUERY) return run_query(&args);
+
+  if (gpu_backend_select() != 0) return 1;
+
+  // Read-only queries are answered by a running daemon when there is one, skipping NVML init
+  if (!args.direct && args.subcommand != SUBCMD_SET && args.subcommand != SUBCMD_RESTORE &&
+      (args.command == CMD_INFO || args.command == CMD_STATUS || args.command == CMD_TEMP ||
+       args.command == CMD_LIST)) {
+    int rc = run_daemon_query(&args);
+    if (rc >= 0) return rc;
+  }
+
+  profile_setup_t setup = {0};
+  uint64_t init_start = monotonic_ns();
+  result = gpu->init();
+  setup.init_ns = monotonic_ns() - init_start;
+  if (result != NVML_SUCCESS) {
+    fprintf(stderr, "Error: Failed to initialize NVML (%s)\n", gpu->error_string(result));
+    return 1;
+  }
+
+  result = gpu->get_count(&device_count);
+  if (result != NVML_SUCCESS) {
+    fprintf(stderr, "Error: Failed to get device count (%s)\n", gpu->error_string(result));
+    gpu->shutdown();
+    return 1;
+  }
+
+  if (device_count == 0) {
+    fprintf(stderr, "No NVIDIA GPUs found\n");
+    gpu->shutdown();
+    return 1;
+  }
+
+  if (args.command == CMD_DAEMON) {
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
+    signal(SIGPIPE, SIG_IGN);
+    int rc = run_daemon(daemon_socket_path(args.socket_path), &running);
+    gpu->shutdown();
+    return rc != 0;
+  }
+
+  // Handle UUID selection
+  if (args.use_uuid) {
+    int device_id = find_device_by_uuid(args.uuid, device_count);
+    if (device_id < 0) {
+      fprintf(stderr, "Error: Device with UUID '%s' not found\n", args.uuid);
+      gpu->shutdown();
+      return 1;
+    }
+    args.devices[0] = device_id;
+    args.device_count = 1;
+    args.all_devices = 0;
+  }
+
+  // Setup device list
+  static int all_devs[MAX_DEVICES];
+  int* target_devices = args.devices;
+  int target_count = args.device_count;
+
+  if (args.all_devices) {
+    for (unsigned int i = 0; i < device_count && i < MAX_DEVICES; i++) all_devs[i] = i;
+    target_devices = all_devs;
+    target_count = device_count < MAX_DEVICES ? device_count : MAX_DEVICES;
+  }
+
+  // Devices collected for watch/export/publish/powerctl/record, which run after the loop
+  static nvmlDevice_t selected_devices[MAX_DEVICES];
+  static int selected_ids[MAX_DEVICES];
+  static vram_sensor_t* selected_sensors[MAX_DEVICES];
+  int selected_count = 0;
+
+  // JSON output header. Objects are joined as they are written in device order, so devices
+  // that fail leave no dangling separator.
+  int info_json = args.subcommand == SUBCMD_JSON && args.command == CMD_INFO;
+  int info_printed = 0;
+  if (info_json) printf("[\n");
+
+  if (args.command == CMD_PROFILE) {
+    uint64_t scan_start = monotonic_ns();
+    if (init_pci() == 0) setup.pci_scan_ns = monotonic_ns() - scan_start;
+    if (!args.count) args.count = DEFAULT_PROFILE_ITERATIONS;
+    profile_print_header(&setup, args.count, args.subcommand == SUBCMD_JSON);
+  }
+
+  // Static per-device facts for list and VRAM setup, NULL if the cache is unavailable. Building
+  // the cache scans the PCI bus for BAR0, which register access through sysfs does not need.
+  const topology_device_t* topo = NULL;
+  int reg_setup = args.command == CMD_VRAMTEMP ||
+                  (args.command == CMD_FANCTL &&
+                   (args.policy.sensor != SENSOR_CORE || args.dashboard || args.config_path)) ||
+                  (args.command == CMD_RECORD && args.policy.sensor == SENSOR_VRAM);
+  if (args.command == CMD_LIST || (reg_setup && args.reg_access == REG_ACCESS_MEM))
+    topo = topology_get(device_count);
+
+  // Execute command for each device. Independent queries and sets fan out over -j workers with
+  // output kept in device order; everything else runs here in sequence.
+  int error_count = 0;
+  if ((args.command == CMD_POWER || args.command == CMD_FAN) && args.subcommand == SUBCMD_SET) {
+    apply_kind_t kind = args.command == CMD_POWER ? APPLY_POWER_LIMIT : APPLY_FAN_SPEED;
+    error_count +=
+        apply_batch(kind, args.set_value, target_devices, target_count, device_count, args.jobs);
+  } else if (is_device_query(args.command)) {
+    device_query_t query = {&args, target_devices, target_count, device_count, topo};
+    if (info_json)
+      error_count += fanout_run_joined(target_count, args.jobs, run_device_query, &query,
+                                       ",\n", &info_printed);
+    else
+      error_count += fanout_run(target_count, args.jobs, run_device_query, &query);
+  } else {
+    for (int i = 0; i < target_count; i++) {
+      int device_id = target_devices[i];
+
+      if (device_id >= (int)device_count) {
+        fprintf(stderr, "Error: Device ID %d not found (available: 0-%d)\n", device_id,
+                device_count - 1);
+        error_count++;
+        continue;
+      }
+
+      nvmlDevice_t device;
+      uint64_t handle_start = monotonic_ns();
+      result = gpu->get_handle_by_index(device_id, &device);
+      uint64_t handle_ns = monotonic_ns() - handle_start;
+      if (result != NVML_SUCCESS) {
+        fprintf(stderr, "Error: Failed to get device handle for device %d (%s)\n", device_id,
+                gpu->error_string(result));
         error_count++;
         continue;
       }
 
-      // Initialize PCI if using VRAM sensor
-      if (args.sensor == SENSOR_VRAM) {
-        if (init_pci() != 0) {
-          fprintf(stderr, "%d:Error: Failed to initialize PCI for VRAM access\n", device_id);
+      switch (args.command) {
+      case CMD_VRAMTEMP:
+        print_vram_temp_cli(device, device_id, topo ? &topo[device_id] : NULL, &args);
+        break;
+
+      case CMD_WATCH:
+      case CMD_POWERCTL:
+      case CMD_EXPORT:
+      case CMD_PUBLISH:
+        selected_devices[selected_count] = device;
+        selected_ids[selected_count++] = device_id;
+        break;
+
+      case CMD_RECORD:
+        if (args.policy.sensor == SENSOR_VRAM) {
+          selected_sensors[selected_count] =
+              open_vram_sensor(device, topo ? &topo[device_id] : NULL, &args);
+          if (!selected_sensors[selected_count]) {
+            fprintf(stderr, "%d:Error: Cannot set up VRAM access for device\n", device_id);
+            error_count++;
+            continue;
+          }
+        }
+        selected_devices[selected_count] = device;
+        selected_ids[selected_count++] = device_id;
+        break;
+
+      case CMD_PROFILE:
+        profile_device(device, device_id, handle_ns, args.count, args.subcommand == SUBCMD_JSON,
+                       i == target_count - 1);
+        break;
+
+      case CMD_FANCTL: {
+        unsigned int num_fans = 0;
+        result = gpu->get_num_fans(device, &num_fans);
+        if (result != NVML_SUCCESS || num_fans == 0) {
+          fprintf(stderr, "%d:Error: Device has no controllable fans\n", device_id);
           error_count++;
           continue;
         }
-        // Verify we can find the device in PCI list
-        if (!find_pci_dev(device)) {
-           fprintf(stderr, "%d:Error: Cannot find device in PCI bus for VRAM access\n", device_id);
-           error_count++;
-           continue;
+
+        // Resolve the VRAM sensor once; the loop then reads the mapped register directly
+        vram_sensor_t* sensor = NULL;
+        if (args.policy.sensor != SENSOR_CORE && !args.config_path) {
+          sensor = open_vram_sensor(device, topo ? &topo[device_id] : NULL, &args);
+          if (!sensor) {
+            fprintf(stderr, "%d:Error: Cannot set up VRAM access for device\n", device_id);
+            error_count++;
+            continue;
+          }
+          if (args.policy.sensor == SENSOR_HOTSPOT &&
+              !sensor->layout->field[REG_HOTSPOT].offset) {
+            fprintf(stderr, "%d:Error: No known hotspot register for this GPU\n", device_id);
+            error_count++;
+            continue;
+          }
+        } else if ((args.dashboard || args.config_path) && geteuid() == 0 &&
+                   (args.reg_access == REG_ACCESS_SYSFS || access(args.mem_path, R_OK) == 0)) {
+          // Best effort: without it the dashboard's VRAM column stays empty, and the config
+          // (now or after a reload) is rejected where it asks for a register sensor
+          sensor = open_vram_sensor(device, topo ? &topo[device_id] : NULL, &args);
         }
-      }
 
-      if (controlled_device_count < MAX_DEVICES) {
-        controlled_devices[controlled_device_count] = device;
-        controlled_device_ids[controlled_device_count] = device_id;
-        controlled_device_count++;
-      }
-    } break;
+        if (controlled_device_count < MAX_DEVICES) {
+          controlled_device_t* cd = &controlled[controlled_device_count++];
+          cd->device = device;
+          cd->id = device_id;
+          cd->sensor = sensor;
+          cd->num_fans = num_fans < MAX_FANS ? num_fans : MAX_FANS;
+          for (int fan = 0; fan < MAX_FANS; fan++) cd->commanded[fan] = -1;
+        }
+      } break;
 
-    default: break;
+      default: break;
+      }
     }
   }
 
   // JSON output footer
-  if (args.subcommand == SUBCMD_JSON && args.command == CMD_INFO) printf("]\n");
+  if (info_json) printf("%s]\n", info_printed ? "\n" : "");
+  if (args.command == CMD_PROFILE) profile_print_footer(args.subcommand == SUBCMD_JSON);
+
+  // With --config every device follows its own policy from the file, starting from the
+  // command-line one
+  static fanconf_device_t conf_devices[MAX_DEVICES];
+  if (args.command == CMD_FANCTL && args.config_path && controlled_device_count > 0 &&
+      error_count == 0) {
+    for (int i = 0; i < controlled_device_count; i++)
+      describe_config_device(&controlled[i], &conf_devices[i]);
+    fan_config =
+        fanconf_load(args.config_path, &args.policy, conf_devices, controlled_device_count);
+    if (!fan_config) error_count++;
+  }
 
   // Handle fanctl main loop
   if (args.command == CMD_FANCTL && controlled_device_count > 0 && error_count == 0) {
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGUSR1, stats_handler);
     atexit(cleanup_pci); // Ensure PCI cleanup on exit
 
     is_terminal = isatty(STDOUT_FILENO);
 
-    const char* sensor_name = (args.sensor == SENSOR_VRAM) ? "VRAM" : "Core";
-    printf("Starting dynamic fan control for %d device(s) using %s temperature (Ctrl-C to exit)\n",
-           controlled_device_count, sensor_name);
-    printf("Setpoints: ");
-    for (int sp = 0; sp < args.setpoint_count; sp++) {
-      printf("%u:%u%%", args.setpoints[sp].temp, args.setpoints[sp].fan);
-      if (sp < args.setpoint_count - 1) printf(" ");
+    for (int i = 0; i < controlled_device_count; i++) {
+      controlled_device_t* cd = &controlled[i];
+      cd->slot = i;
+      cd->policy = fan_config ? fan_config->device[i] : &args.policy;
+      cd->interval_ms = cd->policy->min_interval_ms; // Start fast; adapt_interval() backs off
     }
-    printf("\n");
 
-    if (is_terminal) printf("\n");
-
-    // Main control loop
-    int first_iteration = 1;
-    while (running) {
-      if (is_terminal && !first_iteration) {
-        clear_lines(controlled_device_count);
-      }
-
-      for (int dev_idx = 0; dev_idx < controlled_device_count; dev_idx++) {
-        nvmlDevice_t device = controlled_devices[dev_idx];
-        int device_id = controlled_device_ids[dev_idx];
-        unsigned int current_temp = 0;
-        int temp_result = 0;
-
-        if (args.sensor == SENSOR_VRAM) {
-          temp_result = read_vram_temp(device, &current_temp);
-          if (temp_result != 0) {
-            fprintf(stderr, "%d:Error reading VRAM temp. Falling back to Core temp.\n", device_id);
-            // Fallback to core if VRAM read fails
-            temp_result = nvmlDeviceGetTemperature(device, NVML_TEMPERATURE_GPU, &current_temp);
-            if (temp_result != NVML_SUCCESS) {
-                fprintf(stderr, "%d:Error reading Core temp. Aborting.\n", device_id);
-                running = 0;
-                break;
-            }
-          }
-        } else {
-          temp_result = nvmlDeviceGetTemperature(device, NVML_TEMPERATURE_GPU, &current_temp);
-          if (temp_result != NVML_SUCCESS) {
-            fprintf(stderr, "%d:Error: Cannot read temperature (%s)\n", device_id,
-                    nvmlErrorString(temp_result));
-            running = 0;
-            break;
-          }
-        }
+    if (fan_config) {
+      printf("Starting dynamic fan control for %d device(s) as configured in %s "
+             "(Ctrl-C to exit)\n",
+             controlled_device_count, args.config_path);
+      for (int i = 0; i < controlled_device_count; i++) {
+        char prefix[16];
+        snprintf(prefix, sizeof(prefix), "%d:", controlled[i].id);
+        printf("%sSensor: %s\n", prefix, sensor_name(controlled[i].policy->sensor));
+        print_policy(prefix, controlled[i].policy);
+      }
+    } else {
+      printf("Starting dynamic fan control for %d device(s) using %s temperature "
+             "(Ctrl-C to exit)\n",
+             controlled_device_count, sensor_name(args.policy.sensor));
+      print_policy("", &args.policy);
+    }
 
-        unsigned int target_fan =
-            interpolate_fan_speed(current_temp, args.setpoints, args.setpoint_count);
+    // Optional in-process exporter (which also publishes controller state) and shm publisher
+    static nvmlDevice_t export_devices[MAX_DEVICES];
+    static int export_ids[MAX_DEVICES];
+    for (int i = 0; i < controlled_device_count; i++) {
+      export_devices[i] = controlled[i].device;
+      export_ids[i] = controlled[i].id;
+    }
+    if (args.listen) {
+      if (export_start(args.listen, export_devices, export_ids, controlled_device_count,
+                       args.interval_ms) != 0) {
+        error_count++;
+        args.listen = NULL;
+      } else {
+        printf("Serving metrics on http://%s/metrics\n", args.listen);
+      }
+    }
+    if (args.shm_name && error_count == 0) {
+      if (shm_publish_start(args.shm_name, export_devices, export_ids, controlled_device_count,
+                            args.interval_ms) != 0)
+        error_count++;
+      else
+        printf("Publishing samples to shared memory %s\n", args.shm_name);
+    }
 
-        unsigned int num_fans = 0;
-        nvmlDeviceGetNumFans(device, &num_fans);
-
-        int fan_errors = 0;
-        for (unsigned int fan = 0; fan < num_fans; fan++) {
-          result = nvmlDeviceSetFanSpeed_v2(device, fan, target_fan);
-          if (result != NVML_SUCCESS) {
-            fprintf(stderr, "%d:Fan%u:Error: %s\n", device_id, fan, nvmlErrorString(result));
-            fan_errors++;
-          }
-        }
+    // XID, throttle and power source events wake the loop instead of waiting for the next poll
+    int watched = error_count == 0 ? events_start(export_devices, controlled_device_count) : 0;
+    if (watched < 0)
+      error_count++;
+    else if (watched > 0)
+      printf("Watching events on %d device(s)\n", watched);
 
-        if (fan_errors == 0) {
-          double temp_display = convert_temperature(current_temp, args.temp_unit);
-          const char* sensor_label = (args.sensor == SENSOR_VRAM) ? "V" : ""; // Mark VRAM
-          printf("%d:%.1f%c%s -> %u%%\n", device_id, temp_display, args.temp_unit, sensor_label, target_fan);
-        } else {
-          running = 0;
-          break;
-        }
-      }
+    // Edits to the config are compiled off the loop and swapped in between updates
+    if (fan_config && error_count == 0) {
+      if (fanconf_watch_start(args.config_path, &args.policy, conf_devices,
+                              controlled_device_count) != 0)
+        error_count++;
+      else
+        printf("Reloading %s when it changes\n", args.config_path);
+    }
 
+    // Terminal output is a region redrawn in place; piped output stays one line per update
+    if (is_terminal) {
+      printf("\n");
       fflush(stdout);
-      first_iteration = 0;
-      if (running) sleep(2);
+      int rows = controlled_device_count + (args.dashboard ? 1 : 0);
+      int cols = args.dashboard ? DASHBOARD_WIDTH : (int)sizeof(controlled[0].line);
+      if (render_init(&screen, STDOUT_FILENO, rows, cols) != 0) is_terminal = 0;
+    }
+    if (!is_terminal) args.dashboard = 0;
+
+    int looped = error_count == 0;
+    if (looped && run_fanctl_loop(&args) != 0) {
+      error_count++;
+      looped = 0;
+    }
+    // The signal handler has normally restored automatic control already, but a device thread
+    // may have been mid-write when it ran, and a loop that stopped on an error never ran it
+    if (looped) {
+      for (int i = 0; i < controlled_device_count; i++)
+        for (unsigned int fan = 0; fan < controlled[i].num_fans; fan++)
+          gpu->set_fan_control_policy(controlled[i].device, fan,
+                                      NVML_FAN_POLICY_TEMPERATURE_CONTINOUS_SW);
+    }
+    fanconf_watch_stop();
+    events_stop();
+    export_stop();
+    shm_publish_stop();
+    render_free(&screen);
+
+    unsigned long writes = 0, elided = 0, samples = 0, saved = 0;
+    int adaptive = 0, targeted = 0;
+    for (int i = 0; i < controlled_device_count; i++) {
+      const fan_policy_t* p = controlled[i].policy;
+      writes += controlled[i].writes;
+      elided += controlled[i].writes_elided;
+      samples += controlled[i].samples;
+      saved += samples_saved(&controlled[i]);
+      adaptive |= p->min_interval_ms != p->max_interval_ms;
+      targeted |= p->target_set;
+    }
+    unsigned long total = writes + elided;
+    printf("Fan writes: %lu issued, %lu elided (%.1f%%)\n", writes, elided,
+           total ? elided * 100.0 / total : 0.0);
+    if (adaptive && fan_config)
+      printf("Samples: %lu taken, %lu saved vs. polling at each minimum interval\n", samples,
+             saved);
+    else if (adaptive)
+      printf("Samples: %lu taken, %lu saved vs. polling every %u ms\n", samples, saved,
+             args.policy.min_interval_ms);
+    if (targeted) {
+      uint64_t above_ns = 0;
+      unsigned long throttles = 0;
+      for (int i = 0; i < controlled_device_count; i++) {
+        if (!controlled[i].policy->target_set) continue;
+        above_ns += controlled[i].above_target_ns;
+        throttles += controlled[i].throttle_events;
+      }
+      if (fan_config)
+        printf("Above target: %.1f s (devices with one), thermal throttle events: %lu\n",
+               above_ns / 1e9, throttles);
+      else
+        printf("Above %g C: %.1f s (all devices), thermal throttle events: %lu\n",
+               args.policy.pid.target, above_ns / 1e9, throttles);
+    }
+    if (looped) print_fanctl_stats(stderr, "exit");
+    fanconf_free(fan_config);
+    fan_config = NULL;
+  }
+
+  if (args.command == CMD_POWERCTL && selected_count > 0 && error_count == 0) {
+    signal(SIGINT, power_signal_handler);
+    signal(SIGTERM, power_signal_handler);
+
+    powerctl_options_t opts = {args.budget_w * 1000, args.interval_ms, args.max_step_w * 1000};
+    fprintf(stderr, "Sharing %u W across %d device(s), rebalancing every %u ms (Ctrl-C to exit)\n",
+            args.budget_w, selected_count, args.interval_ms);
+    if (run_powerctl(selected_devices, selected_ids, selected_count, &opts, &running) != 0)
+      error_count++;
+  }
+
+  if (args.command == CMD_RECORD && selected_count > 0 && error_count == 0) {
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
+    if (run_record(&args, selected_devices, selected_ids, selected_sensors, selected_count) != 0)
+      error_count++;
+  }
+
+  if (args.command == CMD_WATCH && selected_count > 0 && error_count == 0) {
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
+    signal(SIGPIPE, SIG_IGN);
+
+    watch_options_t opts = {
+        .format = args.subcommand == SUBCMD_CSV ? WATCH_CSV : WATCH_NDJSON,
+        .fields = args.fields,
+        .interval_ms = args.interval_ms,
+        .count = args.count,
+        .duration_s = args.duration_s,
+        .temp_unit = args.temp_unit,
+    };
+    if (run_watch(selected_devices, selected_ids, selected_count, &opts, &running) != 0)
+      error_count++;
+  }
+
+  if (args.command == CMD_EXPORT && selected_count > 0 && error_count == 0) {
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
+
+    if (export_start(args.listen, selected_devices, selected_ids, selected_count,
+                     args.interval_ms) != 0 ||
+        (args.shm_name && shm_publish_start(args.shm_name, selected_devices, selected_ids,
+                                            selected_count, args.interval_ms) != 0)) {
+      error_count++;
+    } else {
+      fprintf(stderr, "Serving metrics for %d device(s) on http://%s/metrics (Ctrl-C to exit)\n",
+              selected_count, args.listen);
+      while (running) pause();
+    }
+    shm_publish_stop();
+    export_stop();
+  }
+
+  if (args.command == CMD_PUBLISH && selected_count > 0 && error_count == 0) {
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
+
+    if (shm_publish_start(args.shm_name, selected_devices, selected_ids, selected_count,
+                          args.interval_ms) == 0) {
+      fprintf(stderr, "Publishing %d device(s) to shared memory %s every %u ms (Ctrl-C to exit)\n",
+              selected_count, args.shm_name, args.interval_ms);
+      while (running) pause();
+      shm_publish_stop();
+    } else {
+      error_count++;
     }
   }
 
   cleanup_pci();
-  nvmlShutdown();
+  gpu->shutdown();
   return !!error_count;
 }
 
@@ -0,0 +1,152 @@
+// Shared-memory telemetry segment published by `nvml-tool publish` (or fanctl/export --shm).
+//
+// This header is self-contained so other programs can include it without NVML. A reader maps
+// the segment read-only and copies a device slot without taking any lock or making a syscall:
+//
+//   nvml_tool_shm_t shm;
+//   if (nvml_tool_shm_open(NVML_TOOL_SHM_DEFAULT_NAME, &shm) == 0) {
+//     nvml_tool_shm_sample_t s;
+//     if (nvml_tool_shm_read(&shm, 0, &s) == 0) printf("%u C\n", s.temperature);
+//     nvml_tool_shm_close(&shm);
+//   }
+//
+// Layout (all fields native-endian, every block aligned to a 64-byte cache line):
+//   nvml_tool_shm_header_t              one cache line
+//   nvml_tool_shm_slot_t[device_count]  four cache lines each, the hot values in the first
+//
+// Each slot is guarded by a seqlock: the publisher makes seq odd, writes the sample and makes
+// seq even again. A reader retries while seq is odd or changed during its copy. A publisher
+// killed between the two stores leaves seq odd for good, so a reader gives up after a bounded
+// number of retries (a few milliseconds at most) and reports the slot as unreadable. Requires
+// GCC or Clang (__atomic builtins).
+#ifndef NVML_TOOL_SHM_H
+#define NVML_TOOL_SHM_H
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NVML_TOOL_SHM_MAGIC 0x314d48534c4d564eULL // "NVMLSHM1"
+#define NVML_TOOL_SHM_VERSION 1
+#define NVML_TOOL_SHM_DEFAULT_NAME "/nvml-tool"
+#define NVML_TOOL_SHM_CACHELINE 64
+#define NVML_TOOL_SHM_STRING_LEN 96
+#define NVML_TOOL_SHM_READ_SPINS 4096 // Seqlock retries between yields of a reader
+#define NVML_TOOL_SHM_READ_ROUNDS 64  // Yields before a reader gives up on a slot
+
+// Bits in valid; identical to the TM_* bits nvml-tool uses internally
+#define NVML_TOOL_SHM_NAME (1u << 0)
+#define NVML_TOOL_SHM_UUID (1u << 1)
+#define NVML_TOOL_SHM_TEMP (1u << 2)
+#define NVML_TOOL_SHM_FAN (1u << 3)
+#define NVML_TOOL_SHM_POWER (1u << 4)
+#define NVML_TOOL_SHM_POWER_LIMIT (1u << 5)
+#define NVML_TOOL_SHM_MEMORY (1u << 6)
+
+typedef struct {
+  uint64_t magic;   // Written last by the publisher; a reader must check it first
+  uint32_t version; // Bumped on any incompatible layout change
+  uint32_t header_size;
+  uint32_t slot_size;
+  uint32_t device_count;
+  uint32_t interval_ms;  // Publisher sample period
+  uint32_t publisher_pid;
+  uint64_t started_ns;   // CLOCK_MONOTONIC when the segment was created
+  uint64_t updated_ns;   // CLOCK_MONOTONIC at the end of the last sampling round
+  uint32_t alive;        // Cleared when the publisher exits cleanly
+  uint32_t reserved[3];
+} __attribute__((aligned(NVML_TOOL_SHM_CACHELINE))) nvml_tool_shm_header_t;
+
+// The sample as seen by readers
+typedef struct {
+  uint32_t device_id; // nvml-tool device index
+  uint32_t valid;     // NVML_TOOL_SHM_* bits that were read successfully
+  uint32_t temperature; // C
+  uint32_t fan_speed;   // %
+  uint32_t power_usage; // mW
+  uint32_t power_limit; // mW
+  uint64_t timestamp_ns; // CLOCK_MONOTONIC when the sample was taken
+  uint64_t memory_total; // Bytes
+  uint64_t memory_used;
+  uint64_t memory_free;
+  char name[NVML_TOOL_SHM_STRING_LEN];
+  char uuid[NVML_TOOL_SHM_STRING_LEN];
+} nvml_tool_shm_sample_t;
+
+typedef struct {
+  uint32_t seq; // Odd while the publisher is writing, 0 until the first sample
+  uint32_t reserved;
+  nvml_tool_shm_sample_t sample;
+} __attribute__((aligned(NVML_TOOL_SHM_CACHELINE))) nvml_tool_shm_slot_t;
+
+typedef struct {
+  const nvml_tool_shm_header_t* header;
+  const nvml_tool_shm_slot_t* slots;
+  size_t size;
+} nvml_tool_shm_t;
+
+// Map the named segment read-only. Returns 0 on success, -1 if it does not exist or its layout
+// is not the one this header describes.
+static inline int nvml_tool_shm_open(const char* name, nvml_tool_shm_t* shm) {
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) return -1;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(nvml_tool_shm_header_t)) {
+    close(fd);
+    return -1;
+  }
+  void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return -1;
+
+  const nvml_tool_shm_header_t* h = (const nvml_tool_shm_header_t*)base;
+  if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != NVML_TOOL_SHM_MAGIC ||
+      h->version != NVML_TOOL_SHM_VERSION || h->header_size != sizeof(nvml_tool_shm_header_t) ||
+      h->slot_size != sizeof(nvml_tool_shm_slot_t) ||
+      h->header_size + (size_t)h->device_count * h->slot_size > (size_t)st.st_size) {
+    munmap(base, st.st_size);
+    return -1;
+  }
+
+  shm->header = h;
+  shm->slots = (const nvml_tool_shm_slot_t*)((const char*)base + h->header_size);
+  shm->size = st.st_size;
+  return 0;
+}
+
+static inline void nvml_tool_shm_close(nvml_tool_shm_t* shm) {
+  if (shm->header) munmap((void*)shm->header, shm->size);
+  shm->header = NULL;
+  shm->slots = NULL;
+}
+
+// Copy a consistent sample of the index-th published device. Returns 0 on success, -1 if the
+// index is out of range, the device has not been sampled yet, or no consistent copy could be
+// taken: the publisher exited cleanly, or died, in the middle of writing the slot.
+static inline int nvml_tool_shm_read(const nvml_tool_shm_t* shm, uint32_t index,
+                                     nvml_tool_shm_sample_t* out) {
+  if (index >= shm->header->device_count) return -1;
+  const nvml_tool_shm_slot_t* slot = &shm->slots[index];
+
+  for (int round = 0; round < NVML_TOOL_SHM_READ_ROUNDS; round++) {
+    for (int spin = 0; spin < NVML_TOOL_SHM_READ_SPINS; spin++) {
+      uint32_t begin = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+      if (begin == 0) return -1;
+      if (begin & 1) continue; // A live publisher holds the slot for well under 1 us
+      memcpy(out, (const void*)&slot->sample, sizeof(*out));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == begin) return 0;
+    }
+    // Still odd: the publisher was preempted mid-write, or is gone and never will finish
+    if (!__atomic_load_n(&shm->header->alive, __ATOMIC_ACQUIRE)) return -1;
+    sched_yield();
+  }
+  return -1;
+}
+
+#endif
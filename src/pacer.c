@@ -0,0 +1,166 @@
+#define _GNU_SOURCE
+#include "pacer.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "timeutil.h"
+
+typedef enum {
+  ITEM_WAITING, // For its deadline
+  ITEM_RUNNING,
+  ITEM_DONE,  // Result waiting to be taken
+  ITEM_TAKEN, // Held by the caller until released
+} item_state_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t wake; // Released, or stopping
+  item_state_t state;
+  struct timespec deadline;
+  int result;
+  int sleeping; // The thread is in a timed wait for deadline
+  int stopping;
+  pthread_t thread;
+} pacer_item_t;
+
+static struct {
+  pacer_fn_t fn;
+  void* ctx;
+  pacer_item_t* items;
+  int count; // Items with a running thread
+  int done_fd;
+} pacer = {.done_fd = -1};
+
+static void* item_main(void* arg) {
+  pacer_item_t* item = arg;
+  int index = (int)(item - pacer.items);
+
+  pthread_mutex_lock(&item->lock);
+  for (;;) {
+    while (!item->stopping) {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      int due = !timespec_before(&now, &item->deadline);
+      if (item->state == ITEM_WAITING && due) break;
+      // A taken item keeps its deadline, so it is slept on until it passes
+      if ((item->state == ITEM_WAITING || item->state == ITEM_TAKEN) && !due) {
+        item->sleeping = 1;
+        pthread_cond_timedwait(&item->wake, &item->lock, &item->deadline);
+        item->sleeping = 0;
+      } else {
+        pthread_cond_wait(&item->wake, &item->lock);
+      }
+    }
+    if (item->stopping) break;
+    item->state = ITEM_RUNNING;
+    pthread_mutex_unlock(&item->lock);
+
+    int result = pacer.fn(index, pacer.ctx);
+
+    pthread_mutex_lock(&item->lock);
+    item->result = result;
+    item->state = ITEM_DONE;
+    // Only fails if the counter would overflow, and then the collector is already awake
+    uint64_t one = 1;
+    ssize_t written = write(pacer.done_fd, &one, sizeof(one));
+    (void)written;
+  }
+  pthread_mutex_unlock(&item->lock);
+  return NULL;
+}
+
+int pacer_start(int count, pacer_fn_t fn, void* ctx, const struct timespec* first) {
+  if (pacer.items) return -1;
+  pacer.items = calloc(count, sizeof(pacer_item_t));
+  pacer.done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (!pacer.items || pacer.done_fd < 0) {
+    fprintf(stderr, "Error: Failed to set up update threads\n");
+    pacer_stop();
+    return -1;
+  }
+  pacer.fn = fn;
+  pacer.ctx = ctx;
+
+  // Deadlines are on CLOCK_MONOTONIC, like the rest of the loop
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+  // Signals are for the thread collecting the results, whose wait they interrupt; keep them off
+  // these threads, so no handler runs in the middle of an update
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  int err = 0;
+  for (; pacer.count < count; pacer.count++) {
+    pacer_item_t* item = &pacer.items[pacer.count];
+    pthread_mutex_init(&item->lock, NULL);
+    pthread_cond_init(&item->wake, &attr);
+    item->state = ITEM_WAITING;
+    item->deadline = *first;
+    err = pthread_create(&item->thread, NULL, item_main, item);
+    if (err != 0) {
+      pthread_cond_destroy(&item->wake);
+      pthread_mutex_destroy(&item->lock);
+      break;
+    }
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  pthread_condattr_destroy(&attr);
+  if (err != 0) {
+    fprintf(stderr, "Error: Failed to start update thread\n");
+    pacer_stop();
+    return -1;
+  }
+  return 0;
+}
+
+void pacer_stop(void) {
+  for (int i = 0; i < pacer.count; i++) {
+    pacer_item_t* item = &pacer.items[i];
+    pthread_mutex_lock(&item->lock);
+    item->stopping = 1;
+    pthread_cond_signal(&item->wake);
+    pthread_mutex_unlock(&item->lock);
+  }
+  for (int i = 0; i < pacer.count; i++) {
+    pthread_join(pacer.items[i].thread, NULL);
+    pthread_cond_destroy(&pacer.items[i].wake);
+    pthread_mutex_destroy(&pacer.items[i].lock);
+  }
+  if (pacer.done_fd >= 0) close(pacer.done_fd);
+  free(pacer.items);
+  pacer.items = NULL;
+  pacer.count = 0;
+  pacer.done_fd = -1;
+}
+
+int pacer_fd(void) { return pacer.done_fd; }
+
+int pacer_take(int index, int* result) {
+  pacer_item_t* item = &pacer.items[index];
+  pthread_mutex_lock(&item->lock);
+  int taken = item->state == ITEM_RUNNING ? -1 : item->state == ITEM_DONE ? 1 : 0;
+  if (taken > 0) *result = item->result;
+  if (taken >= 0) item->state = ITEM_TAKEN;
+  pthread_mutex_unlock(&item->lock);
+  return taken;
+}
+
+void pacer_release(int index, const struct timespec* deadline) {
+  pacer_item_t* item = &pacer.items[index];
+  pthread_mutex_lock(&item->lock);
+  // A thread already sleeping until the same deadline need not be woken
+  int wake = !item->sleeping || item->deadline.tv_sec != deadline->tv_sec ||
+             item->deadline.tv_nsec != deadline->tv_nsec;
+  item->deadline = *deadline;
+  item->state = ITEM_WAITING;
+  if (wake) pthread_cond_signal(&item->wake);
+  pthread_mutex_unlock(&item->lock);
+}
@@ -0,0 +1,29 @@
+#ifndef NVML_TOOL_PACER_H
+#define NVML_TOOL_PACER_H
+
+#include <time.h>
+
+// Work for one item when it is due; the result is handed to whoever takes the item next
+typedef int (*pacer_fn_t)(int index, void* ctx);
+
+// Start one thread per item, each running fn for its item whenever the item's absolute deadline
+// on CLOCK_MONOTONIC passes, so a slow item delays no other. After each run the item waits,
+// with its result, to be taken and given a new deadline. Every item is first due at first. The
+// threads run with all signals blocked. Returns 0, or -1 if a thread could not be started.
+int pacer_start(int count, pacer_fn_t fn, void* ctx, const struct timespec* first);
+
+// Stop and join every thread; runs in progress finish first
+void pacer_stop(void);
+
+// eventfd that becomes readable whenever an item finishes a run
+int pacer_fd(void);
+
+// Take the index-th item unless it is running: returns 1 with its result if it finished a run,
+// 0 if it was waiting for its deadline, -1 if it is running. A taken item does not run again
+// until it is released.
+int pacer_take(int index, int* result);
+
+// Give a taken item back, due at deadline
+void pacer_release(int index, const struct timespec* deadline);
+
+#endif
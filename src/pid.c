@@ -0,0 +1,65 @@
+#define _GNU_SOURCE
+#include "pid.h"
+
+#include <stdlib.h>
+
+// Time constant of the derivative filter. Sensors report whole degrees, so an unfiltered
+// derivative turns every 1 C step into a spike.
+#define PID_DERIVATIVE_TAU_S 2.0
+
+int pid_parse_gains(const char* str, pid_params_t* params) {
+  double gains[3];
+  const char* p = str;
+  for (int i = 0; i < 3; i++) {
+    char* end;
+    gains[i] = strtod(p, &end);
+    // The negated comparison also rejects NaN
+    if (end == p || !(gains[i] >= 0)) return -1;
+    if (i < 2 && *end != ',') return -1;
+    if (i == 2 && *end) return -1;
+    p = end + 1;
+  }
+  params->kp = gains[0];
+  params->ki = gains[1];
+  params->kd = gains[2];
+  return 0;
+}
+
+static double clamp(double value, double lo, double hi) {
+  return value < lo ? lo : value > hi ? hi : value;
+}
+
+double pid_update(const pid_params_t* params, pid_state_t* state, double temp, double power_w,
+                  double dt, double lo, double hi) {
+  double error = temp - params->target; // Positive when too hot, which calls for more fan
+  if (!state->primed || dt <= 0) {
+    state->derivative = 0;
+  } else {
+    double alpha = dt / (PID_DERIVATIVE_TAU_S + dt);
+    state->derivative += alpha * ((temp - state->last_temp) / dt - state->derivative);
+  }
+  state->last_temp = temp;
+  if (state->primed && dt > 0) state->integral += params->ki * error * dt;
+
+  double fixed = params->feed_forward * power_w + params->kp * error +
+                 params->kd * state->derivative;
+  double output = fixed + state->integral;
+
+  // Anti-windup: while the output is past a bound, bleed off the part of the integral that
+  // pushes it there, so it recovers as soon as the error changes sign
+  if (output > hi && state->integral > 0)
+    state->integral = state->integral - (output - hi) > 0 ? state->integral - (output - hi) : 0;
+  else if (output < lo && state->integral < 0)
+    state->integral = state->integral + (lo - output) < 0 ? state->integral + (lo - output) : 0;
+  output = clamp(fixed + state->integral, lo, hi);
+
+  // The bounds win over the slew limit: the curve floor is a safety net, not a suggestion
+  if (state->primed && params->slew > 0 && dt > 0) {
+    double step = params->slew * dt;
+    output = clamp(clamp(output, state->output - step, state->output + step), lo, hi);
+  }
+
+  state->output = output;
+  state->primed = 1;
+  return output;
+}
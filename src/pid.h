@@ -0,0 +1,35 @@
+#ifndef NVML_TOOL_PID_H
+#define NVML_TOOL_PID_H
+
+// Default gains, tuned against the simulated backend's thermal plant (150 J/K, 2-10 W/K)
+#define PID_DEFAULT_KP 4.0  // % per C above target
+#define PID_DEFAULT_KI 0.1  // % per C*s
+#define PID_DEFAULT_KD 20.0 // % per C/s of rise
+#define PID_DEFAULT_SLEW 20.0 // %/s
+
+typedef struct {
+  double target;       // C
+  double kp, ki, kd;
+  double feed_forward; // % per W of power draw, 0 to disable
+  double slew;         // Largest output change in %/s, 0 for unlimited
+} pid_params_t;
+
+typedef struct {
+  double integral;   // Integral term, in % of output
+  double derivative; // Filtered dT/dt in C/s
+  double last_temp;
+  double output; // Last output in %
+  int primed;
+} pid_state_t;
+
+// Parse "KP,KI,KD" into params. Returns 0 on success.
+int pid_parse_gains(const char* str, pid_params_t* params);
+
+// Advance the controller by dt seconds and return the fan speed in %, within [lo, hi]. The
+// derivative acts on the measurement, so changing the target never kicks the output, and the
+// integral stops growing while the output is pinned at a bound (anti-windup). power_w feeds
+// forward, so a load step raises the fan before the die temperature has moved.
+double pid_update(const pid_params_t* params, pid_state_t* state, double temp, double power_w,
+                  double dt, double lo, double hi);
+
+#endif
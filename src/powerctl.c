@@ -0,0 +1,265 @@
+#define _GNU_SOURCE
+#include "powerctl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "backend.h"
+#include "render.h"
+#include "timeutil.h"
+
+#define POWERCTL_HEADROOM 0.10   // Margin above the measured draw every device keeps
+#define POWERCTL_CAPPED 0.95     // Drawing this fraction of the limit counts as running into it
+#define POWERCTL_BUSY_UTIL 50    // % GPU utilization at which a device competes for surplus
+#define POWERCTL_GRANULARITY 1000 // Limits are set in whole watts
+#define POWERCTL_FILL_ROUNDS 8
+#define POWERCTL_LINE_WIDTH 80
+
+typedef struct {
+  nvmlDevice_t device;
+  int id;
+  unsigned int min_mw;
+  unsigned int max_mw;
+  unsigned int original_mw;
+  unsigned int limit_mw; // Limit currently set
+  unsigned int power_mw;
+  unsigned int util;
+  int capped;
+  double target_mw; // Allocation computed this interval
+  unsigned long capped_intervals;
+  unsigned long writes;
+} powerctl_device_t;
+
+static powerctl_device_t* volatile active;
+static volatile int active_count;
+
+void powerctl_restore(void) {
+  powerctl_device_t* devs = active;
+  if (!devs) return;
+  for (int i = 0; i < active_count; i++)
+    gpu->set_power_limit(devs[i].device, devs[i].original_mw);
+}
+
+static int sample(powerctl_device_t* d) {
+  nvmlReturn_t result = gpu->get_power_usage(d->device, &d->power_mw);
+  if (result == NVML_SUCCESS) result = gpu->get_power_limit(d->device, &d->limit_mw);
+  if (result != NVML_SUCCESS) {
+    fprintf(stderr, "%d:Error: Cannot read power (%s)\n", d->id, gpu->error_string(result));
+    return -1;
+  }
+
+  // Utilization and throttle reasons refine the picture but are not essential
+  nvmlUtilization_t util;
+  d->util = gpu->get_utilization(d->device, &util) == NVML_SUCCESS ? util.gpu : 100;
+  unsigned long long reasons = 0;
+  d->capped = d->power_mw >= d->limit_mw * POWERCTL_CAPPED ||
+              (gpu->get_throttle_reasons(d->device, &reasons) == NVML_SUCCESS &&
+               (reasons & nvmlClocksThrottleReasonSwPowerCap));
+  if (d->capped) d->capped_intervals++;
+  return 0;
+}
+
+static double clamp(double value, double lo, double hi) {
+  return value < lo ? lo : value > hi ? hi : value;
+}
+
+// Highest limit a device can reach this interval
+static double ceiling(const powerctl_device_t* d, unsigned int max_step_mw) {
+  if (!max_step_mw || d->limit_mw + (double)max_step_mw > d->max_mw) return d->max_mw;
+  return d->limit_mw + (double)max_step_mw;
+}
+
+// Sum of allocations if every device gets level, within its minimum and its demand
+static double fill_level(const powerctl_device_t* devs, const double* demand, int count,
+                         double level) {
+  double total = 0;
+  for (int i = 0; i < count; i++) total += clamp(level, devs[i].min_mw, demand[i]);
+  return total;
+}
+
+// Split the budget. A device's demand is its draw plus headroom, or as much as it can get if it
+// is running into its limit (its true demand is then unknown). If the demands do not fit, the
+// budget is shared max-min fairly: every device is raised from its minimum towards its demand
+// at the same level. Otherwise the surplus is water-filled over the devices, weighted towards
+// busy ones. Nothing is handed out beyond what the rate limit lets a device reach this
+// interval, so the remainder stays as headroom on the other devices.
+static void allocate(powerctl_device_t* devs, int count, double budget, unsigned int max_step_mw) {
+  double demand[count];
+  double demand_total = 0, lo = 0, hi = 0;
+  for (int i = 0; i < count; i++) {
+    double top = ceiling(&devs[i], max_step_mw);
+    demand[i] = devs[i].capped ? top
+                               : clamp(devs[i].power_mw * (1 + POWERCTL_HEADROOM), devs[i].min_mw,
+                                       top);
+    devs[i].target_mw = demand[i];
+    demand_total += demand[i];
+    if (demand[i] > hi) hi = demand[i];
+  }
+
+  if (demand_total > budget) {
+    for (int iter = 0; iter < 50; iter++) {
+      double mid = (lo + hi) / 2;
+      if (fill_level(devs, demand, count, mid) > budget)
+        hi = mid;
+      else
+        lo = mid;
+    }
+    for (int i = 0; i < count; i++) devs[i].target_mw = clamp(lo, devs[i].min_mw, demand[i]);
+    return;
+  }
+  double floor_total = demand_total;
+
+  double surplus = budget - floor_total;
+  for (int round = 0; round < POWERCTL_FILL_ROUNDS && surplus > POWERCTL_GRANULARITY; round++) {
+    double weight_total = 0;
+    for (int i = 0; i < count; i++) {
+      if (devs[i].target_mw >= ceiling(&devs[i], max_step_mw)) continue;
+      int hungry = devs[i].capped || devs[i].util >= POWERCTL_BUSY_UTIL;
+      weight_total += hungry ? 1.0 + devs[i].util : 1.0;
+    }
+    if (weight_total == 0) break;
+
+    double given = 0;
+    for (int i = 0; i < count; i++) {
+      double room = ceiling(&devs[i], max_step_mw) - devs[i].target_mw;
+      if (room <= 0) continue;
+      int hungry = devs[i].capped || devs[i].util >= POWERCTL_BUSY_UTIL;
+      double share = surplus * (hungry ? 1.0 + devs[i].util : 1.0) / weight_total;
+      if (share > room) share = room;
+      devs[i].target_mw += share;
+      given += share;
+    }
+    surplus -= given;
+  }
+}
+
+// Lower limits first so the sum stays within budget between the individual writes
+static int apply(powerctl_device_t* devs, int count, unsigned int max_step_mw, int lowering,
+                 volatile int* running) {
+  int errors = 0;
+  for (int i = 0; i < count && *running; i++) {
+    powerctl_device_t* d = &devs[i];
+    unsigned int target = (unsigned int)d->target_mw / POWERCTL_GRANULARITY * POWERCTL_GRANULARITY;
+    if (target < d->min_mw) target = d->min_mw;
+    if (lowering ? target >= d->limit_mw : target <= d->limit_mw) continue;
+    if (!lowering && max_step_mw && target > d->limit_mw + max_step_mw)
+      target = d->limit_mw + max_step_mw;
+    if (target / POWERCTL_GRANULARITY == d->limit_mw / POWERCTL_GRANULARITY) continue;
+
+    nvmlReturn_t result = gpu->set_power_limit(d->device, target);
+    d->writes++;
+    if (result != NVML_SUCCESS) {
+      fprintf(stderr, "%d:Error: Cannot set power limit to %.1fW (%s)\n", d->id, target / 1000.0,
+              gpu->error_string(result));
+      errors++;
+    } else {
+      d->limit_mw = target;
+    }
+  }
+  return errors;
+}
+
+static void print_state(render_t* screen, const powerctl_device_t* devs, int count,
+                        unsigned int budget_mw) {
+  double draw = 0, allocated = 0;
+  for (int i = 0; i < count; i++) {
+    draw += devs[i].power_mw;
+    allocated += devs[i].limit_mw;
+  }
+
+  if (!screen) {
+    for (int i = 0; i < count; i++)
+      printf("%d:%.1fW/%.1fW,%u%%%s\n", devs[i].id, devs[i].power_mw / 1000.0,
+             devs[i].limit_mw / 1000.0, devs[i].util, devs[i].capped ? ",capped" : "");
+    printf("Total:%.1fW/%.1fW of %.1fW\n", draw / 1000.0, allocated / 1000.0, budget_mw / 1000.0);
+    fflush(stdout);
+    return;
+  }
+
+  for (int i = 0; i < count; i++)
+    render_printf(screen, i, "%d: %7.1fW of %6.1fW limit  %3u%% busy%s", devs[i].id,
+                  devs[i].power_mw / 1000.0, devs[i].limit_mw / 1000.0, devs[i].util,
+                  devs[i].capped ? "  capped" : "");
+  render_printf(screen, count, "Total: %.1fW drawn, %.1fW allocated of %.1fW budget",
+                draw / 1000.0, allocated / 1000.0, budget_mw / 1000.0);
+  render_flush(screen);
+}
+
+int run_powerctl(const nvmlDevice_t* devices, const int* device_ids, int count,
+                 const powerctl_options_t* opts, volatile int* running) {
+  powerctl_device_t* devs = calloc(count, sizeof(powerctl_device_t));
+  if (!devs) {
+    fprintf(stderr, "Error: Out of memory\n");
+    return -1;
+  }
+
+  unsigned long long min_total = 0;
+  for (int i = 0; i < count; i++) {
+    powerctl_device_t* d = &devs[i];
+    d->device = devices[i];
+    d->id = device_ids[i];
+    nvmlReturn_t result = gpu->get_power_limit_constraints(d->device, &d->min_mw, &d->max_mw);
+    if (result == NVML_SUCCESS) result = gpu->get_power_limit(d->device, &d->original_mw);
+    if (result != NVML_SUCCESS) {
+      fprintf(stderr, "%d:Error: Cannot read power limits (%s)\n", d->id,
+              gpu->error_string(result));
+      free(devs);
+      return -1;
+    }
+    d->limit_mw = d->original_mw;
+    min_total += d->min_mw;
+  }
+  if (min_total > opts->budget_mw) {
+    fprintf(stderr, "Error: Budget %.1fW is below the sum of minimum limits (%.1fW)\n",
+            opts->budget_mw / 1000.0, min_total / 1000.0);
+    free(devs);
+    return -1;
+  }
+
+  active_count = count;
+  active = devs;
+
+  render_t screen;
+  int use_screen = isatty(STDOUT_FILENO) && render_init(&screen, STDOUT_FILENO, count + 1,
+                                                         POWERCTL_LINE_WIDTH) == 0;
+
+  int errors = 0;
+  unsigned long intervals = 0;
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  while (*running) {
+    for (int i = 0; i < count && errors == 0; i++)
+      if (sample(&devs[i]) != 0) errors++;
+    if (errors) break;
+    intervals++;
+
+    allocate(devs, count, opts->budget_mw, opts->max_step_mw);
+    errors += apply(devs, count, opts->max_step_mw, 1, running);
+    errors += apply(devs, count, opts->max_step_mw, 0, running);
+    if (errors || !*running) break;
+    print_state(use_screen ? &screen : NULL, devs, count, opts->budget_mw);
+
+    timespec_add_ms(&deadline, opts->interval_ms);
+    // Returns early with EINTR on SIGINT/SIGTERM; the loop condition picks that up
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+  }
+
+  // The signal handler has normally restored the limits already, but the loop may have been
+  // mid-write when it ran
+  active = NULL;
+  for (int i = 0; i < count; i++) gpu->set_power_limit(devs[i].device, devs[i].original_mw);
+
+  if (use_screen) render_free(&screen);
+  unsigned long writes = 0;
+  for (int i = 0; i < count; i++) writes += devs[i].writes;
+  printf("Limit writes: %lu over %lu interval(s)\n", writes, intervals);
+  for (int i = 0; i < count; i++)
+    printf("%d:Capped %.1f%% of intervals, limit restored to %.1fW\n", devs[i].id,
+           intervals ? devs[i].capped_intervals * 100.0 / intervals : 0.0,
+           devs[i].original_mw / 1000.0);
+
+  free(devs);
+  return errors ? -1 : 0;
+}
@@ -0,0 +1,26 @@
+#ifndef NVML_TOOL_POWERCTL_H
+#define NVML_TOOL_POWERCTL_H
+
+#include <nvml.h>
+
+#define POWERCTL_DEFAULT_MAX_STEP_W 25
+
+typedef struct {
+  unsigned int budget_mw;   // Sum of all power limits never exceeds this
+  unsigned int interval_ms;
+  unsigned int max_step_mw; // Largest raise of one device's limit per interval
+} powerctl_options_t;
+
+// Redistribute power limits across the devices every interval_ms until *running drops to 0:
+// each device gets what it draws plus headroom, and the rest of the budget goes to busy devices
+// that are running into their limit. Limits stay within each device's constraints, are lowered
+// immediately and raised by at most max_step_mw per interval. The original limits are restored
+// on return. Returns 0 on success.
+int run_powerctl(const nvmlDevice_t* devices, const int* device_ids, int count,
+                 const powerctl_options_t* opts, volatile int* running);
+
+// Put back the limits the devices had when run_powerctl() started, for the SIGINT/SIGTERM
+// handler. A no-op unless run_powerctl() is running.
+void powerctl_restore(void);
+
+#endif
@@ -0,0 +1,191 @@
+#define _GNU_SOURCE
+#include "profile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "backend.h"
+#include "telemetry.h"
+#include "timeutil.h"
+
+// Each profiled query wraps one backend call with fixed arguments
+typedef struct {
+  const char* name;
+  nvmlReturn_t (*call)(nvmlDevice_t device);
+} profile_query_t;
+
+static nvmlReturn_t q_name(nvmlDevice_t d) {
+  char name[NVML_DEVICE_NAME_BUFFER_SIZE];
+  return gpu->get_name(d, name, sizeof(name));
+}
+
+static nvmlReturn_t q_uuid(nvmlDevice_t d) {
+  char uuid[NVML_DEVICE_UUID_BUFFER_SIZE];
+  return gpu->get_uuid(d, uuid, sizeof(uuid));
+}
+
+static nvmlReturn_t q_pci_info(nvmlDevice_t d) {
+  nvmlPciInfo_t pci;
+  return gpu->get_pci_info(d, &pci);
+}
+
+static nvmlReturn_t q_temperature(nvmlDevice_t d) {
+  unsigned int temp;
+  return gpu->get_temperature(d, NVML_TEMPERATURE_GPU, &temp);
+}
+
+static nvmlReturn_t q_memory(nvmlDevice_t d) {
+  nvmlMemory_t memory;
+  return gpu->get_memory_info(d, &memory);
+}
+
+static nvmlReturn_t q_fan_speed(nvmlDevice_t d) {
+  unsigned int speed;
+  return gpu->get_fan_speed(d, &speed);
+}
+
+static nvmlReturn_t q_num_fans(nvmlDevice_t d) {
+  unsigned int num_fans;
+  return gpu->get_num_fans(d, &num_fans);
+}
+
+static nvmlReturn_t q_fan_policy(nvmlDevice_t d) {
+  nvmlFanControlPolicy_t policy;
+  return gpu->get_fan_control_policy(d, 0, &policy);
+}
+
+static nvmlReturn_t q_power_usage(nvmlDevice_t d) {
+  unsigned int mw;
+  return gpu->get_power_usage(d, &mw);
+}
+
+static nvmlReturn_t q_power_limit(nvmlDevice_t d) {
+  unsigned int mw;
+  return gpu->get_power_limit(d, &mw);
+}
+
+static nvmlReturn_t q_power_constraints(nvmlDevice_t d) {
+  unsigned int min_mw, max_mw;
+  return gpu->get_power_limit_constraints(d, &min_mw, &max_mw);
+}
+
+// The full info snapshot, as used by info/status
+static nvmlReturn_t q_snapshot(nvmlDevice_t d) {
+  telemetry_t t;
+  telemetry_read(d, TM_ALL, &t);
+  return (t.valid & TM_ALL) == TM_ALL ? NVML_SUCCESS : NVML_ERROR_UNKNOWN;
+}
+
+static const profile_query_t queries[] = {
+    {"temperature", q_temperature},   {"fan_speed", q_fan_speed},
+    {"num_fans", q_num_fans},         {"fan_policy", q_fan_policy},
+    {"power_usage", q_power_usage},   {"power_limit", q_power_limit},
+    {"power_constraints", q_power_constraints},
+    {"memory_info", q_memory},        {"name", q_name},
+    {"uuid", q_uuid},                 {"pci_info", q_pci_info},
+    {"snapshot", q_snapshot},
+};
+#define QUERY_COUNT (int)(sizeof(queries) / sizeof(queries[0]))
+
+static int compare_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of a sorted sample array
+static uint64_t percentile(const uint64_t* sorted, int count, int pct) {
+  int rank = (pct * count + 99) / 100;
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+void profile_print_header(const profile_setup_t* setup, int iterations, int json) {
+  if (json) {
+    printf("{\n");
+    printf("  \"backend\": \"%s\",\n", gpu->name);
+    printf("  \"iterations\": %d,\n", iterations);
+    printf("  \"init_ms\": %.3f,\n", setup->init_ns / 1e6);
+    if (setup->pci_scan_ns)
+      printf("  \"pci_scan_ms\": %.3f,\n", setup->pci_scan_ns / 1e6);
+    else
+      printf("  \"pci_scan_ms\": null,\n");
+    printf("  \"devices\": [\n");
+    return;
+  }
+
+  printf("Backend: %s, %d calls per query\n", gpu->name, iterations);
+  printf("One-time costs:\n");
+  printf("  init               %10.3f ms\n", setup->init_ns / 1e6);
+  if (setup->pci_scan_ns)
+    printf("  pci_scan_bus       %10.3f ms\n", setup->pci_scan_ns / 1e6);
+  else
+    printf("  pci_scan_bus              n/a\n");
+  printf("\n");
+}
+
+void profile_device(nvmlDevice_t device, int device_id, uint64_t handle_ns, int iterations,
+                    int json, int is_last) {
+  uint64_t* samples = malloc(sizeof(uint64_t) * iterations);
+  if (!samples) {
+    fprintf(stderr, "%d:Error: Out of memory\n", device_id);
+    return;
+  }
+
+  char name[NVML_DEVICE_NAME_BUFFER_SIZE] = "Unknown";
+  gpu->get_name(device, name, sizeof(name));
+
+  if (json) {
+    printf("    {\n");
+    printf("      \"device_id\": %d,\n", device_id);
+    printf("      \"name\": \"%s\",\n", name);
+    printf("      \"handle_ms\": %.3f,\n", handle_ns / 1e6);
+    printf("      \"queries\": {\n");
+  } else {
+    printf("=== Device %d: %s ===\n", device_id, name);
+    printf("Handle lookup: %.3f ms\n", handle_ns / 1e6);
+    printf("%-18s %10s %10s %10s %10s %10s %7s\n", "Query", "p50 us", "p90 us", "p99 us",
+           "max us", "calls/s", "errors");
+  }
+
+  for (int q = 0; q < QUERY_COUNT; q++) {
+    int errors = 0;
+    uint64_t start = monotonic_ns();
+    for (int i = 0; i < iterations; i++) {
+      uint64_t t0 = monotonic_ns();
+      if (queries[q].call(device) != NVML_SUCCESS) errors++;
+      samples[i] = monotonic_ns() - t0;
+    }
+    uint64_t elapsed = monotonic_ns() - start;
+    qsort(samples, iterations, sizeof(uint64_t), compare_u64);
+
+    double p50 = percentile(samples, iterations, 50) / 1e3;
+    double p90 = percentile(samples, iterations, 90) / 1e3;
+    double p99 = percentile(samples, iterations, 99) / 1e3;
+    double max = samples[iterations - 1] / 1e3;
+    double rate = elapsed ? iterations * 1e9 / elapsed : 0.0;
+
+    if (json) {
+      printf("        \"%s\": {\"p50_us\": %.2f, \"p90_us\": %.2f, \"p99_us\": %.2f, "
+             "\"max_us\": %.2f, \"calls_per_sec\": %.1f, \"errors\": %d}%s\n",
+             queries[q].name, p50, p90, p99, max, rate, errors, q == QUERY_COUNT - 1 ? "" : ",");
+    } else {
+      printf("%-18s %10.2f %10.2f %10.2f %10.2f %10.1f %7d\n", queries[q].name, p50, p90, p99,
+             max, rate, errors);
+    }
+  }
+
+  if (json) {
+    printf("      }\n");
+    printf("    }%s\n", is_last ? "" : ",");
+  } else {
+    printf("\n");
+  }
+  fflush(stdout);
+  free(samples);
+}
+
+void profile_print_footer(int json) {
+  if (json) {
+    printf("  ]\n");
+    printf("}\n");
+  }
+}
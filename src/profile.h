@@ -0,0 +1,21 @@
+#ifndef NVML_TOOL_PROFILE_H
+#define NVML_TOOL_PROFILE_H
+
+#include <nvml.h>
+#include <stdint.h>
+
+#define DEFAULT_PROFILE_ITERATIONS 200
+
+// One-time setup costs, measured by main() before the per-device loop
+typedef struct {
+  uint64_t init_ns;
+  uint64_t pci_scan_ns; // 0 if the PCI scan failed
+} profile_setup_t;
+
+// Output is framed like info json: a header, one record per device, then a footer
+void profile_print_header(const profile_setup_t* setup, int iterations, int json);
+void profile_device(nvmlDevice_t device, int device_id, uint64_t handle_ns, int iterations,
+                    int json, int is_last);
+void profile_print_footer(int json);
+
+#endif
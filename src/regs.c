@@ -0,0 +1,128 @@
+#define _GNU_SOURCE
+#include "regs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Offsets and encodings as found by gputemps and gddr6-core-junction-vram-temps
+#define VRAM_E2A8 {0x0000E2A8, 0xfff, 0, 32, 0x7f}
+#define VRAM_EE50 {0x0000EE50, 0xfff, 0, 32, 0x7f}
+#define HOTSPOT {0x0002046C, 0xff, 8, 1, 0x7f}
+
+static const reg_layout_t layouts[] = {
+    {0x2684, {VRAM_E2A8, HOTSPOT}}, // AD102 RTX 4090
+    {0x2685, {VRAM_E2A8, HOTSPOT}}, // AD102 RTX 4090 D
+    {0x26b1, {VRAM_E2A8, HOTSPOT}}, // AD102 RTX 6000 Ada
+    {0x26b9, {VRAM_E2A8, HOTSPOT}}, // AD102 L40S
+    {0x2702, {VRAM_E2A8, HOTSPOT}}, // AD103 RTX 4080 SUPER
+    {0x2704, {VRAM_E2A8, HOTSPOT}}, // AD103 RTX 4080
+    {0x2782, {VRAM_E2A8, HOTSPOT}}, // AD104 RTX 4070 Ti
+    {0x2786, {VRAM_E2A8, HOTSPOT}}, // AD104 RTX 4070
+    {0x27b8, {VRAM_E2A8, HOTSPOT}}, // AD104 L4
+    {0x2203, {VRAM_E2A8, HOTSPOT}}, // GA102 RTX 3090 Ti
+    {0x2204, {VRAM_E2A8, HOTSPOT}}, // GA102 RTX 3090
+    {0x2206, {VRAM_E2A8, HOTSPOT}}, // GA102 RTX 3080
+    {0x2208, {VRAM_E2A8, HOTSPOT}}, // GA102 RTX 3080 Ti
+    {0x2216, {VRAM_E2A8, HOTSPOT}}, // GA102 RTX 3080 LHR
+    {0x2230, {VRAM_E2A8, HOTSPOT}}, // GA102 RTX A6000
+    {0x2232, {VRAM_E2A8, HOTSPOT}}, // GA102 RTX A4500
+    {0x2484, {VRAM_EE50, HOTSPOT}}, // GA104 RTX 3070
+    {0x2488, {VRAM_EE50, HOTSPOT}}, // GA104 RTX 3070 LHR
+    {0x2531, {VRAM_E2A8, HOTSPOT}}, // GA106 RTX A2000
+    {0x2571, {VRAM_E2A8, HOTSPOT}}, // GA106 RTX A2000 12GB
+};
+
+// Anything else gets the most common VRAM register and no hotspot
+static const reg_layout_t default_layout = {0, {VRAM_E2A8, {0, 0, 0, 0, 0}}};
+
+const reg_layout_t* regs_layout(unsigned int device_id) {
+  for (size_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++)
+    if (layouts[i].device_id == device_id) return &layouts[i];
+  return &default_layout;
+}
+
+// Map the pages of fd covering every register of layout, BAR0 starting at bar_offset in
+// the file. Closes fd.
+static int map_registers(gpu_regs_t* regs, const reg_layout_t* layout, int fd, off_t bar_offset,
+                         const char* path) {
+  uint32_t first = UINT32_MAX, last = 0;
+  for (int s = 0; s < REG_SENSORS; s++) {
+    const reg_field_t* f = &layout->field[s];
+    if (!f->offset) continue;
+    if (f->offset < first) first = f->offset;
+    if (f->offset + sizeof(uint32_t) > last) last = f->offset + sizeof(uint32_t);
+  }
+
+  long page = sysconf(_SC_PAGE_SIZE);
+  off_t start = (bar_offset + first) & ~(off_t)(page - 1);
+  size_t size = ((bar_offset + last - start) + page - 1) & ~(size_t)(page - 1);
+
+  // Reading past the end of a regular file mapping raises SIGBUS, so check it up front
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size < start + (off_t)size) {
+    fprintf(stderr, "Error: %s is too small to contain BAR0 registers up to 0x%llx\n", path,
+            (unsigned long long)(bar_offset + last));
+    close(fd);
+    return -1;
+  }
+
+  void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, start);
+  close(fd); // The mapping stays valid after the descriptor is closed
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Error: Failed to map %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  regs->layout = layout;
+  regs->map_base = map;
+  regs->map_size = size;
+  regs->map_offset = (uint32_t)(start - bar_offset);
+  return 0;
+}
+
+int regs_open_mem(gpu_regs_t* regs, const reg_layout_t* layout, uint64_t bar0,
+                  const char* mem_path) {
+  memset(regs, 0, sizeof(*regs));
+  int fd = open(mem_path, O_RDONLY | O_SYNC | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Failed to open %s (root required): %s\n", mem_path, strerror(errno));
+    return -1;
+  }
+  return map_registers(regs, layout, fd, (off_t)(bar0 & 0xFFFFFFFF), mem_path);
+}
+
+int regs_open_sysfs(gpu_regs_t* regs, const reg_layout_t* layout, const char* address,
+                    const char* sysfs_root) {
+  memset(regs, 0, sizeof(*regs));
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/bus/pci/devices/%s/resource0", sysfs_root, address);
+  int fd = open(path, O_RDONLY | O_SYNC | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Failed to open %s (root required): %s\n", path, strerror(errno));
+    return -1;
+  }
+  return map_registers(regs, layout, fd, 0, path);
+}
+
+void regs_close(gpu_regs_t* regs) {
+  if (regs->map_base) munmap(regs->map_base, regs->map_size);
+  regs->map_base = NULL;
+}
+
+static int read_field(const gpu_regs_t* regs, const reg_field_t* f, unsigned int* temp) {
+  if (!f->offset || !regs->map_base) return -1;
+  const volatile uint32_t* reg =
+      (const volatile uint32_t*)((const char*)regs->map_base + (f->offset - regs->map_offset));
+  *temp = ((*reg >> f->shift) & f->mask) / f->divisor;
+  return *temp < f->limit ? 0 : -1;
+}
+
+int regs_read(const gpu_regs_t* regs, reg_sensor_t sensor, unsigned int* temp) {
+  return read_field(regs, &regs->layout->field[sensor], temp);
+}
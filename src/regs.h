@@ -0,0 +1,64 @@
+#ifndef NVML_TOOL_REGS_H
+#define NVML_TOOL_REGS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Temperature sensors NVML does not expose, read from undocumented BAR0 registers. Where the
+// registers sit depends on the GPU, so they are looked up by PCI device ID in a table; every
+// sensor of a device is served from one read-only mapping of the BAR.
+
+#define REGS_SYSFS_ROOT "/sys"
+
+typedef enum {
+  REG_VRAM,    // GDDR6/GDDR6X junction
+  REG_HOTSPOT, // Hottest point on the die
+  REG_SENSORS
+} reg_sensor_t;
+
+typedef enum {
+  REG_ACCESS_MEM,  // Physical memory (/dev/mem) at the BAR0 address from libpci
+  REG_ACCESS_SYSFS // The BAR itself, /sys/bus/pci/devices/<address>/resource0
+} reg_access_t;
+
+// A reading is ((reg >> shift) & mask) / divisor degrees C, valid below limit
+typedef struct {
+  uint32_t offset; // From the start of BAR0, 0 if the device has no such sensor
+  uint32_t mask;
+  uint8_t shift;
+  uint8_t divisor;
+  uint8_t limit;
+} reg_field_t;
+
+typedef struct {
+  uint16_t device_id; // PCI device ID, 0 for the layout assumed for unlisted devices
+  reg_field_t field[REG_SENSORS];
+} reg_layout_t;
+
+typedef struct {
+  const reg_layout_t* layout;
+  void* map_base;
+  size_t map_size;
+  uint32_t map_offset; // BAR0 offset of map_base
+} gpu_regs_t;
+
+// Register layout for a PCI device ID (the upper 16 bits of nvmlPciInfo_t.pciDeviceId)
+const reg_layout_t* regs_layout(unsigned int device_id);
+
+// Map the pages holding layout's registers from mem_path, a file laid out like physical memory
+// (normally /dev/mem), given BAR0 as reported by libpci. Returns 0 on success.
+int regs_open_mem(gpu_regs_t* regs, const reg_layout_t* layout, uint64_t bar0,
+                  const char* mem_path);
+
+// Map them from sysfs_root/bus/pci/devices/ADDRESS/resource0, ADDRESS being the sysfs form
+// "dddd:bb:dd.f". No bus scan and no /dev/mem are involved. Returns 0 on success.
+int regs_open_sysfs(gpu_regs_t* regs, const reg_layout_t* layout, const char* address,
+                    const char* sysfs_root);
+
+void regs_close(gpu_regs_t* regs);
+
+// Read one sensor. Returns 0 on success, -1 if the device has no such sensor or the reading is
+// implausible.
+int regs_read(const gpu_regs_t* regs, reg_sensor_t sensor, unsigned int* temp);
+
+#endif
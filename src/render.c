@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+#include "render.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// Unchanged cells between two changed spans are rewritten rather than skipped when the gap is
+// shorter than a cursor-forward sequence
+#define RENDER_MERGE_GAP 4
+
+// Longest escape sequence emitted per span: "\033[NNNNNA\r\033[NNNNNC"
+#define RENDER_SPAN_OVERHEAD 24
+
+int render_init(render_t* r, int fd, int rows, int cols) {
+  memset(r, 0, sizeof(*r));
+  struct winsize ws;
+  if (ioctl(fd, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 1 && ws.ws_col - 1 < cols)
+    cols = ws.ws_col - 1; // Writing the last column leaves some terminals in a pending wrap
+  if (rows < 1 || cols < 1) return -1;
+
+  r->fd = fd;
+  r->rows = rows;
+  r->cols = cols;
+  // Worst case is every span separated by the merge gap; allocating for a span per cell
+  // covers it with room to spare
+  r->out_cap = (size_t)rows * cols * (RENDER_SPAN_OVERHEAD + 1) + RENDER_SPAN_OVERHEAD;
+  r->front = malloc((size_t)rows * cols);
+  r->back = malloc((size_t)rows * cols);
+  r->out = malloc(r->out_cap);
+  if (!r->front || !r->back || !r->out) {
+    render_free(r);
+    return -1;
+  }
+  memset(r->back, ' ', (size_t)rows * cols);
+  return 0;
+}
+
+void render_free(render_t* r) {
+  free(r->front);
+  free(r->back);
+  free(r->out);
+  r->front = r->back = r->out = NULL;
+}
+
+void render_printf(render_t* r, int row, const char* fmt, ...) {
+  if (row < 0 || row >= r->rows) return;
+  char line[r->cols + 1];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  if (n < 0) n = 0;
+  if (n > r->cols) n = r->cols;
+
+  char* cells = r->back + (size_t)row * r->cols;
+  memcpy(cells, line, n);
+  memset(cells + n, ' ', r->cols - n);
+}
+
+static void emit(render_t* r, const char* data, size_t len) {
+  memcpy(r->out + r->out_len, data, len);
+  r->out_len += len;
+}
+
+static void emit_move(render_t* r, const char* fmt, int n) {
+  r->out_len += sprintf(r->out + r->out_len, fmt, n);
+}
+
+static size_t write_out(render_t* r) {
+  size_t done = 0;
+  while (done < r->out_len) {
+    ssize_t w = write(r->fd, r->out + done, r->out_len - done);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) break;
+    done += w;
+  }
+  r->out_len = 0;
+  return done;
+}
+
+// Length of a row without trailing blanks
+static int trimmed_length(const char* cells, int cols) {
+  while (cols > 0 && cells[cols - 1] == ' ') cols--;
+  return cols;
+}
+
+size_t render_flush(render_t* r) {
+  size_t cells = (size_t)r->rows * r->cols;
+
+  // First frame: print every row and leave the cursor on the line below the region
+  if (!r->drawn) {
+    for (int row = 0; row < r->rows; row++) {
+      const char* line = r->back + (size_t)row * r->cols;
+      emit(r, line, trimmed_length(line, r->cols));
+      emit(r, "\n", 1);
+    }
+    memcpy(r->front, r->back, cells);
+    r->drawn = 1;
+    return write_out(r);
+  }
+
+  int cursor_row = r->rows; // Line below the region, column 0
+  int cursor_col = 0;
+  for (int row = 0; row < r->rows; row++) {
+    const char* old = r->front + (size_t)row * r->cols;
+    const char* new = r->back + (size_t)row * r->cols;
+    int end = trimmed_length(new, r->cols);
+    int old_end = trimmed_length(old, r->cols);
+
+    int col = 0;
+    while (col < r->cols) {
+      if (old[col] == new[col]) {
+        col++;
+        continue;
+      }
+      // Extend the span until RENDER_MERGE_GAP equal cells in a row
+      int span_end = col + 1, equal = 0;
+      for (int c = span_end; c < r->cols && equal < RENDER_MERGE_GAP; c++) {
+        if (old[c] == new[c]) {
+          equal++;
+        } else {
+          equal = 0;
+          span_end = c + 1;
+        }
+      }
+
+      if (cursor_row > row) emit_move(r, "\033[%dA", cursor_row - row);
+      if (cursor_row < row) emit_move(r, "\033[%dB", row - cursor_row);
+      if (col > cursor_col) {
+        emit_move(r, "\033[%dC", col - cursor_col);
+      } else if (col < cursor_col) {
+        emit(r, "\r", 1);
+        if (col > 0) emit_move(r, "\033[%dC", col);
+      }
+      cursor_row = row;
+
+      // Blanking the tail of a shrinking line is one erase rather than a run of spaces
+      if (span_end >= end && old_end > end) {
+        if (end > col) emit(r, new + col, end - col);
+        emit(r, "\033[K", 3);
+        cursor_col = end > col ? end : col;
+        break;
+      }
+      emit(r, new + col, span_end - col);
+      cursor_col = span_end;
+      col = span_end;
+    }
+  }
+
+  if (cursor_row == r->rows && cursor_col == 0) return 0; // Nothing changed
+  if (cursor_row < r->rows) emit_move(r, "\033[%dB", r->rows - cursor_row);
+  emit(r, "\r", 1);
+  memcpy(r->front, r->back, cells);
+  return write_out(r);
+}
@@ -0,0 +1,35 @@
+#ifndef NVML_TOOL_RENDER_H
+#define NVML_TOOL_RENDER_H
+
+#include <stddef.h>
+
+// Double-buffered text region at the bottom of a terminal. A frame is composed into the back
+// buffer; render_flush() compares it with what is on screen and redraws only the changed cells,
+// with relative cursor motion, in a single write(). The region is clipped to the terminal width
+// so lines never wrap, which would break the cursor arithmetic.
+typedef struct {
+  int fd;
+  int rows;
+  int cols;
+  int drawn; // Nonzero once the first frame has been printed
+  char* front; // rows * cols cells as last written to the terminal
+  char* back;  // Frame being composed
+  char* out;   // Escape sequences and text for one flush
+  size_t out_len;
+  size_t out_cap;
+} render_t;
+
+// Allocate a region of rows lines and up to cols columns on fd. Returns 0 on success.
+int render_init(render_t* r, int fd, int rows, int cols);
+
+void render_free(render_t* r);
+
+// Format one line of the next frame. Anything beyond the region width is cut off; rows not
+// written since the last flush keep their previous contents.
+void render_printf(render_t* r, int row, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// Bring the terminal up to date with the back buffer. Returns the number of bytes written.
+size_t render_flush(render_t* r);
+
+#endif
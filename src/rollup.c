@@ -0,0 +1,328 @@
+#define _GNU_SOURCE
+#include "rollup.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const unsigned int rollup_period_ms[ROLLUP_LEVELS] = {60000, 600000, 3600000, 86400000};
+const char* const rollup_suffix[ROLLUP_LEVELS] = {".1m", ".10m", ".1h", ".1d"};
+
+static int add_point(rollup_acc_t* acc, double value, double weight) {
+  // Runs of equal samples share a point
+  if (acc->point_count > 0 && acc->points[acc->point_count - 1].value == value) {
+    acc->points[acc->point_count - 1].weight += weight;
+    return 0;
+  }
+  if (acc->point_count == acc->point_cap) {
+    size_t cap = acc->point_cap ? acc->point_cap * 2 : 64;
+    rollup_point_t* points = realloc(acc->points, cap * sizeof(rollup_point_t));
+    if (!points) return -1;
+    acc->points = points;
+    acc->point_cap = cap;
+  }
+  acc->points[acc->point_count++] = (rollup_point_t){value, weight};
+  return 0;
+}
+
+static void add_range(rollup_acc_t* acc, uint64_t sum, uint32_t count, uint32_t min,
+                      uint32_t max) {
+  if (acc->count == 0 || min < acc->min) acc->min = min;
+  if (acc->count == 0 || max > acc->max) acc->max = max;
+  acc->sum += sum;
+  acc->count += count;
+}
+
+int rollup_acc_add_value(rollup_acc_t* acc, uint32_t value) {
+  add_range(acc, value, 1, value, value);
+  return add_point(acc, value, 1);
+}
+
+int rollup_acc_add_stat(rollup_acc_t* acc, const rollup_stat_t* stat) {
+  if (stat->count == 0) return 0;
+  add_range(acc, stat->sum, stat->count, stat->min, stat->max);
+  // The bins may have been scaled down to fit; spread the true count over them
+  double total = 0;
+  for (int bin = 0; bin < ROLLUP_BINS; bin++) total += stat->hist[bin];
+  double width = (stat->max + 1.0 - stat->min) / ROLLUP_BINS;
+  for (int bin = 0; bin < ROLLUP_BINS; bin++)
+    if (stat->hist[bin] && add_point(acc, stat->min + (bin + 0.5) * width,
+                                     stat->hist[bin] * stat->count / total) != 0)
+      return -1;
+  return 0;
+}
+
+static int compare_points(const void* a, const void* b) {
+  double x = ((const rollup_point_t*)a)->value, y = ((const rollup_point_t*)b)->value;
+  return x < y ? -1 : x > y;
+}
+
+double rollup_acc_quantile(rollup_acc_t* acc, double q) {
+  if (acc->point_count == 0) return 0;
+  qsort(acc->points, acc->point_count, sizeof(rollup_point_t), compare_points);
+  double total = 0;
+  for (size_t i = 0; i < acc->point_count; i++) total += acc->points[i].weight;
+
+  double rank = q * total, value = acc->points[acc->point_count - 1].value;
+  double seen = 0;
+  for (size_t i = 0; i < acc->point_count; i++) {
+    seen += acc->points[i].weight;
+    if (seen >= rank) {
+      value = acc->points[i].value;
+      break;
+    }
+  }
+  if (value < acc->min) value = acc->min;
+  if (value > acc->max) value = acc->max;
+  return value;
+}
+
+void rollup_acc_clear(rollup_acc_t* acc) {
+  acc->sum = 0;
+  acc->count = acc->min = acc->max = 0;
+  acc->point_count = 0;
+}
+
+void rollup_acc_free(rollup_acc_t* acc) {
+  free(acc->points);
+  memset(acc, 0, sizeof(*acc));
+}
+
+// Encode an accumulator as a bucket aggregate and reset it
+static void finish(rollup_acc_t* acc, rollup_stat_t* out) {
+  memset(out, 0, sizeof(*out));
+  if (acc->count > 0) {
+    out->sum = acc->sum;
+    out->count = acc->count;
+    out->min = acc->min;
+    out->max = acc->max;
+    double width = (acc->max + 1.0 - acc->min) / ROLLUP_BINS;
+    double bins[ROLLUP_BINS] = {0}, top = 0;
+    for (size_t i = 0; i < acc->point_count; i++) {
+      int bin = (int)((acc->points[i].value - acc->min) / width);
+      if (bin < 0) bin = 0;
+      if (bin >= ROLLUP_BINS) bin = ROLLUP_BINS - 1;
+      bins[bin] += acc->points[i].weight;
+      if (bins[bin] > top) top = bins[bin];
+    }
+    // Only the shape matters to readers, so busy buckets are scaled down to fit 16 bits
+    double scale = top > UINT16_MAX ? UINT16_MAX / top : 1.0;
+    for (int bin = 0; bin < ROLLUP_BINS; bin++) {
+      out->hist[bin] = (uint16_t)(bins[bin] * scale + 0.5);
+      if (bins[bin] > 0 && out->hist[bin] == 0) out->hist[bin] = 1;
+    }
+  }
+  rollup_acc_clear(acc);
+}
+
+static int pwrite_full(int fd, const void* buf, size_t len, off_t offset) {
+  const char* p = buf;
+  while (len > 0) {
+    ssize_t w = pwrite(fd, p, len, offset);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return -1;
+    p += w;
+    len -= w;
+    offset += w;
+  }
+  return 0;
+}
+
+static int add_record(rollup_writer_t* w, int level, uint64_t bucket, const rollup_stat_t* record);
+
+// Write out the bucket being accumulated at level, merge it into the next level and mark every
+// bucket before final_buckets as final
+static int close_bucket(rollup_writer_t* w, int level, uint64_t final_buckets) {
+  rollup_level_t* l = &w->level[level];
+  int stats = w->device_count * TLOG_COLUMNS;
+  for (int i = 0; i < stats; i++) finish(&l->acc[i], &l->record[i]);
+  l->has_data = 0;
+
+  // The record goes out before the bucket count, so readers never see a final bucket unwritten
+  off_t offset = sizeof(rollup_header_t) + (off_t)l->bucket * w->record_size;
+  if (pwrite_full(l->fd, l->record, w->record_size, offset) != 0 ||
+      pwrite_full(l->fd, &final_buckets, sizeof(final_buckets),
+                  offsetof(rollup_header_t, buckets)) != 0) {
+    fprintf(stderr, "Error: Cannot write rollup: %s\n", strerror(errno));
+    return -1;
+  }
+  if (level + 1 == ROLLUP_LEVELS) return 0;
+  uint64_t parent = l->bucket * rollup_period_ms[level] / rollup_period_ms[level + 1];
+  return add_record(w, level + 1, parent, l->record);
+}
+
+static int add_record(rollup_writer_t* w, int level, uint64_t bucket, const rollup_stat_t* record) {
+  rollup_level_t* l = &w->level[level];
+  if (l->has_data && bucket != l->bucket && close_bucket(w, level, bucket) != 0) return -1;
+  l->bucket = bucket;
+  l->has_data = 1;
+  for (int i = 0; i < w->device_count * TLOG_COLUMNS; i++)
+    if (rollup_acc_add_stat(&l->acc[i], &record[i]) != 0) {
+      fprintf(stderr, "Error: Out of memory\n");
+      return -1;
+    }
+  return 0;
+}
+
+int rollup_add(rollup_writer_t* w, uint64_t ms, const tlog_sample_t* samples) {
+  rollup_level_t* l = &w->level[0];
+  uint64_t bucket = ms / rollup_period_ms[0];
+  if (l->has_data && bucket != l->bucket && close_bucket(w, 0, bucket) != 0) return -1;
+  l->bucket = bucket;
+  l->has_data = 1;
+  for (int d = 0; d < w->device_count; d++)
+    for (int c = 0; c < TLOG_COLUMNS; c++)
+      if ((samples[d].valid & TLOG_VALID(c)) &&
+          rollup_acc_add_value(&l->acc[d * TLOG_COLUMNS + c], samples[d].value[c]) != 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return -1;
+      }
+  return 0;
+}
+
+int rollup_create(rollup_writer_t* w, const char* log_path, int device_count,
+                  uint64_t start_realtime_ns) {
+  memset(w, 0, sizeof(*w));
+  w->device_count = device_count;
+  w->record_size = sizeof(rollup_stat_t) * device_count * TLOG_COLUMNS;
+  for (int i = 0; i < ROLLUP_LEVELS; i++) w->level[i].fd = -1;
+
+  for (int i = 0; i < ROLLUP_LEVELS; i++) {
+    rollup_level_t* l = &w->level[i];
+    char path[4096];
+    snprintf(path, sizeof(path), "%s%s", log_path, rollup_suffix[i]);
+    l->acc = calloc(device_count * TLOG_COLUMNS, sizeof(rollup_acc_t));
+    l->record = malloc(w->record_size);
+    if (!l->acc || !l->record) {
+      fprintf(stderr, "Error: Out of memory\n");
+      rollup_close(w);
+      return -1;
+    }
+
+    rollup_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ROLLUP_MAGIC, sizeof(header.magic));
+    header.version = ROLLUP_VERSION;
+    header.header_size = sizeof(header);
+    header.device_count = device_count;
+    header.period_ms = rollup_period_ms[i];
+    header.start_realtime_ns = start_realtime_ns;
+    header.record_size = w->record_size;
+    l->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (l->fd < 0 || pwrite_full(l->fd, &header, sizeof(header), 0) != 0) {
+      fprintf(stderr, "Error: Cannot create %s: %s\n", path, strerror(errno));
+      rollup_close(w);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int rollup_close(rollup_writer_t* w) {
+  int ret = 0;
+  // Finer levels first, so each partial bucket is merged into its parent before that closes
+  for (int i = 0; i < ROLLUP_LEVELS; i++) {
+    rollup_level_t* l = &w->level[i];
+    if (l->fd >= 0 && l->has_data && ret == 0) ret = close_bucket(w, i, l->bucket + 1);
+  }
+  for (int i = 0; i < ROLLUP_LEVELS; i++) {
+    rollup_level_t* l = &w->level[i];
+    if (l->fd >= 0 && close(l->fd) != 0) ret = -1;
+    if (l->acc)
+      for (int s = 0; s < w->device_count * TLOG_COLUMNS; s++) rollup_acc_free(&l->acc[s]);
+    free(l->acc);
+    free(l->record);
+    l->acc = NULL;
+    l->record = NULL;
+    l->fd = -1;
+  }
+  return ret;
+}
+
+int rollup_open(rollup_reader_t* r, const char* log_path) {
+  memset(r, 0, sizeof(*r));
+  for (int i = 0; i < ROLLUP_LEVELS; i++) {
+    rollup_file_t* f = &r->level[i];
+    char path[4096];
+    snprintf(path, sizeof(path), "%s%s", log_path, rollup_suffix[i]);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      int saved = errno;
+      rollup_close_reader(r);
+      errno = saved;
+      return -1;
+    }
+
+    // The bucket count is read before the size, so every final bucket lies within the mapping
+    rollup_header_t h;
+    struct stat st;
+    int valid = pread(fd, &h, sizeof(h), 0) == sizeof(h) && fstat(fd, &st) == 0 &&
+                memcmp(h.magic, ROLLUP_MAGIC, sizeof(h.magic)) == 0 &&
+                h.version == ROLLUP_VERSION && h.header_size == sizeof(h) &&
+                h.period_ms == rollup_period_ms[i] && h.device_count > 0 &&
+                h.record_size == sizeof(rollup_stat_t) * h.device_count * TLOG_COLUMNS &&
+                (i == 0 || (h.device_count == (uint32_t)r->device_count &&
+                            h.start_realtime_ns == r->start_realtime_ns));
+    void* map = valid ? mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+      rollup_close_reader(r);
+      errno = EINVAL;
+      return -1;
+    }
+    f->map = map;
+    f->size = st.st_size;
+    f->buckets = h.buckets;
+    f->period_ms = h.period_ms;
+    r->device_count = h.device_count;
+    r->record_size = h.record_size;
+    r->start_realtime_ns = h.start_realtime_ns;
+  }
+  return 0;
+}
+
+void rollup_close_reader(rollup_reader_t* r) {
+  for (int i = 0; i < ROLLUP_LEVELS; i++) {
+    if (r->level[i].map) munmap((void*)r->level[i].map, r->level[i].size);
+    r->level[i].map = NULL;
+  }
+}
+
+uint64_t rollup_end_ms(const rollup_reader_t* r) {
+  return r->level[0].buckets * r->level[0].period_ms;
+}
+
+long rollup_query(const rollup_reader_t* r, uint64_t from_ms, uint64_t to_ms, rollup_acc_t* acc) {
+  uint64_t step = rollup_period_ms[0];
+  uint64_t t = from_ms / step * step;
+  uint64_t end = (to_ms + step - 1) / step * step;
+  int stats = r->device_count * TLOG_COLUMNS;
+  long reads = 0;
+
+  while (t < end) {
+    int level = ROLLUP_LEVELS - 1;
+    for (; level >= 0; level--) {
+      const rollup_file_t* f = &r->level[level];
+      if (t % f->period_ms == 0 && t + f->period_ms <= end && t / f->period_ms < f->buckets)
+        break;
+    }
+    if (level < 0) break; // Past the rolled-up data
+
+    const rollup_file_t* f = &r->level[level];
+    size_t offset = sizeof(rollup_header_t) + t / f->period_ms * r->record_size;
+    // Buckets past the end of the file had no samples
+    if (offset + r->record_size <= f->size) {
+      const rollup_stat_t* record = (const rollup_stat_t*)(f->map + offset);
+      for (int i = 0; i < stats; i++)
+        if (rollup_acc_add_stat(&acc[i], &record[i]) != 0) return -1;
+      reads++;
+    }
+    t += f->period_ms;
+  }
+  return reads;
+}
@@ -0,0 +1,132 @@
+#ifndef NVML_TOOL_ROLLUP_H
+#define NVML_TOOL_ROLLUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tlog.h"
+
+// Multi-resolution rollups of a telemetry log. Each level is a sidecar file next to the log
+// (LOG.1m, LOG.10m, LOG.1h, LOG.1d) holding one fixed-size record per bucket, so bucket k of
+// any level is a single seek:
+//
+//   rollup_header_t, then at header_size + k * record_size:
+//   rollup_stat_t[device_count][TLOG_COLUMNS] for ms offsets [k * period_ms, (k + 1) * period_ms)
+//
+// The minute level is built from the samples, every coarser level from the finer level's records,
+// as each bucket closes. Buckets below the header's bucket count are final; a record of zeros
+// (or a hole in the file) among them is a bucket without samples.
+
+#define ROLLUP_MAGIC "NVROLL01"
+#define ROLLUP_VERSION 1
+#define ROLLUP_LEVELS 4
+#define ROLLUP_BINS 16
+
+extern const unsigned int rollup_period_ms[ROLLUP_LEVELS]; // Each a multiple of the one before
+extern const char* const rollup_suffix[ROLLUP_LEVELS];
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t device_count;
+  uint32_t period_ms;
+  uint64_t start_realtime_ns; // Copied from the log header
+  uint32_t record_size;
+  uint32_t reserved0;
+  uint64_t buckets; // Buckets [0, buckets) are final
+  uint32_t reserved[4];
+} rollup_header_t;
+
+// Aggregate of one column of one device over a bucket
+typedef struct {
+  uint64_t sum;
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint32_t reserved;
+  uint16_t hist[ROLLUP_BINS]; // Relative counts in ROLLUP_BINS equal bins over [min, max + 1)
+} rollup_stat_t;
+
+typedef struct {
+  double value;
+  double weight; // Samples at value
+} rollup_point_t;
+
+// Accumulates samples, or the histograms of finer buckets, into one aggregate. Every histogram
+// bin becomes a point at its midpoint, so merged quantiles are accurate to half a bin of the
+// finest bucket that contributed.
+typedef struct {
+  uint64_t sum;
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  rollup_point_t* points;
+  size_t point_count;
+  size_t point_cap;
+} rollup_acc_t;
+
+int rollup_acc_add_value(rollup_acc_t* acc, uint32_t value);
+int rollup_acc_add_stat(rollup_acc_t* acc, const rollup_stat_t* stat);
+
+// Value below which fraction q of the accumulated samples lie (approximate), within [min, max]
+double rollup_acc_quantile(rollup_acc_t* acc, double q);
+
+// Reset to empty, keeping the point buffer
+void rollup_acc_clear(rollup_acc_t* acc);
+void rollup_acc_free(rollup_acc_t* acc);
+
+typedef struct {
+  int fd;
+  uint64_t bucket;       // Bucket being accumulated
+  int has_data;
+  rollup_acc_t* acc;     // device_count * TLOG_COLUMNS
+  rollup_stat_t* record; // Encoding buffer
+} rollup_level_t;
+
+typedef struct {
+  int device_count;
+  size_t record_size;
+  rollup_level_t level[ROLLUP_LEVELS];
+} rollup_writer_t;
+
+// Create (or truncate) the sidecar files of log_path. Returns 0 on success.
+int rollup_create(rollup_writer_t* w, const char* log_path, int device_count,
+                  uint64_t start_realtime_ns);
+
+// Add the frame taken ms after the start, writing out every bucket it closes. Frames must come
+// in time order. Returns 0 on success.
+int rollup_add(rollup_writer_t* w, uint64_t ms, const tlog_sample_t* samples);
+
+// Write out the partial buckets and close the files. Returns 0 on success.
+int rollup_close(rollup_writer_t* w);
+
+typedef struct {
+  const uint8_t* map;
+  size_t size;
+  uint64_t buckets; // Final buckets when opened
+  unsigned int period_ms;
+} rollup_file_t;
+
+typedef struct {
+  int device_count;
+  size_t record_size;
+  uint64_t start_realtime_ns;
+  rollup_file_t level[ROLLUP_LEVELS];
+} rollup_reader_t;
+
+// Map the sidecar files of log_path. Returns 0 on success, -1 (with errno ENOENT if they do not
+// exist) otherwise. Quiet on errors so the caller can rebuild them.
+int rollup_open(rollup_reader_t* r, const char* log_path);
+void rollup_close_reader(rollup_reader_t* r);
+
+// End of the rolled-up data in ms from the start
+uint64_t rollup_end_ms(const rollup_reader_t* r);
+
+// Merge [from_ms, to_ms), widened to whole buckets of the finest level, into
+// acc[device_count * TLOG_COLUMNS]. The window is covered by the coarsest buckets that fit, so
+// the number of records read depends on the window length and not on the size of the log.
+// Returns the number of records read, or -1 if out of memory.
+long rollup_query(const rollup_reader_t* r, uint64_t from_ms, uint64_t to_ms, rollup_acc_t* acc);
+
+#endif
@@ -0,0 +1,181 @@
+#define _GNU_SOURCE
+#include "shm.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry.h"
+#include "timeutil.h"
+
+_Static_assert(sizeof(nvml_tool_shm_header_t) == NVML_TOOL_SHM_CACHELINE, "header layout");
+_Static_assert(sizeof(nvml_tool_shm_slot_t) % NVML_TOOL_SHM_CACHELINE == 0, "slot layout");
+_Static_assert(TM_MEMORY == NVML_TOOL_SHM_MEMORY && TM_ALL == 0x7f, "valid bits");
+
+static struct {
+  int active;
+  int stopping;
+  char name[256];
+  const nvmlDevice_t* devices;
+  const int* device_ids;
+  int count;
+  unsigned int interval_ms;
+
+  nvml_tool_shm_header_t* header;
+  nvml_tool_shm_slot_t* slots;
+  size_t size;
+
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_t thread;
+} publisher;
+
+static void publish_sample(nvml_tool_shm_slot_t* slot, int device_id, const telemetry_t* t) {
+  nvml_tool_shm_sample_t s;
+  memset(&s, 0, sizeof(s));
+  s.device_id = device_id;
+  s.valid = t->valid;
+  s.temperature = t->temperature;
+  s.fan_speed = t->fan_speed;
+  s.power_usage = t->power_usage;
+  s.power_limit = t->power_limit;
+  s.timestamp_ns = t->timestamp_ns;
+  s.memory_total = t->memory.total;
+  s.memory_used = t->memory.used;
+  s.memory_free = t->memory.free;
+  memcpy(s.name, t->name, sizeof(s.name));
+  memcpy(s.uuid, t->uuid, sizeof(s.uuid));
+
+  // Seqlock write side. This thread is the only writer, so a plain increment is enough; the
+  // release fence keeps the sample stores from moving above the odd sequence number.
+  uint32_t seq = slot->seq;
+  __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(&slot->sample, &s, sizeof(s));
+  __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void publish_round(void) {
+  for (int i = 0; i < publisher.count; i++) {
+    telemetry_t t;
+    telemetry_read(publisher.devices[i], TM_ALL, &t);
+    publish_sample(&publisher.slots[i], publisher.device_ids[i], &t);
+  }
+  __atomic_store_n(&publisher.header->updated_ns, monotonic_ns(), __ATOMIC_RELEASE);
+}
+
+static void* publisher_main(void* arg) {
+  (void)arg;
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+  pthread_mutex_lock(&publisher.lock);
+  while (!publisher.stopping) {
+    timespec_add_ms(&deadline, publisher.interval_ms);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    while (!timespec_before(&now, &deadline)) timespec_add_ms(&deadline, publisher.interval_ms);
+
+    while (!publisher.stopping &&
+           pthread_cond_timedwait(&publisher.wake, &publisher.lock, &deadline) != ETIMEDOUT)
+      ;
+    if (publisher.stopping) break;
+
+    pthread_mutex_unlock(&publisher.lock);
+    publish_round();
+    pthread_mutex_lock(&publisher.lock);
+  }
+  pthread_mutex_unlock(&publisher.lock);
+  return NULL;
+}
+
+int shm_publish_start(const char* name, const nvmlDevice_t* devices, const int* device_ids,
+                      int count, unsigned int interval_ms) {
+  if (publisher.active) return 0;
+
+  if (name[0] != '/' || strchr(name + 1, '/') || strlen(name) >= sizeof(publisher.name)) {
+    fprintf(stderr, "Error: Invalid shared memory name '%s' (expected /NAME)\n", name);
+    return -1;
+  }
+
+  // Replace any segment left behind by a publisher that did not exit cleanly; readers that
+  // still map the old one keep a consistent (if stale) view until they reopen
+  shm_unlink(name);
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Failed to create shared memory %s: %s\n", name, strerror(errno));
+    return -1;
+  }
+
+  size_t size = sizeof(nvml_tool_shm_header_t) + (size_t)count * sizeof(nvml_tool_shm_slot_t);
+  void* base = MAP_FAILED;
+  if (ftruncate(fd, size) == 0)
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    fprintf(stderr, "Error: Failed to map shared memory %s: %s\n", name, strerror(errno));
+    shm_unlink(name);
+    return -1;
+  }
+
+  strcpy(publisher.name, name);
+  publisher.devices = devices;
+  publisher.device_ids = device_ids;
+  publisher.count = count;
+  publisher.interval_ms = interval_ms;
+  publisher.stopping = 0;
+  publisher.header = base;
+  publisher.slots = (nvml_tool_shm_slot_t*)((char*)base + sizeof(nvml_tool_shm_header_t));
+  publisher.size = size;
+
+  // ftruncate zero-fills, so every slot starts with seq 0 (never written)
+  nvml_tool_shm_header_t* h = publisher.header;
+  h->version = NVML_TOOL_SHM_VERSION;
+  h->header_size = sizeof(nvml_tool_shm_header_t);
+  h->slot_size = sizeof(nvml_tool_shm_slot_t);
+  h->device_count = count;
+  h->interval_ms = interval_ms;
+  h->publisher_pid = getpid();
+  h->started_ns = monotonic_ns();
+  h->alive = 1;
+
+  // Fill every slot before readers can validate the segment
+  publish_round();
+  __atomic_store_n(&h->magic, NVML_TOOL_SHM_MAGIC, __ATOMIC_RELEASE);
+
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&publisher.wake, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_mutex_init(&publisher.lock, NULL);
+
+  if (pthread_create(&publisher.thread, NULL, publisher_main, NULL) != 0) {
+    fprintf(stderr, "Error: Failed to start shared memory publisher\n");
+    munmap(base, size);
+    shm_unlink(name);
+    return -1;
+  }
+  publisher.active = 1;
+  return 0;
+}
+
+void shm_publish_stop(void) {
+  if (!publisher.active) return;
+
+  pthread_mutex_lock(&publisher.lock);
+  publisher.stopping = 1;
+  pthread_cond_signal(&publisher.wake);
+  pthread_mutex_unlock(&publisher.lock);
+  pthread_join(publisher.thread, NULL);
+
+  pthread_cond_destroy(&publisher.wake);
+  pthread_mutex_destroy(&publisher.lock);
+
+  __atomic_store_n(&publisher.header->alive, 0, __ATOMIC_RELEASE);
+  shm_unlink(publisher.name);
+  munmap(publisher.header, publisher.size);
+  publisher.active = 0;
+}
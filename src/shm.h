@@ -0,0 +1,16 @@
+#ifndef NVML_TOOL_SHM_PUBLISH_H
+#define NVML_TOOL_SHM_PUBLISH_H
+
+#include <nvml.h>
+
+#include "nvml_tool_shm.h"
+
+// Create the POSIX shared-memory segment name (see nvml_tool_shm.h for the layout) and start a
+// thread that republishes every device every interval_ms. Returns 0 on success.
+int shm_publish_start(const char* name, const nvmlDevice_t* devices, const int* device_ids,
+                      int count, unsigned int interval_ms);
+
+// Stop the publisher and unlink the segment, so readers see it disappear rather than go stale
+void shm_publish_stop(void);
+
+#endif
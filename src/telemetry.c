@@ -0,0 +1,114 @@
+#define _GNU_SOURCE
+#include "telemetry.h"
+
+#include <string.h>
+
+#include "backend.h"
+#include "timeutil.h"
+
+// Field IDs are only present in newer nvml.h headers; without them everything goes through the
+// individual queries
+static const struct {
+  unsigned int field_id;
+  unsigned int flag;
+} batched_fields[] = {
+#ifdef NVML_FI_DEV_POWER_AVERAGE
+    {NVML_FI_DEV_POWER_AVERAGE, TM_POWER}, // Same averaging as nvmlDeviceGetPowerUsage()
+#endif
+#ifdef NVML_FI_DEV_POWER_CURRENT_LIMIT
+    {NVML_FI_DEV_POWER_CURRENT_LIMIT, TM_POWER_LIMIT},
+#endif
+    {0, 0},
+};
+#define BATCHED_FIELD_COUNT (sizeof(batched_fields) / sizeof(batched_fields[0]) - 1)
+
+static unsigned int field_as_uint(const nvmlFieldValue_t* value) {
+  switch (value->valueType) {
+  case NVML_VALUE_TYPE_DOUBLE: return (unsigned int)value->value.dVal;
+  case NVML_VALUE_TYPE_UNSIGNED_LONG: return (unsigned int)value->value.ulVal;
+  case NVML_VALUE_TYPE_UNSIGNED_LONG_LONG: return (unsigned int)value->value.ullVal;
+  case NVML_VALUE_TYPE_SIGNED_LONG_LONG: return (unsigned int)value->value.sllVal;
+  default: return value->value.uiVal;
+  }
+}
+
+static void store_field(telemetry_t* out, unsigned int flag, unsigned int value) {
+  switch (flag) {
+  case TM_POWER: out->power_usage = value; break;
+  case TM_POWER_LIMIT: out->power_limit = value; break;
+  }
+  out->valid |= flag;
+}
+
+int telemetry_read(nvmlDevice_t device, unsigned int want, telemetry_t* out) {
+  int calls = 0;
+
+  memset(out, 0, sizeof(*out));
+  strcpy(out->name, "Unknown");
+  strcpy(out->uuid, "Unknown");
+  out->timestamp_ns = monotonic_ns();
+
+  if (BATCHED_FIELD_COUNT > 0) {
+    nvmlFieldValue_t values[BATCHED_FIELD_COUNT + 1];
+    unsigned int flags[BATCHED_FIELD_COUNT + 1];
+    int count = 0;
+
+    for (size_t i = 0; i < BATCHED_FIELD_COUNT; i++) {
+      if (!(want & batched_fields[i].flag)) continue;
+      memset(&values[count], 0, sizeof(values[count]));
+      values[count].fieldId = batched_fields[i].field_id;
+      flags[count++] = batched_fields[i].flag;
+    }
+
+    if (count > 0) {
+      calls++;
+      if (gpu->get_field_values(device, count, values) == NVML_SUCCESS) {
+        for (int i = 0; i < count; i++)
+          if (values[i].nvmlReturn == NVML_SUCCESS)
+            store_field(out, flags[i], field_as_uint(&values[i]));
+      }
+    }
+  }
+
+  // Individual queries for everything the batch did not cover
+  unsigned int missing = want & ~out->valid;
+
+  if (missing & TM_NAME) {
+    calls++;
+    if (gpu->get_name(device, out->name, sizeof(out->name)) == NVML_SUCCESS)
+      out->valid |= TM_NAME;
+    else
+      strcpy(out->name, "Unknown");
+  }
+  if (missing & TM_UUID) {
+    calls++;
+    if (gpu->get_uuid(device, out->uuid, sizeof(out->uuid)) == NVML_SUCCESS)
+      out->valid |= TM_UUID;
+    else
+      strcpy(out->uuid, "Unknown");
+  }
+  if (missing & TM_TEMP) {
+    calls++;
+    if (gpu->get_temperature(device, NVML_TEMPERATURE_GPU, &out->temperature) == NVML_SUCCESS)
+      out->valid |= TM_TEMP;
+  }
+  if (missing & TM_MEMORY) {
+    calls++;
+    if (gpu->get_memory_info(device, &out->memory) == NVML_SUCCESS) out->valid |= TM_MEMORY;
+  }
+  if (missing & TM_FAN) {
+    calls++;
+    if (gpu->get_fan_speed(device, &out->fan_speed) == NVML_SUCCESS) out->valid |= TM_FAN;
+  }
+  if (missing & TM_POWER) {
+    calls++;
+    if (gpu->get_power_usage(device, &out->power_usage) == NVML_SUCCESS) out->valid |= TM_POWER;
+  }
+  if (missing & TM_POWER_LIMIT) {
+    calls++;
+    if (gpu->get_power_limit(device, &out->power_limit) == NVML_SUCCESS)
+      out->valid |= TM_POWER_LIMIT;
+  }
+
+  return calls;
+}
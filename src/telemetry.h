@@ -0,0 +1,39 @@
+#ifndef NVML_TOOL_TELEMETRY_H
+#define NVML_TOOL_TELEMETRY_H
+
+#include <nvml.h>
+#include <stdint.h>
+
+#define TELEMETRY_NAME_LEN 96
+#define TELEMETRY_UUID_LEN 96
+
+// Bits in telemetry_t.valid, also used as the request mask for telemetry_read()
+#define TM_NAME (1u << 0)
+#define TM_UUID (1u << 1)
+#define TM_TEMP (1u << 2)
+#define TM_FAN (1u << 3)
+#define TM_POWER (1u << 4)
+#define TM_POWER_LIMIT (1u << 5)
+#define TM_MEMORY (1u << 6)
+#define TM_ALL 0x7fu
+
+// One point-in-time reading of a device, shared by all output formatters
+typedef struct {
+  unsigned int valid; // TM_* bits that were read successfully
+  uint64_t timestamp_ns; // CLOCK_MONOTONIC at the start of the read
+  char name[TELEMETRY_NAME_LEN];
+  char uuid[TELEMETRY_UUID_LEN];
+  unsigned int temperature; // C
+  unsigned int fan_speed;   // %
+  unsigned int power_usage; // mW
+  unsigned int power_limit; // mW
+  nvmlMemory_t memory;
+} telemetry_t;
+
+// Read the requested TM_* fields. Values that have an NVML field ID are fetched together with a
+// single nvmlDeviceGetFieldValues() call; anything the batch could not provide falls back to the
+// individual query. Fields that could not be read keep their defaults (0, "Unknown").
+// Returns the number of backend calls made.
+int telemetry_read(nvmlDevice_t device, unsigned int want, telemetry_t* out);
+
+#endif
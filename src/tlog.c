@@ -0,0 +1,262 @@
+#define _GNU_SOURCE
+#include "tlog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define VARINT_MAX 10 // Bytes for a 64-bit LEB128 value
+
+static uint8_t* put_varint(uint8_t* p, uint64_t v) {
+  while (v >= 0x80) {
+    *p++ = (uint8_t)v | 0x80;
+    v >>= 7;
+  }
+  *p++ = (uint8_t)v;
+  return p;
+}
+
+// Returns NULL if the varint runs past end
+static const uint8_t* get_varint(const uint8_t* p, const uint8_t* end, uint64_t* v) {
+  uint64_t result = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    uint8_t byte = *p++;
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *v = result;
+      return p;
+    }
+  }
+  return NULL;
+}
+
+static uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+
+static int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+static int write_full(int fd, const void* buf, size_t len) {
+  const char* p = buf;
+  while (len > 0) {
+    ssize_t w = write(fd, p, len);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return -1;
+    p += w;
+    len -= w;
+  }
+  return 0;
+}
+
+int tlog_create(tlog_writer_t* w, const char* path, const tlog_device_t* devices, int count,
+                unsigned int interval_ms, uint64_t start_realtime_ns) {
+  memset(w, 0, sizeof(*w));
+  w->fd = -1;
+  w->device_count = count;
+  int columns = TLOG_BLOCK_COLUMNS(count);
+  w->out_cap = sizeof(tlog_block_t) + columns * sizeof(uint32_t) +
+               (size_t)TLOG_BLOCK_FRAMES * columns * VARINT_MAX;
+  w->samples = malloc(sizeof(tlog_sample_t) * TLOG_BLOCK_FRAMES * count);
+  w->out = malloc(w->out_cap);
+  if (!w->samples || !w->out) {
+    fprintf(stderr, "Error: Out of memory\n");
+    tlog_close(w);
+    return -1;
+  }
+
+  w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  if (w->fd < 0) {
+    fprintf(stderr, "Error: Cannot create %s: %s\n", path, strerror(errno));
+    tlog_close(w);
+    return -1;
+  }
+
+  tlog_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TLOG_MAGIC, sizeof(header.magic));
+  header.version = TLOG_VERSION;
+  header.header_size = sizeof(header) + count * sizeof(tlog_device_t);
+  header.device_count = count;
+  header.interval_ms = interval_ms;
+  header.start_realtime_ns = start_realtime_ns;
+  header.block_frames = TLOG_BLOCK_FRAMES;
+  if (write_full(w->fd, &header, sizeof(header)) != 0 ||
+      write_full(w->fd, devices, count * sizeof(tlog_device_t)) != 0) {
+    fprintf(stderr, "Error: Cannot write %s: %s\n", path, strerror(errno));
+    tlog_close(w);
+    return -1;
+  }
+  w->bytes = header.header_size;
+  return 0;
+}
+
+static int flush_block(tlog_writer_t* w) {
+  if (w->frames == 0) return 0;
+  int columns = TLOG_BLOCK_COLUMNS(w->device_count);
+  tlog_block_t* block = (tlog_block_t*)w->out;
+  uint32_t* offsets = (uint32_t*)(block + 1);
+  uint8_t* base = (uint8_t*)(offsets + columns);
+  uint8_t* p = base;
+  int column = 0;
+
+  offsets[column++] = 0;
+  for (int f = 0; f < w->frames; f++) p = put_varint(p, w->ms[f] - w->ms[f ? f - 1 : 0]);
+
+  for (int d = 0; d < w->device_count; d++) {
+    offsets[column++] = p - base;
+    for (int f = 0; f < w->frames; f++)
+      p = put_varint(p, w->samples[f * w->device_count + d].valid);
+
+    for (int c = 0; c < TLOG_COLUMNS; c++) {
+      offsets[column++] = p - base;
+      uint32_t prev = 0;
+      for (int f = 0; f < w->frames; f++) {
+        const tlog_sample_t* s = &w->samples[f * w->device_count + d];
+        uint32_t value = (s->valid & TLOG_VALID(c)) ? s->value[c] : prev;
+        p = put_varint(p, zigzag((int64_t)value - prev));
+        prev = value;
+      }
+    }
+  }
+
+  block->magic = TLOG_BLOCK_MAGIC;
+  block->size = p - w->out;
+  block->frames = w->frames;
+  block->device_count = w->device_count;
+  block->first_ms = w->ms[0];
+  block->last_ms = w->ms[w->frames - 1];
+  w->frames = 0;
+  if (write_full(w->fd, w->out, block->size) != 0) {
+    fprintf(stderr, "Error: Cannot write telemetry log: %s\n", strerror(errno));
+    return -1;
+  }
+  w->bytes += block->size;
+  return 0;
+}
+
+int tlog_append(tlog_writer_t* w, uint64_t ms, const tlog_sample_t* samples) {
+  w->ms[w->frames] = ms;
+  memcpy(&w->samples[w->frames * w->device_count], samples,
+         sizeof(tlog_sample_t) * w->device_count);
+  if (++w->frames < TLOG_BLOCK_FRAMES) return 0;
+  return flush_block(w);
+}
+
+int tlog_close(tlog_writer_t* w) {
+  int ret = 0;
+  if (w->fd >= 0) {
+    ret = flush_block(w);
+    if (close(w->fd) != 0) ret = -1;
+  }
+  free(w->samples);
+  free(w->out);
+  w->samples = NULL;
+  w->out = NULL;
+  w->fd = -1;
+  return ret;
+}
+
+int tlog_open(tlog_reader_t* r, const char* path) {
+  memset(r, 0, sizeof(*r));
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Cannot open %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(tlog_header_t)) {
+    fprintf(stderr, "Error: %s is not a telemetry log\n", path);
+    close(fd);
+    return -1;
+  }
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Error: Cannot map %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  r->map = map;
+  r->size = st.st_size;
+  r->header = map;
+  r->devices = (const tlog_device_t*)(r->header + 1);
+
+  const tlog_header_t* h = r->header;
+  if (memcmp(h->magic, TLOG_MAGIC, sizeof(h->magic)) != 0 || h->version != TLOG_VERSION ||
+      h->device_count == 0 ||
+      h->header_size != sizeof(tlog_header_t) + h->device_count * sizeof(tlog_device_t) ||
+      h->header_size > r->size) {
+    fprintf(stderr, "Error: %s is not a telemetry log (or an unsupported version)\n", path);
+    tlog_close_reader(r);
+    return -1;
+  }
+  r->offset = h->header_size;
+  return 0;
+}
+
+void tlog_close_reader(tlog_reader_t* r) {
+  if (r->map) munmap((void*)r->map, r->size);
+  r->map = NULL;
+}
+
+// Entry i of a block's column offset table
+static uint32_t column_offset(const uint8_t* table, size_t i) {
+  uint32_t offset;
+  memcpy(&offset, table + i * sizeof(uint32_t), sizeof(offset));
+  return offset;
+}
+
+int tlog_read_block(tlog_reader_t* r, uint64_t* ms, tlog_sample_t* samples) {
+  if (r->size - r->offset < sizeof(tlog_block_t)) return 0;
+  // Blocks are packed back to back at any byte offset, so nothing in them is read in place
+  tlog_block_t block;
+  memcpy(&block, r->map + r->offset, sizeof(block));
+  unsigned int devices = r->header->device_count;
+  size_t columns = TLOG_BLOCK_COLUMNS(devices);
+  if (block.magic != TLOG_BLOCK_MAGIC || block.device_count != devices || block.frames == 0 ||
+      block.frames > TLOG_BLOCK_FRAMES ||
+      block.size < sizeof(tlog_block_t) + columns * sizeof(uint32_t))
+    return -1;
+  if (block.size > r->size - r->offset) return 0; // Cut short while being written
+
+  const uint8_t* offsets = r->map + r->offset + sizeof(tlog_block_t);
+  const uint8_t* base = offsets + columns * sizeof(uint32_t);
+  const uint8_t* end = r->map + r->offset + block.size;
+  for (size_t i = 0; i < columns; i++)
+    if (column_offset(offsets, i) >= (size_t)(end - base)) return -1;
+  int frames = block.frames;
+  size_t column = 0;
+
+  const uint8_t* p = base + column_offset(offsets, column++);
+  uint64_t t = block.first_ms;
+  for (int f = 0; f < frames; f++) {
+    uint64_t delta;
+    if (p >= end || !(p = get_varint(p, end, &delta))) return -1;
+    t += delta;
+    ms[f] = t;
+  }
+
+  for (unsigned int d = 0; d < devices; d++) {
+    p = base + column_offset(offsets, column++);
+    for (int f = 0; f < frames; f++) {
+      uint64_t valid;
+      if (p >= end || !(p = get_varint(p, end, &valid))) return -1;
+      samples[f * devices + d].valid = (uint32_t)valid;
+    }
+    for (int c = 0; c < TLOG_COLUMNS; c++) {
+      p = base + column_offset(offsets, column++);
+      int64_t value = 0;
+      for (int f = 0; f < frames; f++) {
+        uint64_t delta;
+        if (p >= end || !(p = get_varint(p, end, &delta))) return -1;
+        value += unzigzag(delta);
+        samples[f * devices + d].value[c] = (uint32_t)value;
+      }
+    }
+  }
+
+  r->offset += block.size;
+  return frames;
+}
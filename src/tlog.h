@@ -0,0 +1,113 @@
+#ifndef NVML_TOOL_TLOG_H
+#define NVML_TOOL_TLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary telemetry log. The file is a header with the device table, followed by self-contained
+// blocks appended with one write() each, so a crash loses at most the block being filled:
+//
+//   tlog_header_t, tlog_device_t[device_count]
+//   block: tlog_block_t, uint32_t column offsets[TLOG_BLOCK_COLUMNS(device_count)], columns
+//
+// Within a block every column is a run of LEB128 varints: the time column holds the delta in ms
+// from the previous frame, each device's valid column holds its TLOG_VALID mask per frame, and
+// each value column holds zigzag-encoded deltas from the previous frame (starting from 0, and
+// repeating the previous value where it was not read). The offset table locates any single
+// column without decoding the others. Values are stored losslessly in native byte order.
+
+#define TLOG_MAGIC "NVTLOG01"
+#define TLOG_VERSION 1
+#define TLOG_BLOCK_MAGIC 0x424c544eu // "NTLB"
+#define TLOG_BLOCK_FRAMES 64
+#define TLOG_UUID_LEN 96
+#define TLOG_NAME_LEN 96
+
+enum {
+  TLOG_TEMP,        // C
+  TLOG_VRAM_TEMP,   // C
+  TLOG_FAN,         // %
+  TLOG_POWER,       // mW
+  TLOG_POWER_LIMIT, // mW
+  TLOG_MEMORY_USED, // MiB
+  TLOG_COLUMNS
+};
+
+#define TLOG_VALID(column) (1u << (column))
+
+// Time column, then a valid column and TLOG_COLUMNS value columns per device
+#define TLOG_BLOCK_COLUMNS(devices) (1 + (devices) * (1 + TLOG_COLUMNS))
+
+typedef struct {
+  uint32_t valid; // TLOG_VALID bits
+  uint32_t value[TLOG_COLUMNS];
+} tlog_sample_t;
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size; // Header plus device table; blocks start here
+  uint32_t device_count;
+  uint32_t interval_ms;
+  uint64_t start_realtime_ns; // CLOCK_REALTIME at ms offset 0
+  uint32_t block_frames;
+  uint32_t reserved[7];
+} tlog_header_t;
+
+typedef struct {
+  int32_t device_id;
+  uint32_t reserved;
+  char uuid[TLOG_UUID_LEN];
+  char name[TLOG_NAME_LEN];
+} tlog_device_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t size; // Bytes, including this header and the offset table
+  uint32_t frames;
+  uint32_t device_count;
+  uint64_t first_ms; // Offsets from start_realtime_ns of the first and last frame
+  uint64_t last_ms;
+} tlog_block_t;
+
+typedef struct {
+  int fd;
+  int device_count;
+  int frames; // Buffered in the current block
+  uint64_t ms[TLOG_BLOCK_FRAMES];
+  tlog_sample_t* samples; // TLOG_BLOCK_FRAMES * device_count
+  uint8_t* out;           // Encoded block
+  size_t out_cap;
+  unsigned long long bytes; // Written so far, header included
+} tlog_writer_t;
+
+typedef struct {
+  const uint8_t* map;
+  size_t size;
+  const tlog_header_t* header;
+  const tlog_device_t* devices;
+  size_t offset; // Next block
+} tlog_reader_t;
+
+// Create (or truncate) path and write the header. Returns 0 on success.
+int tlog_create(tlog_writer_t* w, const char* path, const tlog_device_t* devices, int count,
+                unsigned int interval_ms, uint64_t start_realtime_ns);
+
+// Add one frame (a sample per device) taken ms after the start. Writes out a block whenever
+// TLOG_BLOCK_FRAMES frames have accumulated. Returns 0 on success.
+int tlog_append(tlog_writer_t* w, uint64_t ms, const tlog_sample_t* samples);
+
+// Write the partial block and close the file. Returns 0 on success.
+int tlog_close(tlog_writer_t* w);
+
+// Map path and validate its header. Returns 0 on success.
+int tlog_open(tlog_reader_t* r, const char* path);
+
+void tlog_close_reader(tlog_reader_t* r);
+
+// Decode the next block into ms[TLOG_BLOCK_FRAMES] and samples[TLOG_BLOCK_FRAMES *
+// device_count]. Returns the number of frames, 0 at the end of the log (including a block cut
+// short by a crash), or -1 if the block is corrupt.
+int tlog_read_block(tlog_reader_t* r, uint64_t* ms, tlog_sample_t* samples);
+
+#endif
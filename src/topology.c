@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+#include "topology.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pci/pci.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "backend.h"
+
+#define TOPOLOGY_MAGIC "NVTTOPO1"
+#define TOPOLOGY_FORMAT_VERSION 1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t device_count;
+  uint32_t reserved;
+  char backend[16];
+  char boot_id[48];
+  char driver_version[NVML_SYSTEM_DRIVER_VERSION_BUFFER_SIZE];
+} topology_header_t;
+
+static topology_device_t* topology;
+static int topology_loaded;
+
+static int cache_path(char* path, size_t size) {
+  const char* env = getenv(TOPOLOGY_CACHE_ENV);
+  if (env && strcmp(env, "off") == 0) return -1;
+  if (env && *env) return snprintf(path, size, "%s", env) < (int)size ? 0 : -1;
+  if (geteuid() == 0)
+    return snprintf(path, size, "%s", TOPOLOGY_SYSTEM_CACHE) < (int)size ? 0 : -1;
+
+  const char* xdg = getenv("XDG_CACHE_HOME");
+  const char* home = getenv("HOME");
+  int n;
+  if (xdg && *xdg)
+    n = snprintf(path, size, "%s/nvml-tool/topology", xdg);
+  else if (home && *home)
+    n = snprintf(path, size, "%s/.cache/nvml-tool/topology", home);
+  else
+    return -1;
+  return n < (int)size ? 0 : -1;
+}
+
+static int read_boot_id(char* boot_id, size_t size) {
+  FILE* f = fopen(TOPOLOGY_BOOT_ID_PATH, "r");
+  if (!f) return -1;
+  int ok = fgets(boot_id, size, f) != NULL;
+  fclose(f);
+  if (!ok) return -1;
+  boot_id[strcspn(boot_id, "\n")] = '\0';
+  return boot_id[0] ? 0 : -1;
+}
+
+static int make_key(topology_header_t* key, unsigned int device_count) {
+  memset(key, 0, sizeof(*key));
+  memcpy(key->magic, TOPOLOGY_MAGIC, sizeof(key->magic));
+  key->version = TOPOLOGY_FORMAT_VERSION;
+  key->record_size = sizeof(topology_device_t);
+  key->device_count = device_count;
+  snprintf(key->backend, sizeof(key->backend), "%s", gpu->name);
+  if (read_boot_id(key->boot_id, sizeof(key->boot_id)) != 0) return -1;
+  if (gpu->get_driver_version(key->driver_version, sizeof(key->driver_version)) != NVML_SUCCESS)
+    return -1;
+  return 0;
+}
+
+static int load(const char* path, const topology_header_t* key, topology_device_t* devices) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return -1;
+
+  topology_header_t header;
+  size_t records = (size_t)key->device_count * sizeof(topology_device_t);
+  int ok = read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+           memcmp(&header, key, sizeof(header)) == 0 &&
+           read(fd, devices, records) == (ssize_t)records;
+  close(fd);
+  return ok ? 0 : -1;
+}
+
+// Create the parent directories of path, ignoring ones that already exist
+static void make_parents(const char* path) {
+  char dir[PATH_MAX];
+  snprintf(dir, sizeof(dir), "%s", path);
+  for (char* p = dir + 1; *p; p++) {
+    if (*p != '/') continue;
+    *p = '\0';
+    mkdir(dir, 0755);
+    *p = '/';
+  }
+}
+
+// Write to a temporary file and rename it over the cache, so concurrent readers see either the
+// old or the new file, never a partial one
+static void store(const char* path, const topology_header_t* key,
+                  const topology_device_t* devices) {
+  char tmp[PATH_MAX];
+  if (snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid()) >= (int)sizeof(tmp)) return;
+  make_parents(path);
+
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) return; // Caching is best effort; an unwritable cache just means no speedup
+  size_t records = (size_t)key->device_count * sizeof(topology_device_t);
+  int ok = write(fd, key, sizeof(*key)) == (ssize_t)sizeof(*key) &&
+           write(fd, devices, records) == (ssize_t)records;
+  if (close(fd) != 0) ok = 0;
+  if (!ok || rename(tmp, path) != 0) unlink(tmp);
+}
+
+// Fill BAR0 for every device with PCI info from a single walk of the bus
+static void resolve_bar0(topology_device_t* devices, unsigned int device_count) {
+  struct pci_access* pacc = pci_alloc();
+  if (!pacc) return;
+  pci_init(pacc);
+  pci_scan_bus(pacc);
+
+  for (struct pci_dev* dev = pacc->devices; dev; dev = dev->next) {
+    pci_fill_info(dev, PCI_FILL_IDENT | PCI_FILL_BASES);
+    unsigned int id = (unsigned int)dev->device_id << 16 | dev->vendor_id;
+    for (unsigned int i = 0; i < device_count; i++) {
+      topology_device_t* t = &devices[i];
+      if ((t->valid & TOPO_PCI) && t->pci_device_id == id &&
+          t->pci_domain == (unsigned int)dev->domain && t->pci_bus == (unsigned int)dev->bus &&
+          t->pci_device == (unsigned int)dev->dev) {
+        t->bar0 = dev->base_addr[0];
+        t->valid |= TOPO_BAR0;
+      }
+    }
+  }
+  pci_cleanup(pacc);
+}
+
+// Returns the number of devices that could not be fully queried
+static int build(topology_device_t* devices, unsigned int device_count) {
+  int incomplete = 0;
+  memset(devices, 0, (size_t)device_count * sizeof(topology_device_t));
+  for (unsigned int i = 0; i < device_count; i++) {
+    topology_device_t* t = &devices[i];
+    nvmlDevice_t device;
+    t->status = gpu->get_handle_by_index(i, &device);
+    if (t->status != NVML_SUCCESS) {
+      incomplete++;
+      continue;
+    }
+
+    if (gpu->get_name(device, t->name, sizeof(t->name)) == NVML_SUCCESS) t->valid |= TOPO_NAME;
+    if (gpu->get_uuid(device, t->uuid, sizeof(t->uuid)) == NVML_SUCCESS) t->valid |= TOPO_UUID;
+
+    nvmlPciInfo_t pci;
+    if (gpu->get_pci_info(device, &pci) == NVML_SUCCESS) {
+      snprintf(t->bus_id, sizeof(t->bus_id), "%s", pci.busId);
+      t->pci_domain = pci.domain;
+      t->pci_bus = pci.bus;
+      t->pci_device = pci.device;
+      t->pci_device_id = pci.pciDeviceId;
+      t->valid |= TOPO_PCI;
+    }
+    if (gpu->get_num_fans(device, &t->num_fans) == NVML_SUCCESS) t->valid |= TOPO_FANS;
+    if (gpu->get_power_limit_constraints(device, &t->power_min_mw, &t->power_max_mw) ==
+        NVML_SUCCESS)
+      t->valid |= TOPO_POWER_LIMITS;
+    if ((t->valid & (TOPO_NAME | TOPO_UUID | TOPO_PCI)) != (TOPO_NAME | TOPO_UUID | TOPO_PCI))
+      incomplete++;
+  }
+  resolve_bar0(devices, device_count);
+  return incomplete;
+}
+
+const topology_device_t* topology_get(unsigned int device_count) {
+  if (topology_loaded) return topology;
+  topology_loaded = 1;
+
+  char path[PATH_MAX];
+  topology_header_t key;
+  if (device_count == 0 || cache_path(path, sizeof(path)) != 0 ||
+      make_key(&key, device_count) != 0)
+    return NULL;
+
+  topology = calloc(device_count, sizeof(topology_device_t));
+  if (!topology) return NULL;
+
+  // A transient failure is not persisted, so the next run tries again rather than reusing it
+  // for the rest of the boot
+  if (load(path, &key, topology) != 0 && build(topology, device_count) == 0)
+    store(path, &key, topology);
+  return topology;
+}
@@ -0,0 +1,46 @@
+#ifndef NVML_TOOL_TOPOLOGY_H
+#define NVML_TOOL_TOPOLOGY_H
+
+#include <nvml.h>
+#include <stdint.h>
+
+#define TOPOLOGY_CACHE_ENV "NVML_TOOL_CACHE"
+#define TOPOLOGY_SYSTEM_CACHE "/var/cache/nvml-tool/topology"
+#define TOPOLOGY_BOOT_ID_PATH "/proc/sys/kernel/random/boot_id"
+
+// Bits in topology_device_t.valid
+#define TOPO_NAME (1u << 0)
+#define TOPO_UUID (1u << 1)
+#define TOPO_PCI (1u << 2)
+#define TOPO_BAR0 (1u << 3)
+#define TOPO_FANS (1u << 4)
+#define TOPO_POWER_LIMITS (1u << 5)
+
+// Per-device facts that cannot change until the next boot or driver reload. Stored on disk
+// verbatim, so any change to this struct must bump TOPOLOGY_FORMAT_VERSION in topology.c.
+typedef struct {
+  int32_t status; // nvmlReturn_t of the handle lookup; nothing else is set unless NVML_SUCCESS
+  uint32_t valid; // TOPO_* bits for the values below
+  char name[96];
+  char uuid[96];
+  char bus_id[32];
+  uint32_t pci_domain;
+  uint32_t pci_bus;
+  uint32_t pci_device;
+  uint32_t pci_device_id;
+  uint64_t bar0; // BAR0 as reported by libpci (base address and flag bits)
+  uint32_t num_fans;
+  uint32_t power_min_mw;
+  uint32_t power_max_mw;
+  uint32_t reserved;
+} topology_device_t;
+
+// Return the topology of all device_count devices, loading it from the cache file or, if the
+// file is missing or was written under another boot, driver version or device count, querying
+// every device (and the PCI bus) once and rewriting the file. The cache lives at
+// $NVML_TOOL_CACHE, TOPOLOGY_SYSTEM_CACHE for root, or ~/.cache/nvml-tool/topology otherwise;
+// NVML_TOOL_CACHE=off disables it. Returns NULL if the cache is disabled or the boot cannot be
+// identified; callers then query NVML directly.
+const topology_device_t* topology_get(unsigned int device_count);
+
+#endif
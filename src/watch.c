@@ -0,0 +1,307 @@
+#define _GNU_SOURCE
+#include "watch.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "format.h"
+#include "telemetry.h"
+#include "timeutil.h"
+
+#define WATCH_RECORD_MAX 512 // Upper bound on one formatted device record
+
+// Sampled frames are handed from the sampler thread to the writer through a fixed ring. If the
+// writer falls behind (a slow pipe), the oldest frames are overwritten and counted as dropped so
+// the sampling schedule never stalls on stdout.
+typedef struct {
+  int devices;
+  telemetry_t* slots; // WATCH_RING_FRAMES * devices
+  unsigned long long head; // Next frame to write
+  unsigned long long tail; // Next frame to read
+  unsigned long long dropped;
+  int done;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+} watch_ring_t;
+
+typedef struct {
+  const nvmlDevice_t* devices;
+  int count;
+  const watch_options_t* opts;
+  volatile int* running;
+  watch_ring_t* ring;
+  telemetry_t* scratch; // One frame, filled outside the ring lock
+} watch_sampler_t;
+
+static const struct {
+  const char* name;
+  unsigned int flag;
+} watch_fields[] = {
+    {"name", TM_NAME},   {"uuid", TM_UUID},   {"temp", TM_TEMP},
+    {"fan", TM_FAN},     {"power", TM_POWER}, {"power_limit", TM_POWER_LIMIT},
+    {"memory", TM_MEMORY},
+};
+
+unsigned int watch_parse_fields(const char* list) {
+  char* copy = strdup(list);
+  char* save = NULL;
+  unsigned int mask = 0;
+
+  for (char* tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+    unsigned int flag = 0;
+    for (size_t i = 0; i < sizeof(watch_fields) / sizeof(watch_fields[0]); i++)
+      if (strcmp(tok, watch_fields[i].name) == 0) flag = watch_fields[i].flag;
+    if (!flag) {
+      fprintf(stderr, "Error: Unknown watch field '%s'\n", tok);
+      mask = 0;
+      break;
+    }
+    mask |= flag;
+  }
+
+  free(copy);
+  return mask;
+}
+
+static void* sampler_main(void* arg) {
+  watch_sampler_t* s = arg;
+  watch_ring_t* ring = s->ring;
+  const watch_options_t* opts = s->opts;
+
+  struct timespec deadline, end = {0, 0};
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  if (opts->duration_s) {
+    end = deadline;
+    end.tv_sec += opts->duration_s;
+  }
+
+  for (long frame = 0; *s->running && (!opts->count || frame < opts->count); frame++) {
+    for (int i = 0; i < s->count; i++) telemetry_read(s->devices[i], opts->fields, &s->scratch[i]);
+
+    pthread_mutex_lock(&ring->lock);
+    telemetry_t* slot = &ring->slots[(ring->head % WATCH_RING_FRAMES) * ring->devices];
+    memcpy(slot, s->scratch, sizeof(telemetry_t) * ring->devices);
+    ring->head++;
+    if (ring->head - ring->tail > WATCH_RING_FRAMES) {
+      ring->tail = ring->head - WATCH_RING_FRAMES;
+      ring->dropped++;
+    }
+    pthread_cond_signal(&ring->ready);
+    pthread_mutex_unlock(&ring->lock);
+
+    timespec_add_ms(&deadline, opts->interval_ms);
+    if (opts->duration_s && !timespec_before(&deadline, &end)) break;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    while (!timespec_before(&now, &deadline)) timespec_add_ms(&deadline, opts->interval_ms);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR && *s->running)
+      ;
+  }
+
+  pthread_mutex_lock(&ring->lock);
+  ring->done = 1;
+  pthread_cond_signal(&ring->ready);
+  pthread_mutex_unlock(&ring->lock);
+  return NULL;
+}
+
+static size_t format_csv_header(char* buf, size_t size, unsigned int fields) {
+  size_t n = snprintf(buf, size, "mono_ns,device_id");
+  if (fields & TM_NAME) n += snprintf(buf + n, size - n, ",name");
+  if (fields & TM_UUID) n += snprintf(buf + n, size - n, ",uuid");
+  if (fields & TM_TEMP) n += snprintf(buf + n, size - n, ",temperature");
+  if (fields & TM_FAN) n += snprintf(buf + n, size - n, ",fan_speed_percent");
+  if (fields & TM_POWER) n += snprintf(buf + n, size - n, ",power_usage_watts");
+  if (fields & TM_POWER_LIMIT) n += snprintf(buf + n, size - n, ",power_limit_watts");
+  if (fields & TM_MEMORY) n += snprintf(buf + n, size - n, ",memory_used_mb,memory_total_mb");
+  n += snprintf(buf + n, size - n, "\n");
+  return n;
+}
+
+// Missing values are written as null (NDJSON) or an empty cell (CSV)
+static size_t format_record(char* buf, size_t size, const telemetry_t* t, int device_id,
+                            const watch_options_t* opts) {
+  unsigned int f = opts->fields;
+  size_t n;
+
+  if (opts->format == WATCH_CSV) {
+    n = snprintf(buf, size, "%llu,%d", (unsigned long long)t->timestamp_ns, device_id);
+    if (f & TM_NAME) n += snprintf(buf + n, size - n, ",\"%s\"", t->name);
+    if (f & TM_UUID) n += snprintf(buf + n, size - n, ",%s", t->uuid);
+    if (f & TM_TEMP) {
+      if (t->valid & TM_TEMP)
+        n += snprintf(buf + n, size - n, ",%.1f",
+                      convert_temperature(t->temperature, opts->temp_unit));
+      else
+        n += snprintf(buf + n, size - n, ",");
+    }
+    if (f & TM_FAN) {
+      if (t->valid & TM_FAN)
+        n += snprintf(buf + n, size - n, ",%u", t->fan_speed);
+      else
+        n += snprintf(buf + n, size - n, ",");
+    }
+    if (f & TM_POWER) {
+      if (t->valid & TM_POWER)
+        n += snprintf(buf + n, size - n, ",%.2f", t->power_usage / 1000.0);
+      else
+        n += snprintf(buf + n, size - n, ",");
+    }
+    if (f & TM_POWER_LIMIT) {
+      if (t->valid & TM_POWER_LIMIT)
+        n += snprintf(buf + n, size - n, ",%.2f", t->power_limit / 1000.0);
+      else
+        n += snprintf(buf + n, size - n, ",");
+    }
+    if (f & TM_MEMORY) {
+      if (t->valid & TM_MEMORY)
+        n += snprintf(buf + n, size - n, ",%llu,%llu", t->memory.used / (1024 * 1024),
+                      t->memory.total / (1024 * 1024));
+      else
+        n += snprintf(buf + n, size - n, ",,");
+    }
+    n += snprintf(buf + n, size - n, "\n");
+    return n;
+  }
+
+  n = snprintf(buf, size, "{\"mono_ns\":%llu,\"device_id\":%d",
+               (unsigned long long)t->timestamp_ns, device_id);
+  if (f & TM_NAME) n += snprintf(buf + n, size - n, ",\"name\":\"%s\"", t->name);
+  if (f & TM_UUID) n += snprintf(buf + n, size - n, ",\"uuid\":\"%s\"", t->uuid);
+  if (f & TM_TEMP) {
+    if (t->valid & TM_TEMP)
+      n += snprintf(buf + n, size - n, ",\"temperature\":%.1f,\"temperature_unit\":\"%c\"",
+                    convert_temperature(t->temperature, opts->temp_unit), opts->temp_unit);
+    else
+      n += snprintf(buf + n, size - n, ",\"temperature\":null");
+  }
+  if (f & TM_FAN) {
+    if (t->valid & TM_FAN)
+      n += snprintf(buf + n, size - n, ",\"fan_speed_percent\":%u", t->fan_speed);
+    else
+      n += snprintf(buf + n, size - n, ",\"fan_speed_percent\":null");
+  }
+  if (f & TM_POWER) {
+    if (t->valid & TM_POWER)
+      n += snprintf(buf + n, size - n, ",\"power_usage_watts\":%.2f", t->power_usage / 1000.0);
+    else
+      n += snprintf(buf + n, size - n, ",\"power_usage_watts\":null");
+  }
+  if (f & TM_POWER_LIMIT) {
+    if (t->valid & TM_POWER_LIMIT)
+      n += snprintf(buf + n, size - n, ",\"power_limit_watts\":%.2f", t->power_limit / 1000.0);
+    else
+      n += snprintf(buf + n, size - n, ",\"power_limit_watts\":null");
+  }
+  if (f & TM_MEMORY) {
+    if (t->valid & TM_MEMORY)
+      n += snprintf(buf + n, size - n, ",\"memory_used_mb\":%llu,\"memory_total_mb\":%llu",
+                    t->memory.used / (1024 * 1024), t->memory.total / (1024 * 1024));
+    else
+      n += snprintf(buf + n, size - n, ",\"memory_used_mb\":null,\"memory_total_mb\":null");
+  }
+  n += snprintf(buf + n, size - n, "}\n");
+  return n;
+}
+
+static int write_all(int fd, const char* buf, size_t len) {
+  while (len > 0) {
+    ssize_t w = write(fd, buf, len);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    buf += w;
+    len -= w;
+  }
+  return 0;
+}
+
+int run_watch(const nvmlDevice_t* devices, const int* device_ids, int count,
+              const watch_options_t* opts, volatile int* running) {
+  watch_ring_t ring = {.devices = count};
+  size_t out_size = (size_t)count * WATCH_RECORD_MAX;
+  char* out = malloc(out_size);
+  telemetry_t* frame = malloc(sizeof(telemetry_t) * count);
+  telemetry_t* scratch = malloc(sizeof(telemetry_t) * count);
+  ring.slots = malloc(sizeof(telemetry_t) * count * WATCH_RING_FRAMES);
+  if (!out || !frame || !scratch || !ring.slots) {
+    fprintf(stderr, "Error: Out of memory\n");
+    free(out);
+    free(frame);
+    free(scratch);
+    free(ring.slots);
+    return -1;
+  }
+  pthread_mutex_init(&ring.lock, NULL);
+  pthread_cond_init(&ring.ready, NULL);
+
+  int ret = 0;
+  if (opts->format == WATCH_CSV) {
+    size_t n = format_csv_header(out, out_size, opts->fields);
+    if (write_all(STDOUT_FILENO, out, n) != 0) ret = -1;
+  }
+
+  watch_sampler_t sampler = {devices, count, opts, running, &ring, scratch};
+  pthread_t thread;
+  if (ret == 0 && pthread_create(&thread, NULL, sampler_main, &sampler) != 0) {
+    fprintf(stderr, "Error: Failed to start sampler thread\n");
+    ret = -1;
+  }
+
+  unsigned long long frames = 0;
+  if (ret == 0) {
+    for (;;) {
+      pthread_mutex_lock(&ring.lock);
+      while (ring.tail == ring.head && !ring.done) {
+        // Bounded wait so a signal delivered to this thread is noticed promptly
+        struct timespec timeout;
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timespec_add_ms(&timeout, 200);
+        pthread_cond_timedwait(&ring.ready, &ring.lock, &timeout);
+        if (!*running) break;
+      }
+      if (ring.tail == ring.head) {
+        int finished = ring.done || !*running;
+        pthread_mutex_unlock(&ring.lock);
+        if (finished) break;
+        continue;
+      }
+      memcpy(frame, &ring.slots[(ring.tail % WATCH_RING_FRAMES) * count],
+             sizeof(telemetry_t) * count);
+      ring.tail++;
+      pthread_mutex_unlock(&ring.lock);
+
+      size_t n = 0;
+      for (int i = 0; i < count; i++)
+        n += format_record(out + n, out_size - n, &frame[i], device_ids[i], opts);
+      if (write_all(STDOUT_FILENO, out, n) != 0) {
+        // Reader went away (EPIPE) or stdout failed: stop sampling
+        *running = 0;
+        if (errno != EPIPE) {
+          fprintf(stderr, "Error: Failed to write output: %s\n", strerror(errno));
+          ret = -1;
+        }
+        break;
+      }
+      frames++;
+    }
+    pthread_join(thread, NULL);
+  }
+
+  if (ring.dropped)
+    fprintf(stderr, "watch: %llu frames written, %llu dropped (output too slow)\n", frames,
+            ring.dropped);
+
+  pthread_cond_destroy(&ring.ready);
+  pthread_mutex_destroy(&ring.lock);
+  free(out);
+  free(frame);
+  free(scratch);
+  free(ring.slots);
+  return ret;
+}
@@ -0,0 +1,29 @@
+#ifndef NVML_TOOL_WATCH_H
+#define NVML_TOOL_WATCH_H
+
+#include <nvml.h>
+
+#define WATCH_RING_FRAMES 64
+#define WATCH_DEFAULT_FIELDS (TM_TEMP | TM_FAN | TM_POWER)
+
+typedef enum { WATCH_NDJSON, WATCH_CSV } watch_format_t;
+
+typedef struct {
+  watch_format_t format;
+  unsigned int fields; // TM_* mask
+  unsigned int interval_ms;
+  long count;           // Frames to emit, 0 for no limit
+  unsigned int duration_s; // Stop after this many seconds, 0 for no limit
+  char temp_unit;
+} watch_options_t;
+
+// Parse a comma-separated field list (name,uuid,temp,fan,power,power_limit,memory) into a TM_*
+// mask. Returns 0 on an unknown field.
+unsigned int watch_parse_fields(const char* list);
+
+// Sample the devices every interval_ms until a limit is reached or *running drops to 0,
+// streaming one frame (a record per device) per write() to stdout. Returns 0 on success.
+int run_watch(const nvmlDevice_t* devices, const int* device_ids, int count,
+              const watch_options_t* opts, volatile int* running);
+
+#endif